@@ -26,6 +26,8 @@
 #ifndef WIN64
 #include <pthread.h>
 #include <sys/stat.h>
+#include <sys/wait.h>
+#include <dirent.h>
 #endif
 
 using namespace std;
@@ -100,6 +102,19 @@ int Kangaroo::IsDir(string dirName) {
 
 }
 
+uint32_t Kangaroo::GetFileHead(std::string &fileName) {
+
+  uint32_t head = 0;
+  FILE *f = fopen(fileName.c_str(),"rb");
+  if(f) {
+    if(::fread(&head,sizeof(uint32_t),1,f) != 1)
+      head = 0;
+    fclose(f);
+  }
+  return head;
+
+}
+
 FILE *Kangaroo::ReadHeader(std::string fileName, uint32_t *version, int type) {
 
   FILE *f = fopen(fileName.c_str(),"rb");
@@ -130,11 +145,18 @@ FILE *Kangaroo::ReadHeader(std::string fileName, uint32_t *version, int type) {
     if(head==HEADK) {
       fread(&nbLoadedWalk,sizeof(uint64_t),1,f);
       ::printf("ReadHeader: %s is a kangaroo only file [2^%.2f kangaroos]\n",fileName.c_str(),log2((double)nbLoadedWalk));
-    } if(head == HEADKS) {
+    } else if(head == HEADKS) {
       fread(&nbLoadedWalk,sizeof(uint64_t),1,f);
       ::printf("ReadHeader: %s is a compressed kangaroo only file [2^%.2f kangaroos]\n",fileName.c_str(),log2((double)nbLoadedWalk));
+    } else if(head == HEADKC) {
+      fread(&nbLoadedWalk,sizeof(uint64_t),1,f);
+      ::printf("ReadHeader: %s is a compressed local kangaroo file [2^%.2f kangaroos]\n",fileName.c_str(),log2((double)nbLoadedWalk));
     } else if(head==HEADW) {
       ::printf("ReadHeader: %s is a work file, kangaroo only file expected\n",fileName.c_str());
+    } else if(head==HEADJ) {
+      ::printf("ReadHeader: %s is a DP journal file\n",fileName.c_str());
+    } else if(head==HEADM) {
+      ::printf("ReadHeader: %s is a mapped work file, use it with -i\n",fileName.c_str());
     } else {
       ::printf("ReadHeader: %s Not a work file\n",fileName.c_str());
     }
@@ -154,7 +176,10 @@ bool Kangaroo::LoadWork(string &fileName) {
 
   if(!clientMode) {
 
-    fRead = ReadHeader(fileName,NULL,HEADW);
+    bool mapped = (GetFileHead(fileName) == HEADM);
+
+    uint32_t version;
+    fRead = ReadHeader(fileName,&version,mapped ? HEADM : HEADW);
     if(fRead == NULL)
       return false;
 
@@ -185,12 +210,26 @@ bool Kangaroo::LoadWork(string &fileName) {
     ::printf("Keys :%d\n",(int)keysToSearch.size());
 
     // Read hashTable
-    hashTable.LoadTable(fRead);
+    if(mapped) {
+      // Table is used in place, pages are loaded on demand
+      uint64_t endPos = hashTable.MapTable(fileName,MAP_ALIGN(FTell(fRead)),prefault);
+      if(endPos == 0) {
+        fclose(fRead);
+        fRead = NULL;
+        return false;
+      }
+      FSeek(fRead,endPos);
+    } else if(!LoadTable(fRead,version)) {
+      fclose(fRead);
+      fRead = NULL;
+      return false;
+    }
 
   } else {
 
     // In client mode, config come from the server, file has only kangaroo
-    fRead = ReadHeader(fileName,NULL,HEADK);
+    compressedInput = (GetFileHead(fileName) == HEADKC);
+    fRead = ReadHeader(fileName,NULL,compressedInput ? HEADKC : HEADK);
     if(fRead == NULL)
       return false;
 
@@ -199,6 +238,31 @@ bool Kangaroo::LoadWork(string &fileName) {
   // Read number of walk
   fread(&nbLoadedWalk,sizeof(uint64_t),1,fRead);
 
+  if(!clientMode) {
+
+    // Replay DP journal (if any)
+    LoadJournal(fileName);
+
+    // With journal, kangaroos are stored in a separate file
+    string kName = fileName + ".kang";
+    FILE *fk = (nbLoadedWalk == 0) ? fopen(kName.c_str(),"rb") : NULL;
+    if(fk) {
+      fclose(fk);
+      bool compressed = (GetFileHead(kName) == HEADKC);
+      fk = ReadHeader(kName,NULL,compressed ? HEADKC : HEADK);
+      if(fk) {
+        fclose(fRead);
+        fRead = fk;
+        compressedInput = compressed;
+        fread(&nbLoadedWalk,sizeof(uint64_t),1,fRead);
+      }
+    }
+
+    // Restore multi-key progress (if any)
+    LoadKeyManifest(fileName);
+
+  }
+
   double t1 = Timer::get_tick();
 
   ::printf("LoadWork: [HashTable %s] [%s]\n",hashTable.GetSizeInfo().c_str(),GetTimeStr(t1 - t0).c_str());
@@ -286,6 +350,100 @@ void Kangaroo::FetchWalks(uint64_t nbWalk,std::vector<int256_t>& kangs,Int* x,In
 
 }
 
+bool Kangaroo::FetchCompressedKangaroos(TH_PARAM *threads) {
+
+  double sFetch = Timer::get_tick();
+  uint64_t nbSaved = nbLoadedWalk;
+
+  // Distances and type bitmap are read in bulk
+  restoreDist.resize(nbSaved);
+  restoreType.resize((nbSaved + 7) / 8);
+  if(::fread(restoreDist.data(),32,nbSaved,fRead) != nbSaved ||
+     ::fread(restoreType.data(),1,restoreType.size(),fRead) != restoreType.size()) {
+    ::printf("FectchKangaroos: Unexpected end of file, kangaroos will be created\n");
+    restoreDist.clear();
+    restoreType.clear();
+    nbLoadedWalk = 0;
+    return false;
+  }
+
+  // Give each thread a slice, threads rebuild their herd in parallel and
+  // start walking as soon as it is ready
+  uint64_t idx = 0;
+  for(int i = 0; i < nbCPUThread + nbGPUThread; i++) {
+    uint64_t nbKangaroo = (i < nbCPUThread) ? CPU_GRP_SIZE : threads[i].nbKangaroo;
+    uint64_t n = (nbSaved - idx < nbKangaroo) ? nbSaved - idx : nbKangaroo;
+    threads[i].restoreIdx = idx;
+    threads[i].nbRestore = n;
+    idx += n;
+  }
+  nbLoadedWalk -= idx;
+
+  double eFetch = Timer::get_tick();
+
+  if(nbLoadedWalk != 0) {
+    ::printf("FectchKangaroos: Warning %.0f unhandled kangaroos !\n",(double)nbLoadedWalk);
+  }
+
+  uint64_t created = (nbSaved < totalRW) ? totalRW - nbSaved : 0;
+
+  ::printf("FectchKangaroos: [2^%.2f kangaroos loaded] [%.0f created] [%s]\n",log2((double)nbSaved),(double)created,GetTimeStr(eFetch - sFetch).c_str());
+
+  return true;
+
+}
+
+void Kangaroo::RestoreHerd(TH_PARAM *ph,uint64_t nbKangaroo) {
+
+  Point Z;
+  Z.Clear();
+  uint64_t n = 0;
+
+  // No lock needed, ComputePublicKeys() and AddDirect() only read shared tables
+  while(n < ph->nbRestore) {
+
+    uint64_t nb = ph->nbRestore - n;
+    if(nb > RESTORE_BATCH) nb = RESTORE_BATCH;
+
+    vector<Int> dists;
+    vector<Point> Sp;
+    dists.reserve(nb);
+    Sp.reserve(nb);
+
+    for(uint64_t j = 0; j < nb; j++) {
+      uint64_t k = ph->restoreIdx + n + j;
+      Int dist;
+      HashTable::CalcDist(&restoreDist[k],&dist);
+      dists.push_back(dist);
+      if(((restoreType[k >> 3] >> (k & 7)) & 1) == TAME)
+        Sp.push_back(Z);
+      else
+        Sp.push_back(keyToSearch);
+    }
+
+    vector<Point> P = secp->ComputePublicKeys(dists);
+    vector<Point> S = secp->AddDirect(Sp,P);
+
+    for(uint64_t j = 0; j < nb; j++) {
+      ph->px[n + j].Set(&S[j].x);
+      ph->py[n + j].Set(&S[j].y);
+      ph->distance[n + j].Set(&dists[j]);
+    }
+
+    n += nb;
+
+  }
+
+  if(n < nbKangaroo) {
+    // Fill empty kanagaroo
+    CreateHerd((int)(nbKangaroo - n),&(ph->px[n]),&(ph->py[n]),&(ph->distance[n]),(int)(n % 2));
+  }
+
+  // Next keys start with new kangaroos
+  ph->nbRestore = 0;
+
+}
+
 void Kangaroo::FectchKangaroos(TH_PARAM *threads) {
 
   double sFetch = Timer::get_tick();
@@ -302,7 +460,12 @@ void Kangaroo::FectchKangaroos(TH_PARAM *threads) {
 
 
   // Fetch input kangaroo from file (if any)
-  if(nbLoadedWalk>0) {
+  if(nbLoadedWalk>0 && compressedInput) {
+
+    // Positions are rebuilt by the walking threads
+    FetchCompressedKangaroos(threads);
+
+  } else if(nbLoadedWalk>0) {
 
     ::printf("Restoring");
 
@@ -363,11 +526,10 @@ void Kangaroo::FectchKangaroos(TH_PARAM *threads) {
 
 
 // ----------------------------------------------------------------------------
-bool Kangaroo::SaveHeader(string fileName,FILE* f,int type,uint64_t totalCount,double totalTime) {
+bool Kangaroo::SaveHeader(string fileName,FILE* f,int type,uint64_t totalCount,double totalTime,uint32_t version) {
 
   // Header
   uint32_t head = type;
-  uint32_t version = 0;
   if(::fwrite(&head,sizeof(uint32_t),1,f) != 1) {
     ::printf("SaveHeader: Cannot write to %s\n",fileName.c_str());
     ::printf("%s\n",::strerror(errno));
@@ -375,7 +537,7 @@ bool Kangaroo::SaveHeader(string fileName,FILE* f,int type,uint64_t totalCount,d
   }
   ::fwrite(&version,sizeof(uint32_t),1,f);
 
-  if(type==HEADW) {
+  if(type==HEADW || type==HEADJ || type==HEADM) {
 
     // Save global param
     ::fwrite(&dpSize,sizeof(uint32_t),1,f);
@@ -391,202 +553,1417 @@ bool Kangaroo::SaveHeader(string fileName,FILE* f,int type,uint64_t totalCount,d
   return true;
 }
 
-void  Kangaroo::SaveWork(string fileName,FILE *f,int type,uint64_t totalCount,double totalTime) {
+// Header and table, returns false when the table could not be written
+bool Kangaroo::SaveWork(string fileName,FILE *f,int type,uint64_t totalCount,double totalTime,bool resetTable) {
 
   ::printf("\nSaveWork: %s",fileName.c_str());
 
-  // Header
-  if(!SaveHeader(fileName,f,type,totalCount,totalTime))
-    return;
+  // Header, HEADW files are followed by a v2 trailer (see SaveTrailer())
+  if(!SaveHeader(fileName,f,type,totalCount,totalTime,(type == HEADW) ? WORK_VERSION : 0))
+    return false;
+
+  // DPs added from now may miss the base file, the journal keeps them
+  if(useJournal) {
+    LOCK(ghMutex);
+    journal.clear();
+    UNLOCK(ghMutex);
+  }
 
   // Save hash table
-  hashTable.SaveTable(f);
+  if(type == HEADM)
+    return SaveMappedTable(f);
+  else
+    return SaveTable(f,resetTable);
 
 }
 
-void Kangaroo::SaveServerWork() {
+bool Kangaroo::SaveMappedTable(FILE *f) {
+
+  // Index and entries are page aligned so that the file can be mapped
+  // and used in place by HashTable::MapTable() (native ENTRY layout)
+  uint64_t indexPos = MAP_ALIGN(FTell(f));
+  uint64_t dataPos = MAP_ALIGN(indexPos + HASH_SIZE * sizeof(MAP_INDEX));
+  vector<MAP_INDEX> index(HASH_SIZE);
+  vector<ENTRY> buff;
+  uint64_t pos = dataPos;
+  FSeek(f,dataPos);
+
+  uint32_t chunk = HASH_SIZE / 64;
+  for(uint32_t h = 0; h < HASH_SIZE; h += chunk) {
+
+    LOCK(ghMutex);
+    for(uint32_t b = h; b < h + chunk; b++) {
+      uint32_t nbItem = hashTable.E[b].nbItem;
+      index[b].nbItem = nbItem;
+      index[b].maxItem = nbItem;
+      index[b].offset = pos;
+      for(uint32_t i = 0; i < nbItem; i++) {
+        ENTRY *src = hashTable.GetItem(b,i);
+        ENTRY e;
+        memset(&e,0,sizeof(ENTRY));
+        e.x = src->x;
+        e.d = src->d;
+        e.kType = src->kType;
+        buff.push_back(e);
+      }
+      pos += (uint64_t)nbItem * sizeof(ENTRY);
+    }
+    UNLOCK(ghMutex);
 
-  saveRequest = true;
+    if(::fwrite(buff.data(),sizeof(ENTRY),buff.size(),f) != buff.size()) {
+      ::printf("\nSaveTable: Write error: %s\n",::strerror(errno));
+      return false;
+    }
+    buff.clear();
+    if(h % (HASH_SIZE / 16) == 0) ::printf(".");
 
-  double t0 = Timer::get_tick();
+  }
 
-  string fileName = workFile;
-  if(splitWorkfile)
-    fileName = workFile + "_" + Timer::getTS();
+  FSeek(f,indexPos);
+  if(::fwrite(index.data(),sizeof(MAP_INDEX),HASH_SIZE,f) != HASH_SIZE) {
+    ::printf("\nSaveTable: Write error: %s\n",::strerror(errno));
+    return false;
+  }
+  FSeek(f,pos);
+  return true;
 
-  FILE *f = fopen(fileName.c_str(),"wb");
-  if(f == NULL) {
-    ::printf("\nSaveWork: Cannot open %s for writing\n",fileName.c_str());
+}
+
+bool Kangaroo::ReplaceFile(string &tmpName,string &fileName) {
+
+#ifdef WIN64
+  // A mapped file cannot be replaced, the table leaves the mapping first
+  if(hashTable.IsMappedFile(fileName)) {
+    LOCK(ghMutex);
+    hashTable.DetachTable();
+    UNLOCK(ghMutex);
+  }
+  if(!MoveFileExA(tmpName.c_str(),fileName.c_str(),MOVEFILE_REPLACE_EXISTING)) {
+    ::printf("\nSaveWork: Cannot replace %s, work saved in %s (error %d)\n",fileName.c_str(),tmpName.c_str(),(int)GetLastError());
+    return false;
+  }
+#else
+  if(rename(tmpName.c_str(),fileName.c_str()) != 0) {
+    ::printf("\nSaveWork: Cannot replace %s, work saved in %s\n",fileName.c_str(),tmpName.c_str());
     ::printf("%s\n",::strerror(errno));
-    saveRequest = false;
-    return;
+    return false;
   }
+#endif
+  return true;
 
-  SaveWork(fileName,f,HEADW,0,0);
+}
 
-  uint64_t totalWalk = 0;
-  ::fwrite(&totalWalk,sizeof(uint64_t),1,f);
+// ----------------------------------------------------------------------------
+// Parallel table save/load
+// The table is processed by partition of H_PER_PART buckets. On save, each
+// round serializes one partition per thread, computes the partition offsets
+// from their sizes and writes the buffers concurrently with pwrite().
+// Partitions are also the v2 regions, their crc and bucket offsets are
+// computed while serializing.
+// On load, partition offsets come from the v2 index or are found by skipping
+// through bucket headers, then partitions are read and rebuilt concurrently.
 
-  uint64_t size = FTell(f);
-  fclose(f);
+#ifdef WIN64
+DWORD WINAPI _serializeTablePart(LPVOID lpParam) {
+#else
+void* _serializeTablePart(void* lpParam) {
+#endif
+  TH_PARAM* p = (TH_PARAM*)lpParam;
+  p->obj->SerializeTablePart(p);
+  p->isRunning = false;
+  return 0;
+}
 
-  // CRITICAL: SaveServerWork() is ONLY called in server mode
-  // Do NOT reset hashtable - server needs to keep DPs for collision detection
-  // The -wsplit flag should be blocked by main.cpp validation, but as a safeguard:
-  if(splitWorkfile) {
-    ::printf("\nWARNING: -wsplit detected in server mode - NOT resetting hashtable!\n");
-    ::printf("         Server must keep DPs in memory for collision detection.\n");
-    // Do NOT call hashTable.Reset() in server mode
-  }
+#ifdef WIN64
+DWORD WINAPI _writeTablePart(LPVOID lpParam) {
+#else
+void* _writeTablePart(void* lpParam) {
+#endif
+  TH_PARAM* p = (TH_PARAM*)lpParam;
+  p->obj->WriteTablePart(p);
+  p->isRunning = false;
+  return 0;
+}
 
-  double t1 = Timer::get_tick();
+#ifdef WIN64
+DWORD WINAPI _loadTablePart(LPVOID lpParam) {
+#else
+void* _loadTablePart(void* lpParam) {
+#endif
+  TH_PARAM* p = (TH_PARAM*)lpParam;
+  p->obj->LoadTablePart(p);
+  p->isRunning = false;
+  return 0;
+}
 
-  char *ctimeBuff;
-  time_t now = time(NULL);
-  ctimeBuff = ctime(&now);
-  ::printf("done [%.1f MB] [%s] %s",(double)size / (1024.0*1024.0),GetTimeStr(t1 - t0).c_str(),ctimeBuff);
+bool Kangaroo::SerializeTablePart(TH_PARAM* p) {
+
+  // Buckets are copied SERIALIZE_CHUNK at a time, walkers and the other
+  // serializer threads interleave on ghMutex between chunks. The region crc
+  // and index are computed without the lock.
+  LOCK(ghMutex);
+  uint64_t maxSize = hashTable.GetTableSize(p->hStart,p->hStop);
+  UNLOCK(ghMutex);
+  maxSize += maxSize / 16;
+
+  p->bufferSize = 0;
+  p->buffer = (uint8_t*)malloc(maxSize);
+
+  for(uint32_t h = p->hStart; h < p->hStop && p->buffer; h += SERIALIZE_CHUNK) {
+
+    LOCK(ghMutex);
+    uint64_t size = hashTable.GetTableSize(h,h + SERIALIZE_CHUNK);
+    if(p->bufferSize + size > maxSize) {
+      // DPs added since the region size was computed
+      uint64_t newSize = p->bufferSize + size + maxSize / 16;
+      uint8_t *buff = (uint8_t*)realloc(p->buffer,newSize);
+      if(buff == NULL) {
+        UNLOCK(ghMutex);
+        maxSize = newSize;
+        safe_free(p->buffer);
+        break;
+      }
+      p->buffer = buff;
+      maxSize = newSize;
+    }
+    hashTable.SerializeTable(p->buffer + p->bufferSize,h,h + SERIALIZE_CHUNK);
+    if(p->resetTable)
+      hashTable.Reset(h,h + SERIALIZE_CHUNK);
+    UNLOCK(ghMutex);
+    p->bufferSize += size;
 
-  saveRequest = false;
+  }
 
-}
+  if(p->buffer == NULL) {
+    ::printf("\nSaveTable: Cannot allocate %.1f MB\n",(double)maxSize / (1024.0 * 1024.0));
+    p->bufferSize = 0;
+    return false;
+  }
 
-void Kangaroo::SaveWork(uint64_t totalCount,double totalTime,TH_PARAM *threads,int nbThread) {
+  IndexRegion(p);
+  return true;
 
-  uint64_t totalWalk = 0;
-  uint64_t size;
+}
 
-  LOCK(saveMutex);
+void Kangaroo::IndexRegion(TH_PARAM* p) {
+
+  // Region crc, tame count and bucket offsets (relative to the region start)
+  uint32_t region = p->hStart / H_PER_PART;
+  uint64_t nbTame = 0;
+  uint64_t pos = 0;
+  for(uint32_t h = p->hStart; h < p->hStop; h++) {
+    uint32_t nbItem;
+    memcpy(&nbItem,p->buffer + pos,sizeof(uint32_t));
+    workIndex.bucketOffset[h] = pos;
+    pos += 2 * sizeof(uint32_t);
+    for(uint32_t i = 0; i < nbItem; i++) {
+      uint32_t kType;
+      memcpy(&kType,p->buffer + pos + 64,sizeof(uint32_t));
+      if(kType == TAME) nbTame++;
+      pos += ENTRY_FILE_SIZE;
+    }
+  }
+  workIndex.regionCrc[region] = HashTable::Crc32(p->buffer,p->bufferSize);
+  workIndex.regionTame[region] = nbTame;
 
-  double t0 = Timer::get_tick();
+}
 
-  // Wait that all threads blocks before saving works
-  saveRequest = true;
-  int timeout = wtimeout;
-  while(!isWaiting(threads) && timeout>0) {
-    Timer::SleepMillis(50);
-    timeout -= 50;
+bool Kangaroo::GetRegionOffsets(FILE *f,uint32_t version,vector<uint64_t> &offsets,bool *indexed) {
+
+  // Offsets of the MERGE_PART regions and of the table end, f must be at the
+  // start of the table and is left at its end. Region crc are available in
+  // workIndex when the v2 index is used.
+  WORK_FOOTER footer;
+  offsets.resize(MERGE_PART + 1);
+
+  *indexed = (version >= WORK_VERSION) && ReadTrailer(f,&footer,true);
+  if(*indexed) {
+    for(int r = 0; r < MERGE_PART; r++)
+      offsets[r] = workIndex.bucketOffset[r * H_PER_PART];
+    offsets[MERGE_PART] = footer.tableEnd;
+    FSeek(f,footer.tableEnd);
+    return true;
   }
 
-  if(timeout<=0) {
-    // Thread blocked or ended !
-    if(!endOfSearch)
-      ::printf("\nSaveWork timeout !\n");
-    UNLOCK(saveMutex);
-    return;
+  for(uint32_t h = 0; h < HASH_SIZE; h++) {
+    if(h % H_PER_PART == 0)
+      offsets[h / H_PER_PART] = FTell(f);
+    uint32_t nbItem[2];
+    if(::fread(nbItem,sizeof(uint32_t),2,f) != 2) {
+      ::printf("GetRegionOffsets: Unexpected end of file\n");
+      return false;
+    }
+#ifdef WIN64
+    _fseeki64(f,(uint64_t)ENTRY_FILE_SIZE * nbItem[0],SEEK_CUR);
+#else
+    fseeko(f,(uint64_t)ENTRY_FILE_SIZE * nbItem[0],SEEK_CUR);
+#endif
   }
+  offsets[MERGE_PART] = FTell(f);
+  return true;
 
-  string fileName = workFile;
-  if(splitWorkfile)
-    fileName = workFile + "_" + Timer::getTS();
+}
 
-  // Save
-  FILE* f = NULL;
-  if(!saveKangarooByServer) {
-    f = fopen(fileName.c_str(),"wb");
-    if(f == NULL) {
-      ::printf("\nSaveWork: Cannot open %s for writing\n",fileName.c_str());
-      ::printf("%s\n",::strerror(errno));
-      UNLOCK(saveMutex);
-      return;
+bool Kangaroo::WriteTablePart(TH_PARAM* p) {
+
+#ifndef WIN64
+  int fd = fileno(p->f);
+  uint8_t *buff = p->buffer;
+  uint64_t size = p->bufferSize;
+  uint64_t offset = p->fOffset;
+
+  while(size > 0) {
+    ssize_t w = ::pwrite(fd,buff,size,offset);
+    if(w <= 0) {
+      ::printf("\nSaveTable: Write error at %.0f: %s\n",(double)offset,::strerror(errno));
+      p->bufferSize = 0;
+      return false;
     }
+    buff += w;
+    size -= w;
+    offset += w;
   }
+#endif
 
-  if (clientMode) {
+  return true;
 
-    if(saveKangarooByServer) {
+}
 
-      ::printf("\nSaveWork (Kangaroo->Server): %s",fileName.c_str());
-      vector<int256_t> kangs;
-      for(int i = 0; i < nbThread; i++)
-        totalWalk += threads[i].nbKangaroo;
-      kangs.reserve(totalWalk);
+bool Kangaroo::LoadTablePart(TH_PARAM* p) {
 
-      for(int i = 0; i < nbThread; i++) {
-        int256_t X;
-        int256_t D;
-        for(uint64_t n = 0; n < threads[i].nbKangaroo; n++) {
-          HashTable::Convert(&threads[i].px[n],&threads[i].distance[n],&X,&D);
-	  kangs.push_back(D);
-        }
-      }
-      SendKangaroosToServer(fileName,kangs);
-      size = kangs.size()*32 + 32;
-      goto end;
+  p->buffer = (uint8_t*)malloc(p->bufferSize);
+  if(p->buffer == NULL) {
+    ::printf("LoadTable: Cannot allocate %.1f MB\n",(double)p->bufferSize / (1024.0 * 1024.0));
+    p->bufferSize = 0;
+    return false;
+  }
 
-    } else {
-      SaveHeader(fileName,f,HEADK,totalCount,totalTime);
-      ::printf("\nSaveWork (Kangaroo): %s",fileName.c_str());
+#ifdef WIN64
+  // No pread(), regions are read in order by the calling thread
+  FSeek(p->f,p->fOffset);
+  if(::fread(p->buffer,1,p->bufferSize,p->f) != p->bufferSize) {
+    ::printf("LoadTable: Read error at %.0f: %s\n",(double)p->fOffset,
+             feof(p->f) ? "Unexpected end of file" : ::strerror(errno));
+    safe_free(p->buffer);
+    p->bufferSize = 0;
+    return false;
+  }
+#else
+  int fd = fileno(p->f);
+  uint8_t *buff = p->buffer;
+  uint64_t size = p->bufferSize;
+  uint64_t offset = p->fOffset;
+
+  while(size > 0) {
+    ssize_t r = ::pread(fd,buff,size,offset);
+    if(r <= 0) {
+      ::printf("LoadTable: Read error at %.0f: %s\n",(double)offset,(r == 0) ? "Unexpected end of file" : ::strerror(errno));
+      safe_free(p->buffer);
+      p->bufferSize = 0;
+      return false;
     }
+    buff += r;
+    size -= r;
+    offset += r;
+  }
+#endif
 
-  } else {
+  // v2 file, check the region before trusting its bucket sizes
+  uint32_t region = p->hStart / H_PER_PART;
+  if(p->checkCrc && HashTable::Crc32(p->buffer,p->bufferSize) != workIndex.regionCrc[region]) {
+    ::printf("LoadTable: Checksum error in region %d [buckets %d..%d]\n",region,p->hStart,p->hStop - 1);
+    safe_free(p->buffer);
+    p->bufferSize = 0;
+    return false;
+  }
 
-    SaveWork(fileName,f,HEADW,totalCount,totalTime);
+  hashTable.DeserializeTable(p->buffer,p->hStart,p->hStop);
+  safe_free(p->buffer);
 
-  }
+  return true;
 
+}
 
-  if(saveKangaroo) {
+bool Kangaroo::SaveTable(FILE *f,bool resetTable) {
 
-    // Save kangaroos
-    for(int i = 0; i < nbThread; i++)
-      totalWalk += threads[i].nbKangaroo;
-    ::fwrite(&totalWalk,sizeof(uint64_t),1,f);
+  int nbThread = Timer::getCoreNumber();
+  if(nbThread > MERGE_PART) nbThread = MERGE_PART;
+#ifdef WIN64
+  // No pwrite(), partitions are written in order by the calling thread
+  nbThread = 1;
+#endif
+  if(saveSerial)
+    nbThread = 1;
+
+  workIndex.bucketOffset.resize(HASH_SIZE);
+  workIndex.regionCrc.resize(MERGE_PART);
+  workIndex.regionTame.resize(MERGE_PART);
+
+  TH_PARAM* params = (TH_PARAM*)malloc(nbThread * sizeof(TH_PARAM));
+  THREAD_HANDLE* thHandles = (THREAD_HANDLE*)malloc(nbThread * sizeof(THREAD_HANDLE));
+  memset(params,0,nbThread * sizeof(TH_PARAM));
+
+  ::fflush(f);
+  uint64_t offset = FTell(f);
+  bool ok = true;
+
+  // Walkers are only blocked while a partition is serialized.
+  // DP added meanwhile in an already saved partition go to the next save.
+  // With -wsplit, the partition is reset once serialized.
+  // A failed partition ends the save, the file must not replace the last one.
+  for(int p = 0; p < MERGE_PART && ok; p += nbThread) {
+
+    int n = (MERGE_PART - p < nbThread) ? MERGE_PART - p : nbThread;
+
+    for(int i = 0; i < n; i++) {
+      params[i].threadId = i;
+      params[i].isRunning = true;
+      params[i].hStart = (p + i) * H_PER_PART;
+      params[i].hStop = (p + i + 1) * H_PER_PART;
+      params[i].resetTable = resetTable;
+      if(n > 1)
+        thHandles[i] = LaunchThread(_serializeTablePart,params + i);
+      else
+        SerializeTablePart(params + i);
+    }
+    if(n > 1) {
+      JoinThreads(thHandles,n);
+      FreeHandles(thHandles,n);
+    }
 
-    uint64_t point = totalWalk / 16;
-    uint64_t pointPrint = 0;
-
-    for(int i = 0; i < nbThread; i++) {
-      for(uint64_t n = 0; n < threads[i].nbKangaroo; n++) {
-        ::fwrite(&threads[i].px[n].bits64,32,1,f);
-        ::fwrite(&threads[i].py[n].bits64,32,1,f);
-        ::fwrite(&threads[i].distance[n].bits64,32,1,f);
-        pointPrint++;
-        if(pointPrint>point) {
-          ::printf(".");
-          pointPrint = 0;
-        }
+    for(int i = 0; i < n; i++)
+      ok = ok && (params[i].buffer != NULL);
+
+    for(int i = 0; i < n && ok; i++) {
+      params[i].isRunning = true;
+      params[i].f = f;
+      params[i].fOffset = offset;
+      offset += params[i].bufferSize;
+      for(uint32_t h = params[i].hStart; h < params[i].hStop; h++)
+        workIndex.bucketOffset[h] += params[i].fOffset;
+      if(n > 1) {
+        thHandles[i] = LaunchThread(_writeTablePart,params + i);
+      } else if(::fwrite(params[i].buffer,1,params[i].bufferSize,f) != params[i].bufferSize) {
+        ::printf("\nSaveTable: Write error at %.0f: %s\n",(double)params[i].fOffset,::strerror(errno));
+        params[i].bufferSize = 0;
       }
     }
+    if(ok && n > 1) {
+      JoinThreads(thHandles,n);
+      FreeHandles(thHandles,n);
+    }
 
-  } else {
+    for(int i = 0; i < n; i++) {
+      ok = ok && (params[i].bufferSize > 0);
+      safe_free(params[i].buffer);
+    }
 
-    ::fwrite(&totalWalk,sizeof(uint64_t),1,f);
+    for(int d = (p * 16) / MERGE_PART; d < ((p + n) * 16) / MERGE_PART; d++)
+      ::printf(".");
 
   }
 
-  size = FTell(f);
-  fclose(f);
+  FSeek(f,offset);
+  workIndex.tableEnd = offset;
 
-  if(splitWorkfile)
-    hashTable.Reset();
+  free(params);
+  free(thHandles);
 
-  // Unblock threads
-end:
-  saveRequest = false;
-  UNLOCK(saveMutex);
+  return ok;
 
-  double t1 = Timer::get_tick();
+}
 
-  char *ctimeBuff;
-  time_t now = time(NULL);
-  ctimeBuff = ctime(&now);
-  ::printf("done [%.1f MB] [%s] %s",(double)size/(1024.0*1024.0),GetTimeStr(t1 - t0).c_str(),ctimeBuff);
+void Kangaroo::SaveTrailer(FILE *f,uint64_t nbWalk) {
+
+  // Must follow SaveTable()
+  WORK_FOOTER footer;
+  memset(&footer,0,sizeof(WORK_FOOTER));
+  footer.indexPos = FTell(f);
+  footer.tableEnd = workIndex.tableEnd;
+  footer.nbItem = (workIndex.tableEnd - workIndex.bucketOffset[0] - 2 * sizeof(uint32_t) * HASH_SIZE) / ENTRY_FILE_SIZE;
+  for(int r = 0; r < MERGE_PART; r++)
+    footer.nbTame += workIndex.regionTame[r];
+  footer.nbWalk = nbWalk;
+  footer.dpSize = dpSize;
+  footer.magic = WORK_MAGIC;
+
+  ::fwrite(workIndex.bucketOffset.data(),sizeof(uint64_t),HASH_SIZE,f);
+  ::fwrite(workIndex.regionCrc.data(),sizeof(uint32_t),MERGE_PART,f);
+  ::fwrite(&footer,sizeof(WORK_FOOTER),1,f);
 
 }
 
-void Kangaroo::WorkInfo(std::string &fName) {
+bool Kangaroo::ReadTrailer(FILE *f,WORK_FOOTER *footer,bool readIndex) {
 
-  int isDir = IsDir(fName);
-  if(isDir<0)
-    return;
+  // Read the v2 trailer, file position is restored
+  uint64_t pos = FTell(f);
+  uint64_t indexSize = sizeof(uint64_t) * HASH_SIZE + sizeof(uint32_t) * MERGE_PART;
+  bool ok = false;
 
-  string fileName = fName;
-  if(isDir)
-    fileName = fName + "/header";
+#ifdef WIN64
+  _fseeki64(f,0,SEEK_END);
+#else
+  fseeko(f,0,SEEK_END);
+#endif
+  uint64_t fileSize = FTell(f);
+
+  if(fileSize >= sizeof(WORK_FOOTER) + indexSize) {
+    FSeek(f,fileSize - sizeof(WORK_FOOTER));
+    ok = ::fread(footer,sizeof(WORK_FOOTER),1,f) == 1 &&
+         footer->magic == WORK_MAGIC &&
+         footer->indexPos + indexSize + sizeof(WORK_FOOTER) == fileSize &&
+         footer->tableEnd <= footer->indexPos;
+  }
 
-  ::printf("Loading: %s\n",fileName.c_str());
+  if(ok && readIndex) {
+    workIndex.bucketOffset.resize(HASH_SIZE);
+    workIndex.regionCrc.resize(MERGE_PART);
+    FSeek(f,footer->indexPos);
+    ok = ::fread(workIndex.bucketOffset.data(),sizeof(uint64_t),HASH_SIZE,f) == HASH_SIZE &&
+         ::fread(workIndex.regionCrc.data(),sizeof(uint32_t),MERGE_PART,f) == MERGE_PART;
+    workIndex.tableEnd = footer->tableEnd;
+    for(uint32_t h = 1; ok && h < HASH_SIZE; h++)
+      ok = workIndex.bucketOffset[h] >= workIndex.bucketOffset[h - 1] + 2 * sizeof(uint32_t);
+    ok = ok && workIndex.bucketOffset[0] == pos && workIndex.bucketOffset[HASH_SIZE - 1] < footer->tableEnd;
+  }
 
-  uint32_t version;
+  if(!ok)
+    ::printf("ReadTrailer: Invalid or missing v2 index, file is read sequentially\n");
+
+  FSeek(f,pos);
+  return ok;
+
+}
+
+bool Kangaroo::LoadTable(FILE *f,uint32_t version) {
+
+  int nbThread = Timer::getCoreNumber();
+  if(nbThread > MERGE_PART) nbThread = MERGE_PART;
+#ifdef WIN64
+  // No pread(), regions are read in order by the calling thread
+  nbThread = 1;
+#endif
+
+  // v2 regions are checked even with a single thread
+  if(nbThread > 1 || version >= WORK_VERSION) {
+
+    // Partition offsets
+    vector<uint64_t> offsets;
+    bool indexed;
+    hashTable.Reset();
+    if(!GetRegionOffsets(f,version,offsets,&indexed))
+      return false;
+
+    TH_PARAM* params = (TH_PARAM*)malloc(nbThread * sizeof(TH_PARAM));
+    THREAD_HANDLE* thHandles = (THREAD_HANDLE*)malloc(nbThread * sizeof(THREAD_HANDLE));
+    memset(params,0,nbThread * sizeof(TH_PARAM));
+    bool ok = true;
+
+    for(int p = 0; p < MERGE_PART && ok; p += nbThread) {
+
+      int n = (MERGE_PART - p < nbThread) ? MERGE_PART - p : nbThread;
+
+      for(int i = 0; i < n; i++) {
+        params[i].threadId = i;
+        params[i].isRunning = true;
+        params[i].hStart = (p + i) * H_PER_PART;
+        params[i].hStop = (p + i + 1) * H_PER_PART;
+        params[i].f = f;
+        params[i].fOffset = offsets[p + i];
+        params[i].bufferSize = offsets[p + i + 1] - offsets[p + i];
+        params[i].checkCrc = indexed;
+        if(n > 1)
+          thHandles[i] = LaunchThread(_loadTablePart,params + i);
+        else
+          LoadTablePart(params + i);
+      }
+      if(n > 1) {
+        JoinThreads(thHandles,n);
+        FreeHandles(thHandles,n);
+      }
+
+      for(int i = 0; i < n; i++)
+        ok = ok && (params[i].bufferSize > 0);
+
+    }
+
+    free(params);
+    free(thHandles);
+
+    // Do not keep a partially loaded table
+    if(!ok)
+      hashTable.Reset();
+    else
+      FSeek(f,offsets[MERGE_PART]);
+
+    return ok;
+
+  }
+
+  hashTable.LoadTable(f);
+  return true;
+
+}
+
+// ----------------------------------------------------------------------------
+// DP journal
+// The journal (workFile.jnl) holds the DPs found since the last full save as a
+// sequence of checksummed blocks appended after a HEADJ header:
+//   nbItem (uint32), crc32 (uint32), totalCount (uint64), totalTime (double),
+//   nbItem * (x,d,kType)
+// The crc covers totalCount, totalTime and the entries. A partially written
+// block at the end of the file is detected and ignored on load.
+
+bool Kangaroo::UseJournalSave() {
+
+  // Compact into the base file when the journal exceeds half of the base.
+  // Walkers append to the journal under ghMutex.
+  LOCK(ghMutex);
+  uint64_t nbPending = journal.size();
+  UNLOCK(ghMutex);
+  return journalReady && 2 * (journalNbItem + nbPending) < baseNbItem;
+
+}
+
+void Kangaroo::ResetJournal(string &fileName) {
+
+  // A full save has just been written to fileName
+  string jName = fileName + ".jnl";
+  remove(jName.c_str());
+  journalNbItem = 0;
+  baseNbItem = hashTable.GetNbItem();
+  journalReady = useJournal;
+
+}
+
+uint64_t Kangaroo::SaveJournal(string &fileName,uint64_t totalCount,double totalTime) {
+
+  string jName = fileName + ".jnl";
+
+  // Take pending DPs, walkers keep adding to an empty journal
+  vector<ENTRY> entries;
+  LOCK(ghMutex);
+  entries.swap(journal);
+  UNLOCK(ghMutex);
+
+  FILE *f;
+  if(journalNbItem == 0) {
+    f = fopen(jName.c_str(),"wb");
+    if(f && !SaveHeader(jName,f,HEADJ,totalCount,totalTime)) {
+      fclose(f);
+      f = NULL;
+    }
+  } else {
+    f = fopen(jName.c_str(),"ab");
+  }
+
+  if(f == NULL) {
+    ::printf("\nSaveJournal: Cannot open %s for writing\n",jName.c_str());
+    ::printf("%s\n",::strerror(errno));
+    journalReady = false;
+    return 0;
+  }
+
+  uint32_t nbItem = (uint32_t)entries.size();
+  vector<uint8_t> buff(16 + (size_t)nbItem * ENTRY_FILE_SIZE);
+  uint8_t *p = buff.data();
+  memcpy(p,&totalCount,8); p += 8;
+  memcpy(p,&totalTime,8); p += 8;
+  for(uint32_t i = 0; i < nbItem; i++) {
+    memcpy(p,&entries[i].x,32); p += 32;
+    memcpy(p,&entries[i].d,32); p += 32;
+    memcpy(p,&entries[i].kType,4); p += 4;
+  }
+  uint32_t crc = HashTable::Crc32(buff.data(),buff.size());
+
+  bool ok = ::fwrite(&nbItem,sizeof(uint32_t),1,f) == 1;
+  ok = ok && ::fwrite(&crc,sizeof(uint32_t),1,f) == 1;
+  ok = ok && ::fwrite(buff.data(),1,buff.size(),f) == buff.size();
+  ok = ok && ::fflush(f) == 0;
+#ifndef WIN64
+  ok = ok && ::fsync(fileno(f)) == 0;
+#endif
+
+  if(!ok) {
+    ::printf("\nSaveJournal: Cannot write to %s\n",jName.c_str());
+    ::printf("%s\n",::strerror(errno));
+    fclose(f);
+    // Next save will be a full one
+    journalReady = false;
+    return 0;
+  }
+
+  uint64_t size = FTell(f);
+  fclose(f);
+
+  journalNbItem += nbItem;
+
+  return size;
+
+}
+
+bool Kangaroo::LoadJournal(string &fileName) {
+
+  baseNbItem = hashTable.GetNbItem();
+  journalNbItem = 0;
+  journal.clear();
+  journalReady = useJournal && fileName == workFile;
+
+  string jName = fileName + ".jnl";
+  FILE *f = fopen(jName.c_str(),"rb");
+  if(f == NULL)
+    return true;
+  fclose(f);
+
+  ::printf("Loading: %s\n",jName.c_str());
+
+  f = ReadHeader(jName,NULL,HEADJ);
+  if(f == NULL) {
+    journalReady = false;
+    return false;
+  }
+
+  // Check that the journal belongs to the loaded work file
+  uint32_t dp;
+  Int RS;
+  Int RE;
+  Point key;
+  uint64_t count;
+  double time;
+  ::fread(&dp,sizeof(uint32_t),1,f);
+  ::fread(&RS.bits64,32,1,f); RS.bits64[4] = 0;
+  ::fread(&RE.bits64,32,1,f); RE.bits64[4] = 0;
+  ::fread(&key.x.bits64,32,1,f); key.x.bits64[4] = 0;
+  ::fread(&key.y.bits64,32,1,f); key.y.bits64[4] = 0;
+  ::fread(&count,sizeof(uint64_t),1,f);
+  if(::fread(&time,sizeof(double),1,f) != 1 ||
+     !RS.IsEqual(&rangeStart) || !RE.IsEqual(&rangeEnd) ||
+     !key.x.IsEqual(&keysToSearch[0].x) || !key.y.IsEqual(&keysToSearch[0].y)) {
+    ::printf("LoadJournal: %s does not match work file, ignored\n",jName.c_str());
+    fclose(f);
+    journalReady = false;
+    return false;
+  }
+
+  uint64_t pos = FTell(f);
+#ifdef WIN64
+  _fseeki64(f,0,SEEK_END);
+#else
+  fseeko(f,0,SEEK_END);
+#endif
+  uint64_t fileSize = FTell(f);
+  FSeek(f,pos);
+
+  uint32_t nbBlock = 0;
+  bool torn = false;
+  vector<uint8_t> buff;
+
+  while(true) {
+
+    uint32_t nbItem;
+    uint32_t crc;
+    if(::fread(&nbItem,sizeof(uint32_t),1,f) != 1)
+      break;
+
+    uint64_t bSize = 16 + (uint64_t)nbItem * ENTRY_FILE_SIZE;
+    if(::fread(&crc,sizeof(uint32_t),1,f) != 1 || FTell(f) + bSize > fileSize) {
+      torn = true;
+      break;
+    }
+
+    buff.resize(bSize);
+    if(::fread(buff.data(),1,bSize,f) != bSize || HashTable::Crc32(buff.data(),bSize) != crc) {
+      torn = true;
+      break;
+    }
+
+    uint8_t *p = buff.data();
+    memcpy(&offsetCount,p,8); p += 8;
+    memcpy(&offsetTime,p,8); p += 8;
+    for(uint32_t i = 0; i < nbItem; i++) {
+      int256_t x;
+      int256_t d;
+      uint32_t kType;
+      memcpy(&x,p,32); p += 32;
+      memcpy(&d,p,32); p += 32;
+      memcpy(&kType,p,4); p += 4;
+      hashTable.Add(&x,&d,kType);
+    }
+
+    journalNbItem += nbItem;
+    nbBlock++;
+
+  }
+
+  fclose(f);
+
+  if(torn) {
+    // Do not append after a damaged block, next save will be a full one
+    ::printf("LoadJournal: Warning, incomplete block at end of %s ignored\n",jName.c_str());
+    journalReady = false;
+  }
+
+  ::printf("LoadJournal: [%d blocks] [2^%.2f DP]\n",nbBlock,log2((double)journalNbItem));
+
+  return !torn;
+
+}
+
+// ----------------------------------------------------------------------------
+// Multi-key manifest
+// The work file holds the table and counters of the current key only, the
+// manifest (workfile.keys) records the key list, the status and counters of
+// each key and the key to continue with.
+
+bool Kangaroo::SaveKeyManifest(string &fileName,uint32_t nextKey) {
+
+  string kName = fileName + ".keys";
+  string tmpName = kName + ".tmp";
+  FILE *f = fopen(tmpName.c_str(),"wb");
+  if(f == NULL) {
+    ::printf("\nSaveKeyManifest: Cannot open %s for writing\n",tmpName.c_str());
+    ::printf("%s\n",::strerror(errno));
+    return false;
+  }
+
+  uint32_t head = HEADKL;
+  uint32_t version = 0;
+  uint32_t nbKey = (uint32_t)keysToSearch.size();
+  ::fwrite(&head,sizeof(uint32_t),1,f);
+  ::fwrite(&version,sizeof(uint32_t),1,f);
+  ::fwrite(&nbKey,sizeof(uint32_t),1,f);
+  ::fwrite(&nextKey,sizeof(uint32_t),1,f);
+  ::fwrite(&rangeStart.bits64,32,1,f);
+  ::fwrite(&rangeEnd.bits64,32,1,f);
+
+  for(uint32_t i = 0; i < nbKey; i++) {
+    ::fwrite(&keysToSearch[i].x.bits64,32,1,f);
+    ::fwrite(&keysToSearch[i].y.bits64,32,1,f);
+    ::fwrite(&keyProgress[i].status,sizeof(uint32_t),1,f);
+    ::fwrite(&keyProgress[i].count,sizeof(uint64_t),1,f);
+    ::fwrite(&keyProgress[i].time,sizeof(double),1,f);
+  }
+
+  bool ok = !::ferror(f);
+  fclose(f);
+  if(!ok) {
+    ::printf("\nSaveKeyManifest: Cannot write %s\n",tmpName.c_str());
+    return false;
+  }
+
+  return ReplaceFile(tmpName,kName);
+
+}
+
+bool Kangaroo::LoadKeyManifest(string &fileName) {
+
+  string kName = fileName + ".keys";
+  FILE *f = fopen(kName.c_str(),"rb");
+  if(f == NULL)
+    return false;
+
+  uint32_t head = 0;
+  uint32_t version = 0;
+  uint32_t nbKey = 0;
+  uint32_t nextKey = 0;
+  Int rStart;
+  Int rEnd;
+  rStart.SetInt32(0);
+  rEnd.SetInt32(0);
+
+  ::fread(&head,sizeof(uint32_t),1,f);
+  ::fread(&version,sizeof(uint32_t),1,f);
+  ::fread(&nbKey,sizeof(uint32_t),1,f);
+  ::fread(&nextKey,sizeof(uint32_t),1,f);
+  ::fread(&rStart.bits64,32,1,f);
+  ::fread(&rEnd.bits64,32,1,f);
+
+  if(head != HEADKL || version > 0) {
+    ::printf("LoadKeyManifest: %s is not a key manifest\n",kName.c_str());
+    fclose(f);
+    return false;
+  }
+
+  if(!rStart.IsEqual(&rangeStart) || !rEnd.IsEqual(&rangeEnd)) {
+    ::printf("LoadKeyManifest: %s range differs from work file, ignored\n",kName.c_str());
+    fclose(f);
+    return false;
+  }
+
+  vector<Point> keys;
+  vector<KEY_PROGRESS> progress;
+  keys.reserve(nbKey);
+  progress.reserve(nbKey);
+
+  for(uint32_t i = 0; i < nbKey; i++) {
+    Point key;
+    KEY_PROGRESS kp;
+    key.Clear();
+    ::fread(&key.x.bits64,32,1,f); key.x.bits64[4] = 0;
+    ::fread(&key.y.bits64,32,1,f); key.y.bits64[4] = 0;
+    ::fread(&kp.status,sizeof(uint32_t),1,f);
+    ::fread(&kp.count,sizeof(uint64_t),1,f);
+    ::fread(&kp.time,sizeof(double),1,f);
+    key.z.SetInt32(1);
+    keys.push_back(key);
+    progress.push_back(kp);
+  }
+
+  if(::feof(f) || nextKey > nbKey) {
+    ::printf("LoadKeyManifest: %s is truncated, ignored\n",kName.c_str());
+    fclose(f);
+    return false;
+  }
+  fclose(f);
+
+  // The work file key must be the current key or an already finished one
+  Point &cur = keysToSearch[0];
+  int32_t fileKey = -1;
+  for(uint32_t i = 0; i < nbKey && fileKey < 0; i++)
+    if(keys[i].x.IsEqual(&cur.x) && keys[i].y.IsEqual(&cur.y))
+      fileKey = (int32_t)i;
+
+  if(fileKey < 0 || (uint32_t)fileKey > nextKey) {
+    ::printf("LoadKeyManifest: work file key not found in %s, ignored\n",kName.c_str());
+    return false;
+  }
+
+  if((uint32_t)fileKey < nextKey) {
+    // Stopped between two keys, the work file belongs to a finished key
+    hashTable.Reset();
+    journal.clear();
+    offsetCount = 0;
+    offsetTime = 0;
+    nbLoadedWalk = 0;
+  }
+
+  keysToSearch = keys;
+  keyProgress = progress;
+  startKeyIdx = nextKey;
+
+  int nbSolved = 0;
+  for(uint32_t i = 0; i < nbKey; i++)
+    if(keyProgress[i].status == KEY_SOLVED)
+      nbSolved++;
+
+  ::printf("LoadKeyManifest: [Keys %d] [Solved %d] [Resume at key #%d]\n",(int)nbKey,nbSolved,(int)startKeyIdx);
+
+  return true;
+
+}
+
+// ----------------------------------------------------------------------------
+
+uint64_t Kangaroo::SaveKangarooFile(string &fileName,TH_PARAM *threads,int nbThread) {
+
+  string kName = fileName + ".kang";
+  FILE *f = fopen(kName.c_str(),"wb");
+  if(f == NULL) {
+    ::printf("\nSaveWork: Cannot open %s for writing\n",kName.c_str());
+    ::printf("%s\n",::strerror(errno));
+    return 0;
+  }
+
+  if(compressKangaroo) {
+    SaveHeader(kName,f,HEADKC,0,0);
+    SaveCompressedKangaroos(f,threads,nbThread);
+  } else {
+    SaveHeader(kName,f,HEADK,0,0);
+    SaveKangaroos(f,threads,nbThread);
+  }
+
+  uint64_t size = FTell(f);
+  fclose(f);
+  return size;
+
+}
+
+uint64_t Kangaroo::SaveKangaroos(FILE *f,TH_PARAM *threads,int nbThread) {
+
+  uint64_t totalWalk = 0;
+  for(int i = 0; i < nbThread; i++)
+    totalWalk += threads[i].nbKangaroo;
+  ::fwrite(&totalWalk,sizeof(uint64_t),1,f);
+
+  uint64_t point = totalWalk / 16;
+  uint64_t pointPrint = 0;
+
+  for(int i = 0; i < nbThread; i++) {
+    for(uint64_t n = 0; n < threads[i].nbKangaroo; n++) {
+      ::fwrite(&threads[i].snapPx[n].bits64,32,1,f);
+      ::fwrite(&threads[i].snapPy[n].bits64,32,1,f);
+      ::fwrite(&threads[i].snapDistance[n].bits64,32,1,f);
+      pointPrint++;
+      if(pointPrint>point) {
+        ::printf(".");
+        pointPrint = 0;
+      }
+    }
+  }
+
+  return totalWalk;
+
+}
+
+uint64_t Kangaroo::SaveCompressedKangaroos(FILE *f,TH_PARAM *threads,int nbThread) {
+
+  uint64_t totalWalk = 0;
+  for(int i = 0; i < nbThread; i++)
+    totalWalk += threads[i].nbKangaroo;
+  ::fwrite(&totalWalk,sizeof(uint64_t),1,f);
+
+  // Distances, one write per thread, positions are rebuilt on restore
+  vector<int256_t> dists;
+  vector<uint8_t> types((totalWalk + 7) / 8,0);
+  uint64_t k = 0;
+
+  for(int i = 0; i < nbThread; i++) {
+    dists.resize(threads[i].nbKangaroo);
+    for(uint64_t n = 0; n < threads[i].nbKangaroo; n++) {
+      HashTable::toint256t(&threads[i].snapDistance[n],&dists[n]);
+      if(n % 2 == WILD)
+        types[k >> 3] |= (uint8_t)(1 << (k & 7));
+      k++;
+    }
+    ::fwrite(dists.data(),32,dists.size(),f);
+    ::printf(".");
+  }
+
+  // Kangaroo type bitmap
+  ::fwrite(types.data(),1,types.size(),f);
+
+  return totalWalk;
+
+}
+
+// ----------------------------------------------------------------------------
+
+#ifndef WIN64
+
+// Close the files inherited by the save process but stdio and keepFd: the
+// listening, client and metrics sockets must be released when the server
+// closes them, and the port must be free for a restarted server
+static void closeInheritedFiles(int keepFd) {
+
+  vector<int> fds;
+  DIR *dir = opendir("/proc/self/fd");
+  if(dir != NULL) {
+    struct dirent *ent;
+    while((ent = readdir(dir)) != NULL) {
+      int fd = atoi(ent->d_name);
+      if(fd > 2 && fd != keepFd && fd != dirfd(dir))
+        fds.push_back(fd);
+    }
+    closedir(dir);
+  } else {
+    // No procfs
+    int maxFd = (int)sysconf(_SC_OPEN_MAX);
+    for(int fd = 3; fd < maxFd; fd++)
+      if(fd != keepFd)
+        fds.push_back(fd);
+  }
+
+  for(int i = 0; i < (int)fds.size(); i++)
+    close(fds[i]);
+
+}
+
+#endif
+
+// Server checkpoints never stop the clients (no SERVER_BACKUP status). On
+// Linux the work file is written by a forked process from a copy-on-write
+// snapshot of the table while the server keeps receiving and adding DPs,
+// ProcessServer is only blocked during fork(). On Windows the save is done
+// in place, clients keep sending and DPs wait in recvDP meanwhile.
+void Kangaroo::SaveServerWork() {
+
+#ifndef WIN64
+  if(savePid > 0) {
+    ::printf("\nSaveWork: previous save still running, skipped\n");
+    return;
+  }
+#endif
+
+  double t0 = Timer::get_tick();
+
+  string fileName = workFile;
+  if(splitWorkfile)
+    fileName = workFile + "_" + Timer::getTS();
+
+  // CRITICAL: SaveServerWork() is ONLY called in server mode
+  // Do NOT reset hashtable - server needs to keep DPs for collision detection
+  // The -wsplit flag should be blocked by main.cpp validation, but as a safeguard:
+  if(splitWorkfile) {
+    ::printf("\nWARNING: -wsplit detected in server mode - NOT resetting hashtable!\n");
+    ::printf("         Server must keep DPs in memory for collision detection.\n");
+    // Do NOT call hashTable.Reset() in server mode
+  }
+
+  bool journalSave = UseJournalSave();
+
+#ifndef WIN64
+
+  int fd[2];
+  if(pipe(fd) == 0) {
+
+    // Fork with ghMutex and stdout held, the child gets them unlocked
+    // and without pending output
+    ::fflush(stdout);
+    LOCK(ghMutex);
+    flockfile(stdout);
+    pid_t pid = fork();
+    funlockfile(stdout);
+    UNLOCK(ghMutex);
+
+    if(pid == 0) {
+      // Child: write the snapshot and report size and time to the server.
+      // Only the forking thread exists here, the save must not start
+      // threads nor use LOG (its flush thread and lock stay in the server):
+      // the table is serialized and written in order by this thread.
+      signal(SIGINT,SIG_IGN);
+      closeInheritedFiles(fd[1]);
+      saveSerial = true;
+      double t1 = Timer::get_tick();
+      SAVE_REPORT r;
+      r.size = WriteServerWork(fileName,journalSave);
+      r.time = Timer::get_tick() - t1;
+      write(fd[1],&r,sizeof(r));
+      ::fflush(stdout);
+      _exit(r.size > 0 ? 0 : 1);
+    }
+
+    close(fd[1]);
+    if(pid > 0) {
+      savePid = (int)pid;
+      savePipe = fd[0];
+      serverStat.stallTime = Timer::get_tick() - t0;
+      // The snapshot holds the pending journal entries (journal save) or
+      // the whole table (full save). The bookkeeping is advanced now, the
+      // journal keeps the DPs added from the snapshot on; if the save
+      // process fails, PollServerWork() drops the journal chain and the
+      // next save is a full one.
+      if(journalSave) {
+        journalNbItem += journal.size();
+      } else {
+        journalNbItem = 0;
+        baseNbItem = hashTable.GetNbItem();
+        journalReady = useJournal;
+      }
+      journal.clear();
+      return;
+    }
+
+    close(fd[0]);
+    ::printf("\nSaveWork: fork() failed, saving in place: %s\n",::strerror(errno));
+
+  }
+
+#endif
+
+  uint64_t size = WriteServerWork(fileName,journalSave);
+  double t1 = Timer::get_tick();
+  serverStat.stallTime = t1 - t0;
+  EndServerWork(size,t1 - t0);
+
+}
+
+// Write the journal or the whole table to fileName, the previous full save
+// is replaced only once the new one is complete. Returns the file size, 0 on
+// failure.
+uint64_t Kangaroo::WriteServerWork(string &fileName,bool journalSave) {
+
+  double t0 = Timer::get_tick();
+  uint64_t size;
+
+  if(journalSave) {
+
+    ::printf("\nSaveWork (Journal): %s.jnl",fileName.c_str());
+    size = SaveJournal(fileName,0,0);
+
+  } else {
+
+    string saveName = fileName + ".tmp";
+    FILE *f = fopen(saveName.c_str(),"wb");
+    if(f == NULL) {
+      ::printf("\nSaveWork: Cannot open %s for writing\n",saveName.c_str());
+      ::printf("%s\n",::strerror(errno));
+      return 0;
+    }
+
+    bool ok = SaveWork(fileName,f,mapWorkfile ? HEADM : HEADW,0,0);
+
+    uint64_t totalWalk = 0;
+    ::fwrite(&totalWalk,sizeof(uint64_t),1,f);
+    if(!mapWorkfile)
+      SaveTrailer(f,totalWalk);
+
+    size = FTell(f);
+    ok = ok && !ferror(f);
+    ok = (fclose(f) == 0) && ok;
+
+    // Keep the last good save
+    if(!ok) {
+      ::printf("\nSaveWork: %s failed, %s is kept\n",saveName.c_str(),fileName.c_str());
+      remove(saveName.c_str());
+      return 0;
+    }
+
+    if(!ReplaceFile(saveName,fileName))
+      return 0;
+
+    if(useJournal)
+      ResetJournal(fileName);
+
+  }
+
+  if(size > 0) {
+    double t1 = Timer::get_tick();
+    char *ctimeBuff;
+    time_t now = time(NULL);
+    ctimeBuff = ctime(&now);
+    ::printf("done [%.1f MB] [%s] %s",(double)size / (1024.0*1024.0),GetTimeStr(t1 - t0).c_str(),ctimeBuff);
+  }
+
+  return size;
+
+}
+
+// Save statistics, a failed save is followed by a full one
+void Kangaroo::EndServerWork(uint64_t size,double time) {
+
+  if(size == 0) {
+    journalReady = false;
+    return;
+  }
+
+  serverStat.nbSave++;
+  serverStat.saveTime = time;
+  serverStat.totalSaveTime += time;
+  if(time > serverStat.maxSaveTime)
+    serverStat.maxSaveTime = time;
+
+}
+
+// Reap the save process, called by ProcessServer
+void Kangaroo::PollServerWork(bool wait) {
+
+#ifndef WIN64
+
+  if(savePid <= 0)
+    return;
+
+  int status;
+  pid_t r = waitpid((pid_t)savePid,&status,wait ? 0 : WNOHANG);
+  if(r == 0)
+    return;
+
+  SAVE_REPORT rep;
+  memset(&rep,0,sizeof(rep));
+  if(r < 0 || !WIFEXITED(status) || WEXITSTATUS(status) != 0 ||
+     read(savePipe,&rep,sizeof(rep)) != (int)sizeof(rep)) {
+    ::printf("\nSaveWork: save process %d failed\n",savePid);
+    rep.size = 0;
+  }
+  close(savePipe);
+  savePid = 0;
+
+  // journalNbItem/baseNbItem were advanced and the journal entries of the
+  // snapshot cleared at fork(), they are not in any file: the journal
+  // chain is no longer valid, next save is a full one (the table holds
+  // every DP)
+  if(rep.size == 0)
+    journalReady = false;
+
+  EndServerWork(rep.size,rep.time);
+
+#endif
+
+}
+
+void Kangaroo::SaveWork(uint64_t totalCount,double totalTime,TH_PARAM *threads,int nbThread) {
+
+  uint64_t totalWalk = 0;
+  uint64_t size;
+  bool ok = true;
+
+  LOCK(saveMutex);
+
+  double t0 = Timer::get_tick();
+
+  // Wait that all threads hand off their kangaroos, they do not stop walking
+  saveRequest = true;
+  int timeout = wtimeout;
+  while(!isWaiting(threads) && timeout>0) {
+    Timer::SleepMillis(50);
+    timeout -= 50;
+  }
+
+  if(timeout<=0) {
+    // Thread blocked or ended !
+    if(!endOfSearch)
+      ::printf("\nSaveWork timeout !\n");
+    saveRequest = false;
+    UNLOCK(saveMutex);
+    return;
+  }
+
+  string fileName = workFile;
+  if(splitWorkfile)
+    fileName = workFile + "_" + Timer::getTS();
+
+  bool incremental = !clientMode && UseJournalSave();
+
+  // With journal or compressed kangaroos, work file kangaroos are stored aside
+  bool kangFile = !clientMode && (useJournal || compressKangaroo);
+
+  // Work files are written aside and replace the last save once complete
+  // (a mapped work file may also be in use)
+  string saveName = clientMode ? fileName : fileName + ".tmp";
+
+  // Save
+  FILE* f = NULL;
+  if(!saveKangarooByServer && !incremental) {
+    f = fopen(saveName.c_str(),"wb");
+    if(f == NULL) {
+      ::printf("\nSaveWork: Cannot open %s for writing\n",saveName.c_str());
+      ::printf("%s\n",::strerror(errno));
+      saveRequest = false;
+      UNLOCK(saveMutex);
+      return;
+    }
+  }
+
+  if (clientMode) {
+
+    if(saveKangarooByServer) {
+
+      ::printf("\nSaveWork (Kangaroo->Server): %s",fileName.c_str());
+      vector<int256_t> kangs;
+      for(int i = 0; i < nbThread; i++)
+        totalWalk += threads[i].nbKangaroo;
+      kangs.reserve(totalWalk);
+
+      for(int i = 0; i < nbThread; i++) {
+        int256_t X;
+        int256_t D;
+        for(uint64_t n = 0; n < threads[i].nbKangaroo; n++) {
+          HashTable::Convert(&threads[i].snapPx[n],&threads[i].snapDistance[n],&X,&D);
+	  kangs.push_back(D);
+        }
+      }
+      SendKangaroosToServer(fileName,kangs);
+      size = kangs.size()*32 + 32;
+      goto end;
+
+    } else {
+      SaveHeader(fileName,f,compressKangaroo ? HEADKC : HEADK,totalCount,totalTime);
+      ::printf("\nSaveWork (Kangaroo): %s",fileName.c_str());
+    }
+
+  } else if(incremental) {
+
+    // Only DPs found since last save are appended to the journal
+    ::printf("\nSaveWork (Journal): %s.jnl",fileName.c_str());
+    size = SaveJournal(fileName,totalCount,totalTime);
+    if(saveKangaroo)
+      size += SaveKangarooFile(fileName,threads,nbThread);
+    goto end;
+
+  } else {
+
+    ok = SaveWork(fileName,f,mapWorkfile ? HEADM : HEADW,totalCount,totalTime,splitWorkfile);
+
+  }
+
+
+  if(saveKangaroo && !kangFile) {
+
+    // Save kangaroos
+    if(compressKangaroo)
+      totalWalk = SaveCompressedKangaroos(f,threads,nbThread);
+    else
+      totalWalk = SaveKangaroos(f,threads,nbThread);
+
+  } else {
+
+    ::fwrite(&totalWalk,sizeof(uint64_t),1,f);
+
+  }
+
+  if(!clientMode && !mapWorkfile)
+    SaveTrailer(f,totalWalk);
+
+  size = FTell(f);
+  ok = ok && !ferror(f);
+  ok = (fclose(f) == 0) && ok;
+
+  if(!ok) {
+    ::printf("\nSaveWork: %s failed, %s is kept\n",saveName.c_str(),fileName.c_str());
+    if(saveName != fileName)
+      remove(saveName.c_str());
+    goto end;
+  }
+
+  if(saveName != fileName && !ReplaceFile(saveName,fileName)) {
+    ok = false;
+    goto end;
+  }
+
+  if(useJournal)
+    // Base file is up to date, restart journal
+    ResetJournal(fileName);
+
+  if(kangFile) {
+    string kName = fileName + ".kang";
+    remove(kName.c_str());
+    if(saveKangaroo)
+      size += SaveKangarooFile(fileName,threads,nbThread);
+  }
+
+  // Release threads snapshot
+end:
+  saveRequest = false;
+  timeout = wtimeout;
+  while(!isWaiting(threads,false) && timeout>0) {
+    Timer::SleepMillis(10);
+    timeout -= 10;
+  }
+  UNLOCK(saveMutex);
+
+  // DPs cleared from the journal are only in the table, next save is a full one
+  if(!ok) {
+    journalReady = false;
+    return;
+  }
+
+  if(!clientMode && keysToSearch.size() > 1) {
+    keyProgress[keyIdx].count = totalCount;
+    keyProgress[keyIdx].time = totalTime;
+    SaveKeyManifest(workFile,keyIdx);
+  }
+
+  double t1 = Timer::get_tick();
+
+  char *ctimeBuff;
+  time_t now = time(NULL);
+  ctimeBuff = ctime(&now);
+  ::printf("done [%.1f MB] [%s] %s",(double)size/(1024.0*1024.0),GetTimeStr(t1 - t0).c_str(),ctimeBuff);
+
+}
+
+void Kangaroo::WorkInfo(std::string &fName) {
+
+  int isDir = IsDir(fName);
+  if(isDir<0)
+    return;
+
+  string fileName = fName;
+  if(isDir)
+    fileName = fName + "/header";
+
+  ::printf("Loading: %s\n",fileName.c_str());
+
+  uint32_t version;
   FILE *f1 = ReadHeader(fileName,&version,HEADW);
   if(f1 == NULL)
     return;
@@ -620,12 +1997,23 @@ void Kangaroo::WorkInfo(std::string &fName) {
   }
 
   // Read hashTable
+  WORK_FOOTER footer;
+  bool indexed = false;
   if(isDir) {
     for(int i = 0; i < MERGE_PART; i++) {
       FILE* f = OpenPart(fName,"rb",i);
       hashTable.SeekNbItem(f,i * H_PER_PART,(i + 1) * H_PER_PART);
       fclose(f);
     }
+  } else if(version >= WORK_VERSION && ReadTrailer(f1,&footer,true)) {
+    // Bucket sizes from the index, the table is not read
+    indexed = true;
+    for(uint32_t h = 0; h < HASH_SIZE; h++) {
+      uint64_t next = (h < HASH_SIZE - 1) ? workIndex.bucketOffset[h + 1] : footer.tableEnd;
+      uint32_t nbItem = (uint32_t)((next - workIndex.bucketOffset[h] - 2 * sizeof(uint32_t)) / ENTRY_FILE_SIZE);
+      hashTable.SetNbItem(h,nbItem,nbItem);
+    }
+    FSeek(f1,footer.tableEnd);
   } else {
     hashTable.SeekNbItem(f1);
   }
@@ -642,6 +2030,15 @@ void Kangaroo::WorkInfo(std::string &fName) {
 #endif
   ::printf("Time      : %s\n",GetTimeStr(time1).c_str());
   hashTable.PrintInfo();
+  if(indexed) {
+#ifdef WIN64
+    ::printf("Tame DP   : %I64d\n",footer.nbTame);
+    ::printf("Wild DP   : %I64d\n",footer.nbItem - footer.nbTame);
+#else
+    ::printf("Tame DP   : %" PRId64 "\n",footer.nbTame);
+    ::printf("Wild DP   : %" PRId64 "\n",footer.nbItem - footer.nbTame);
+#endif
+  }
 
   fread(&nbLoadedWalk,sizeof(uint64_t),1,f1);
 #ifdef WIN64
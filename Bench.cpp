@@ -0,0 +1,1500 @@
+/*
+* This file is part of the BSGS distribution (https://github.com/JeanLucPons/Kangaroo).
+* Copyright (c) 2020 Jean Luc PONS.
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, version 3.
+*
+* This program is distributed in the hope that it will be useful, but
+* WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+* General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "Kangaroo.h"
+#include "SECPK1/IntGroup.h"
+#include "SECPK1/Random.h"
+#include "Timer.h"
+#include <string.h>
+#include <errno.h>
+#define _USE_MATH_DEFINES
+#include <math.h>
+#include <algorithm>
+#include <ctype.h>
+#ifndef WIN64
+#include <sys/wait.h>
+#endif
+
+using namespace std;
+
+// Microbenchmarks of the field and curve arithmetic used by the walk.
+// Operands come from a fixed seed and each benchmark reports the best of
+// BENCH_REPEAT runs, so that results can be compared across builds and hosts.
+
+#define BENCH_SEED     0x4B414E47
+#define BENCH_REPEAT   5
+#define BENCH_MIN_TIME 0.05   // Minimum duration of a run (calibration)
+#define BENCH_BATCH    1024   // Size of the ComputePublicKeys/AddDirect batches
+
+enum {
+  BENCH_MODMUL,
+  BENCH_MODSQR,
+  BENCH_MODINV,
+  BENCH_GRPINV,
+  BENCH_JUMP,
+  BENCH_ORDADD,
+  BENCH_ISDP,
+  BENCH_PUBKEY,
+  BENCH_PUBKEYS,
+  BENCH_ADDDIRECT,
+  BENCH_ADDDIRECTS
+};
+
+typedef struct {
+
+  Int a;
+  Int b;
+  Int *ints;            // IntGroup::ModInv input
+  IntGroup *grp;
+  Int *px;              // Herd of the jump step
+  Int *py;
+  Int *d;
+  Int *dx;
+  Int jx[NB_JUMP];      // Jump table of the jump step
+  Int jy[NB_JUMP];
+  Int jd[NB_JUMP];
+  vector<Int> keys;
+  vector<Point> p1;
+  vector<Point> p2;
+  Point P;
+  Point Q;
+  uint64_t sink;        // Keeps results alive
+
+} BENCH_CTX;
+
+typedef struct {
+
+  string   name;
+  int      size;
+  uint64_t nbOp;
+  double   nsPerOp;
+  double   cyclesPerOp;
+
+} BENCH_RESULT;
+
+// ----------------------------------------------------------------------------
+
+// Run n iterations of op, an iteration performs size operations
+void Kangaroo::BenchOp(int op,int size,void *ctx,uint64_t n) {
+
+  BENCH_CTX *c = (BENCH_CTX *)ctx;
+
+  switch(op) {
+
+  case BENCH_MODMUL:
+    for(uint64_t i = 0; i < n; i++)
+      c->a.ModMulK1(&c->b);
+    c->sink += c->a.bits64[0];
+    break;
+
+  case BENCH_MODSQR:
+    for(uint64_t i = 0; i < n; i++)
+      c->a.ModSquareK1(&c->a);
+    c->sink += c->a.bits64[0];
+    break;
+
+  case BENCH_MODINV:
+    for(uint64_t i = 0; i < n; i++)
+      c->a.ModInv();
+    c->sink += c->a.bits64[0];
+    break;
+
+  case BENCH_GRPINV:
+    for(uint64_t i = 0; i < n; i++) {
+      c->grp->Set(c->ints);
+      c->grp->ModInv();
+    }
+    c->sink += c->ints[0].bits64[0];
+    break;
+
+  case BENCH_JUMP: {
+
+    // Same affine step as SolveKeyCPU()
+    Int dy;
+    Int rx;
+    Int ry;
+    Int _s;
+    Int _p;
+
+    for(uint64_t i = 0; i < n; i++) {
+
+      for(int g = 0; g < size; g++) {
+        uint64_t jmp = c->px[g].bits64[0] % NB_JUMP;
+        c->dx[g].ModSub(&c->px[g],&c->jx[jmp]);
+      }
+
+      c->grp->Set(c->dx);
+      c->grp->ModInv();
+
+      for(int g = 0; g < size; g++) {
+
+        uint64_t jmp = c->px[g].bits64[0] % NB_JUMP;
+
+        dy.ModSub(&c->py[g],&c->jy[jmp]);
+        _s.ModMulK1(&dy,&c->dx[g]);
+        _p.ModSquareK1(&_s);
+
+        rx.ModSub(&_p,&c->jx[jmp]);
+        rx.ModSub(&c->px[g]);
+
+        ry.ModSub(&c->px[g],&rx);
+        ry.ModMulK1(&_s);
+        ry.ModSub(&c->py[g]);
+
+        c->d[g].ModAddK1order(&c->jd[jmp]);
+
+        c->px[g].Set(&rx);
+        c->py[g].Set(&ry);
+
+      }
+
+    }
+    c->sink += c->px[0].bits64[0];
+
+  } break;
+
+  case BENCH_ORDADD:
+    for(uint64_t i = 0; i < n; i++)
+      c->a.ModAddK1order(&c->b);
+    c->sink += c->a.bits64[0];
+    break;
+
+  case BENCH_ISDP:
+    for(uint64_t i = 0; i < n; i++) {
+      // Vary the input without adding a multiplication to the loop
+      c->a.bits64[0] += 0x9E3779B97F4A7C15ULL;
+      c->a.bits64[3] ^= c->a.bits64[0];
+      c->sink += IsDP(&c->a);
+    }
+    break;
+
+  case BENCH_PUBKEY:
+    for(uint64_t i = 0; i < n; i++) {
+      c->P = secp->ComputePublicKey(&c->a);
+      c->a.bits64[0] += c->P.x.bits64[0] | 1;
+    }
+    c->sink += c->P.x.bits64[0];
+    break;
+
+  case BENCH_PUBKEYS:
+    for(uint64_t i = 0; i < n; i++) {
+      c->p1 = secp->ComputePublicKeys(c->keys);
+      c->keys[0].bits64[0]++;
+    }
+    c->sink += c->p1[0].x.bits64[0];
+    break;
+
+  case BENCH_ADDDIRECT:
+    for(uint64_t i = 0; i < n; i++)
+      c->P = secp->AddDirect(c->P,c->Q);
+    c->sink += c->P.x.bits64[0];
+    break;
+
+  case BENCH_ADDDIRECTS:
+    for(uint64_t i = 0; i < n; i++)
+      c->p1 = secp->AddDirect(c->p1,c->p2);
+    c->sink += c->p1[0].x.bits64[0];
+    break;
+
+  }
+
+}
+
+// ----------------------------------------------------------------------------
+
+static void BenchPrint(BENCH_RESULT &r) {
+
+  if(r.cyclesPerOp > 0.0)
+    ::printf("%-18s %6d %12.1f %12.1f %12.3f\n",r.name.c_str(),r.size,r.nsPerOp,r.cyclesPerOp,1e3 / r.nsPerOp);
+  else
+    ::printf("%-18s %6d %12.1f %12s %12.3f\n",r.name.c_str(),r.size,r.nsPerOp,"n/a",1e3 / r.nsPerOp);
+
+}
+
+void Kangaroo::Bench(string jsonFile) {
+
+  vector<BENCH_RESULT> results;
+  BENCH_CTX *c = new BENCH_CTX();
+
+  // Fixed operands
+  rseed(BENCH_SEED);
+  c->sink = 0;
+  c->a.Rand(256);
+  c->b.Rand(256);
+  c->P = secp->ComputePublicKey(&c->a);
+  c->Q = secp->ComputePublicKey(&c->b);
+  for(int i = 0; i < NB_JUMP; i++) {
+    c->jd[i].Rand(128);
+    Point J = secp->ComputePublicKey(&c->jd[i]);
+    c->jx[i].Set(&J.x);
+    c->jy[i].Set(&J.y);
+  }
+  for(int i = 0; i < BENCH_BATCH; i++) {
+    Int k;
+    k.Rand(256);
+    c->keys.push_back(k);
+  }
+  c->p1 = secp->ComputePublicKeys(c->keys);
+  c->p2 = c->p1;
+  for(int i = 0; i < BENCH_BATCH; i++)
+    c->p2[i] = secp->AddDirect(c->p2[i],secp->G);
+  SetDP(16);
+
+  bool hasTSC = Timer::getTSC() != 0;
+
+  ::printf("Bench: single thread, best of %d runs, seed %08X\n",BENCH_REPEAT,BENCH_SEED);
+  ::printf("%-18s %6s %12s %12s %12s\n","Operation","Size","ns/op","cycles/op","Mop/s");
+
+  const char *names[] = { "ModMulK1","ModSquareK1","ModInv","IntGroup::ModInv","JumpStep",
+                          "ModAddK1order","IsDP","ComputePublicKey","ComputePublicKeys",
+                          "AddDirect","AddDirect[]" };
+  int grpSizes[] = { 64,256,1024,4096 };
+
+  for(int op = BENCH_MODMUL; op <= BENCH_ADDDIRECTS; op++) {
+
+    int nbSize = (op == BENCH_GRPINV) ? 4 : 1;
+
+    for(int s = 0; s < nbSize; s++) {
+
+      int size = 1;
+      switch(op) {
+      case BENCH_GRPINV: size = grpSizes[s]; break;
+      case BENCH_JUMP: size = CPU_GRP_SIZE; break;
+      case BENCH_PUBKEYS:
+      case BENCH_ADDDIRECTS: size = BENCH_BATCH; break;
+      }
+
+      if(op == BENCH_GRPINV || op == BENCH_JUMP) {
+        c->ints = new Int[size];
+        c->grp = new IntGroup(size);
+        for(int i = 0; i < size; i++) c->ints[i].Rand(256);
+      }
+      if(op == BENCH_JUMP) {
+        c->px = new Int[size];
+        c->py = new Int[size];
+        c->d = new Int[size];
+        c->dx = new Int[size];
+        for(int i = 0; i < size; i++) {
+          c->d[i].Rand(128);
+          Point S = secp->ComputePublicKey(&c->d[i]);
+          c->px[i].Set(&S.x);
+          c->py[i].Set(&S.y);
+        }
+      }
+
+      // Calibrate the number of iterations of a run
+      uint64_t n = 1;
+      double t0 = Timer::get_tick();
+      BenchOp(op,size,c,n);
+      double t1 = Timer::get_tick();
+      while(t1 - t0 < BENCH_MIN_TIME) {
+        n *= 2;
+        t0 = Timer::get_tick();
+        BenchOp(op,size,c,n);
+        t1 = Timer::get_tick();
+      }
+
+      BENCH_RESULT r;
+      r.name = names[op];
+      r.size = size;
+      r.nbOp = n * (uint64_t)size;
+      r.nsPerOp = 0;
+      r.cyclesPerOp = 0;
+
+      for(int i = 0; i < BENCH_REPEAT; i++) {
+        uint64_t c0 = Timer::getTSC();
+        t0 = Timer::get_tick();
+        BenchOp(op,size,c,n);
+        t1 = Timer::get_tick();
+        uint64_t c1 = Timer::getTSC();
+        double ns = (t1 - t0) * 1e9 / (double)r.nbOp;
+        double cy = (double)(c1 - c0) / (double)r.nbOp;
+        if(i == 0 || ns < r.nsPerOp) r.nsPerOp = ns;
+        if(i == 0 || cy < r.cyclesPerOp) r.cyclesPerOp = cy;
+      }
+      if(!hasTSC) r.cyclesPerOp = 0;
+
+      BenchPrint(r);
+      results.push_back(r);
+
+      if(op == BENCH_GRPINV || op == BENCH_JUMP) {
+        delete[] c->ints;
+        delete c->grp;
+      }
+      if(op == BENCH_JUMP) {
+        delete[] c->px;
+        delete[] c->py;
+        delete[] c->d;
+        delete[] c->dx;
+      }
+
+    }
+
+  }
+
+  // Printed so that the compiler cannot drop the computations
+  ::printf("Bench: checksum %016" PRIx64 "\n",c->sink);
+  delete c;
+
+  if(jsonFile.length() == 0)
+    return;
+
+  FILE *f = fopen(jsonFile.c_str(),"w");
+  if(f == NULL) {
+    ::printf("Bench: Cannot open %s for writing\n",jsonFile.c_str());
+    ::printf("%s\n",::strerror(errno));
+    return;
+  }
+
+  ::fprintf(f,"{\n");
+  ::fprintf(f,"  \"version\": \"%s\",\n",RELEASE);
+  ::fprintf(f,"  \"cores\": %d,\n",Timer::getCoreNumber());
+  ::fprintf(f,"  \"tsc\": %s,\n",hasTSC ? "true" : "false");
+  ::fprintf(f,"  \"repeat\": %d,\n",BENCH_REPEAT);
+  ::fprintf(f,"  \"seed\": %u,\n",(uint32_t)BENCH_SEED);
+  ::fprintf(f,"  \"results\": [\n");
+  for(size_t i = 0; i < results.size(); i++) {
+    BENCH_RESULT &r = results[i];
+    ::fprintf(f,"    { \"name\": \"%s\", \"size\": %d, \"ops\": %" PRIu64 ", \"ns_per_op\": %.3f, ",
+              r.name.c_str(),r.size,r.nbOp,r.nsPerOp);
+    if(hasTSC)
+      ::fprintf(f,"\"cycles_per_op\": %.3f }",r.cyclesPerOp);
+    else
+      ::fprintf(f,"\"cycles_per_op\": null }");
+    ::fprintf(f,"%s\n",(i + 1 < results.size()) ? "," : "");
+  }
+  ::fprintf(f,"  ]\n");
+  ::fprintf(f,"}\n");
+  ::fclose(f);
+
+  ::printf("Bench: results written to %s\n",jsonFile.c_str());
+
+}
+
+// ----------------------------------------------------------------------------
+// DP table benchmark
+
+#define BENCH_LAT_STEP 16       // One Add() out of BENCH_LAT_STEP is timed
+#define BENCH_LOOKUP   (1<<20)  // Maximum number of lookups
+
+typedef struct {
+
+  string   name;
+  int      nbThread;
+  uint64_t nbOp;
+  double   opPerSec;
+  double   mbPerSec;   // Save/Load only
+  double   lat[5];     // p50,p90,p99,p99.9,max in ns (negative when not measured)
+
+} TABLE_RESULT;
+
+// Threaded proc
+#ifdef WIN64
+DWORD WINAPI _benchTableThread(LPVOID lpParam) {
+#else
+void* _benchTableThread(void* lpParam) {
+#endif
+  TH_PARAM* p = (TH_PARAM*)lpParam;
+  p->obj->BenchTableAdd(p);
+  p->isRunning = false;
+  return 0;
+}
+
+// Insert a slice of the DP stream, the table is shared as with walkers
+void Kangaroo::BenchTableAdd(TH_PARAM *p) {
+
+  for(uint64_t i = 0; i < p->nbBenchDP; i++) {
+    ENTRY *e = p->benchDP + i;
+    LOCK(ghMutex);
+    hashTable.Add(&e->x,&e->d,e->kType);
+    UNLOCK(ghMutex);
+  }
+
+}
+
+// Add a DP stream single threaded, one Add() out of BENCH_LAT_STEP is timed
+static void BenchTableTimedAdd(HashTable *t,vector<ENTRY> &dps,uint64_t nb,bool hasTSC,TABLE_RESULT &r) {
+
+  vector<uint64_t> lat;
+  lat.reserve(nb / BENCH_LAT_STEP + 1);
+
+  uint64_t c0 = Timer::getTSC();
+  double t0 = Timer::get_tick();
+  for(uint64_t i = 0; i < nb; i++) {
+    ENTRY *e = &dps[i];
+    if(hasTSC && i % BENCH_LAT_STEP == 0) {
+      uint64_t s = Timer::getTSC();
+      t->Add(&e->x,&e->d,e->kType);
+      lat.push_back(Timer::getTSC() - s);
+    } else {
+      t->Add(&e->x,&e->d,e->kType);
+    }
+  }
+  double t1 = Timer::get_tick();
+  uint64_t c1 = Timer::getTSC();
+
+  r.nbThread = 1;
+  r.nbOp = nb;
+  r.opPerSec = (double)nb / (t1 - t0);
+  r.mbPerSec = -1.0;
+  for(int i = 0; i < 5; i++) r.lat[i] = -1.0;
+
+  if(lat.size() > 0 && t1 > t0) {
+    // Convert TSC to ns using the rate measured on this pass
+    double nsPerCycle = (t1 - t0) * 1e9 / (double)(c1 - c0);
+    sort(lat.begin(),lat.end());
+    double q[4] = { 0.5,0.9,0.99,0.999 };
+    for(int i = 0; i < 4; i++)
+      r.lat[i] = (double)lat[(size_t)(q[i] * (double)(lat.size() - 1))] * nsPerCycle;
+    r.lat[4] = (double)lat.back() * nsPerCycle;
+  }
+
+}
+
+static void BenchTablePrint(TABLE_RESULT &r) {
+
+  ::printf("%-12s %3d %12.0f %10.3f",r.name.c_str(),r.nbThread,(double)r.nbOp,r.opPerSec / 1e6);
+  if(r.mbPerSec >= 0.0)
+    ::printf(" %9.1f MB/s",r.mbPerSec);
+  if(r.lat[0] >= 0.0)
+    ::printf("  lat(ns) p50 %.0f p90 %.0f p99 %.0f p99.9 %.0f max %.0f",r.lat[0],r.lat[1],r.lat[2],r.lat[3],r.lat[4]);
+  ::printf("\n");
+
+}
+
+void Kangaroo::BenchTable(uint64_t nbDP,double dupRate,int nbThread,string replayFile,string jsonFile) {
+
+  vector<ENTRY> dps;
+  vector<TABLE_RESULT> results;
+  TABLE_RESULT r;
+  bool hasTSC = Timer::getTSC() != 0;
+  rseed(BENCH_SEED);
+
+  if(nbThread < 1) nbThread = 1;
+
+  if(replayFile.length() > 0) {
+
+    // Recorded stream: DPs of a work file, in a reproducible random order
+    if(!LoadWork(replayFile))
+      return;
+    for(uint32_t h = 0; h < HASH_SIZE; h++)
+      for(uint32_t i = 0; i < hashTable.E[h].nbItem; i++)
+        dps.push_back(*hashTable.GetItem(h,i));
+    hashTable.Reset();
+    for(size_t i = dps.size(); i > 1; i--) {
+      size_t j = (size_t)(rndl() % i);
+      ENTRY tmp = dps[i - 1];
+      dps[i - 1] = dps[j];
+      dps[j] = tmp;
+    }
+    if(nbDP > 0 && nbDP < dps.size())
+      dps.resize(nbDP);
+    nbDP = dps.size();
+
+  } else {
+
+    // Synthetic stream, DP x have their dpSize upper bits cleared
+    if(initDPSize < 0) SetDP(16);
+    else SetDP(initDPSize);
+    dps.reserve(nbDP);
+    for(uint64_t i = 0; i < nbDP; i++) {
+      if(i > 0 && rnd() < dupRate) {
+        dps.push_back(dps[rndl() % i]);
+        continue;
+      }
+      Int x;
+      Int d;
+      ENTRY e;
+      x.Rand(256);
+      for(int j = 0; j < 4; j++) x.bits64[j] &= ~dMask.i64[j];
+      d.Rand(126);
+      HashTable::Convert(&x,&d,&e.x,&e.d);
+      e.kType = rndl() % 2;
+      dps.push_back(e);
+    }
+
+  }
+
+  if(nbDP == 0) {
+    ::printf("BenchTable: No DP to insert\n");
+    return;
+  }
+
+  ::printf("BenchTable: %.0f DP (2^%.2f), DP size %d, duplicate %.2f%%, %d thread(s)%s\n",
+           (double)nbDP,log2((double)nbDP),dpSize,dupRate * 100.0,nbThread,
+           (replayFile.length() > 0) ? ", replay" : "");
+
+  // Single threaded insert
+  hashTable.Reset();
+  r.name = "Add";
+  BenchTableTimedAdd(&hashTable,dps,nbDP,hasTSC,r);
+  results.push_back(r);
+
+  // Memory footprint of the filled table
+  uint64_t nbItem = hashTable.GetNbItem();
+  uint64_t totalByte = hashTable.GetTotalByte();
+
+  // Lookups of stored DPs (all duplicates)
+  {
+    uint64_t nbLookup = (nbDP < BENCH_LOOKUP) ? nbDP : BENCH_LOOKUP;
+    vector<ENTRY> lk;
+    lk.reserve(nbLookup);
+    for(uint64_t i = 0; i < nbLookup; i++)
+      lk.push_back(dps[rndl() % nbDP]);
+    r.name = "Lookup";
+    BenchTableTimedAdd(&hashTable,lk,nbLookup,hasTSC,r);
+    results.push_back(r);
+  }
+
+  // Multi threaded insert, Add() is serialized by ghMutex as in SolveKeyCPU()
+  {
+    hashTable.Reset();
+    TH_PARAM *params = (TH_PARAM *)malloc(nbThread * sizeof(TH_PARAM));
+    THREAD_HANDLE *thHandles = (THREAD_HANDLE *)malloc(nbThread * sizeof(THREAD_HANDLE));
+    memset(params,0,nbThread * sizeof(TH_PARAM));
+    uint64_t slice = nbDP / nbThread;
+    double t0 = Timer::get_tick();
+    for(int i = 0; i < nbThread; i++) {
+      params[i].threadId = i;
+      params[i].isRunning = true;
+      params[i].benchDP = &dps[i * slice];
+      params[i].nbBenchDP = (i == nbThread - 1) ? nbDP - i * slice : slice;
+      thHandles[i] = LaunchThread(_benchTableThread,params + i);
+    }
+    JoinThreads(thHandles,nbThread);
+    FreeHandles(thHandles,nbThread);
+    double t1 = Timer::get_tick();
+    free(params);
+    free(thHandles);
+    r.name = "AddShared";
+    r.nbThread = nbThread;
+    r.nbOp = nbDP;
+    r.opPerSec = (double)nbDP / (t1 - t0);
+    r.mbPerSec = -1.0;
+    for(int i = 0; i < 5; i++) r.lat[i] = -1.0;
+    results.push_back(r);
+  }
+
+  // Save and load
+  {
+    string tmpName = "benchtable_" + ::to_string(pid) + ".tmp";
+    FILE *f = fopen(tmpName.c_str(),"wb+");
+    if(f == NULL) {
+      ::printf("BenchTable: Cannot open %s for writing\n",tmpName.c_str());
+      ::printf("%s\n",::strerror(errno));
+      return;
+    }
+
+    double t0 = Timer::get_tick();
+    hashTable.SaveTable(f);
+    fflush(f);
+    double t1 = Timer::get_tick();
+    uint64_t fileSize = FTell(f);
+    r.name = "SaveTable";
+    r.nbThread = 1;
+    r.nbOp = nbItem;
+    r.opPerSec = (double)nbItem / (t1 - t0);
+    r.mbPerSec = (double)fileSize / (1024.0 * 1024.0) / (t1 - t0);
+    results.push_back(r);
+
+    hashTable.Reset();
+    FSeek(f,0);
+    t0 = Timer::get_tick();
+    hashTable.LoadTable(f);
+    t1 = Timer::get_tick();
+    r.name = "LoadTable";
+    r.opPerSec = (double)nbItem / (t1 - t0);
+    r.mbPerSec = (double)fileSize / (1024.0 * 1024.0) / (t1 - t0);
+    results.push_back(r);
+
+    fclose(f);
+    remove(tmpName.c_str());
+  }
+
+  // Merge the table with a second one holding every other DP of the stream
+  {
+    HashTable *t2 = new HashTable();
+    for(uint64_t i = 0; i < nbDP; i += 2)
+      t2->Add(&dps[i].x,&dps[i].d,dps[i].kType);
+
+    uint64_t s1 = hashTable.GetTableSize(0,HASH_SIZE);
+    uint64_t s2 = t2->GetTableSize(0,HASH_SIZE);
+    uint8_t *b1 = (uint8_t *)malloc(s1);
+    uint8_t *b2 = (uint8_t *)malloc(s2);
+    uint8_t *bo = (uint8_t *)malloc(s1 + s2);
+    if(b1 == NULL || b2 == NULL || bo == NULL) {
+      ::printf("BenchTable: Cannot allocate %.1f MB for merge\n",(double)(2 * (s1 + s2)) / (1024.0 * 1024.0));
+    } else {
+      hashTable.SerializeTable(b1,0,HASH_SIZE);
+      t2->SerializeTable(b2,0,HASH_SIZE);
+      uint8_t *in[2] = { b1,b2 };
+      uint8_t *bd = bo;
+      uint32_t hDP;
+      uint32_t hDuplicate;
+      Int d1;
+      uint32_t k1;
+      Int d2;
+      uint32_t k2;
+      uint64_t nbIn = hashTable.GetNbItem() + t2->GetNbItem();
+      double t0 = Timer::get_tick();
+      for(uint32_t h = 0; h < HASH_SIZE; h++)
+        HashTable::MergeH(h,2,in,&bd,&hDP,&hDuplicate,&d1,&k1,&d2,&k2);
+      double t1 = Timer::get_tick();
+      r.name = "MergeH";
+      r.nbThread = 1;
+      r.nbOp = nbIn;
+      r.opPerSec = (double)nbIn / (t1 - t0);
+      r.mbPerSec = (double)(s1 + s2) / (1024.0 * 1024.0) / (t1 - t0);
+      results.push_back(r);
+    }
+    safe_free(b1);
+    safe_free(b2);
+    safe_free(bo);
+    t2->Reset();
+    delete t2;
+  }
+
+  hashTable.Reset();
+
+  ::printf("\nBenchTable: %.0f DP stored, %.1f bytes/DP, %.1f MB\n",(double)nbItem,
+           (double)totalByte / (double)nbItem,(double)totalByte / (1024.0 * 1024.0));
+  ::printf("%-12s %3s %12s %10s\n","Operation","Thr","DP","MDP/s");
+  for(size_t i = 0; i < results.size(); i++)
+    BenchTablePrint(results[i]);
+
+  if(jsonFile.length() == 0)
+    return;
+
+  FILE *f = fopen(jsonFile.c_str(),"w");
+  if(f == NULL) {
+    ::printf("BenchTable: Cannot open %s for writing\n",jsonFile.c_str());
+    ::printf("%s\n",::strerror(errno));
+    return;
+  }
+
+  ::fprintf(f,"{\n");
+  ::fprintf(f,"  \"version\": \"%s\",\n",RELEASE);
+  ::fprintf(f,"  \"cores\": %d,\n",Timer::getCoreNumber());
+  ::fprintf(f,"  \"nb_dp\": %" PRIu64 ",\n",nbDP);
+  ::fprintf(f,"  \"dp_size\": %d,\n",dpSize);
+  ::fprintf(f,"  \"duplicate_rate\": %.4f,\n",dupRate);
+  ::fprintf(f,"  \"replay\": %s,\n",(replayFile.length() > 0) ? "true" : "false");
+  ::fprintf(f,"  \"stored_dp\": %" PRIu64 ",\n",nbItem);
+  ::fprintf(f,"  \"bytes_per_dp\": %.3f,\n",(double)totalByte / (double)nbItem);
+  ::fprintf(f,"  \"results\": [\n");
+  for(size_t i = 0; i < results.size(); i++) {
+    TABLE_RESULT &t = results[i];
+    ::fprintf(f,"    { \"name\": \"%s\", \"threads\": %d, \"ops\": %" PRIu64 ", \"ops_per_sec\": %.1f",
+              t.name.c_str(),t.nbThread,t.nbOp,t.opPerSec);
+    if(t.mbPerSec >= 0.0)
+      ::fprintf(f,", \"mb_per_sec\": %.3f",t.mbPerSec);
+    if(t.lat[0] >= 0.0)
+      ::fprintf(f,", \"lat_ns\": { \"p50\": %.1f, \"p90\": %.1f, \"p99\": %.1f, \"p999\": %.1f, \"max\": %.1f }",
+                t.lat[0],t.lat[1],t.lat[2],t.lat[3],t.lat[4]);
+    ::fprintf(f," }%s\n",(i + 1 < results.size()) ? "," : "");
+  }
+  ::fprintf(f,"  ]\n");
+  ::fprintf(f,"}\n");
+  ::fclose(f);
+
+  ::printf("BenchTable: results written to %s\n",jsonFile.c_str());
+
+}
+
+// ----------------------------------------------------------------------------
+// Statistical solve-time harness
+
+#define STAT_SEED 0x53544154
+
+typedef struct {
+
+  uint32_t jumpSeed;
+  int      grpSize;
+  int      dpSize;
+  int      nbSolved;
+  int      nbFailed;
+  double   mean;      // Operations / sqrt(N)
+  double   stdDev;
+  double   ci95;      // Half width of the 95% confidence interval of the mean
+  double   expected;  // expectedNbOp / sqrt(N)
+  double   dead;      // Average dead kangaroos per key
+  double   time;      // Average solve time
+
+} STAT_RESULT;
+
+#ifdef WIN64
+extern DWORD WINAPI _SolveKeyCPU(LPVOID lpParam);
+#else
+extern void *_SolveKeyCPU(void *lpParam);
+#endif
+
+// Solve nbKey random keys of a 2^rangeBits range for each configuration
+// (jump table x kangaroos per thread x DP size). The same keys are used for
+// every configuration.
+void Kangaroo::StatSolve(int nbThread,int nbKey,int rangeBits,vector<int> dpSizes,vector<int> grpSizes,
+                         int nbJumpTable,string jsonFile) {
+
+  if(nbThread < 1) nbThread = 1;
+  if(nbJumpTable < 1) nbJumpTable = 1;
+  if(grpSizes.size() == 0) grpSizes.push_back(CPU_GRP_SIZE);
+  if(dpSizes.size() == 0) dpSizes.push_back(initDPSize);
+
+  nbCPUThread = nbThread;
+  nbGPUThread = 0;
+  workFile = "";
+
+#ifdef WALK_PROFILE
+  WalkProfileInit();
+#endif
+
+  // Range [2^rangeBits,2^(rangeBits+1)[
+  rangeStart.SetInt32(1);
+  rangeStart.ShiftL(rangeBits);
+  rangeEnd.Set(&rangeStart);
+  rangeEnd.ShiftL(1);
+  rangeEnd.SubOne();
+  InitRange();
+  double sqrtN = pow(2.0,(double)rangePower / 2.0);
+
+  rseed(STAT_SEED);
+  vector<Point> keys;
+  for(int k = 0; k < nbKey; k++) {
+    Int pk;
+    pk.Rand(rangeBits);
+    pk.Add(&rangeStart);
+    keys.push_back(secp->ComputePublicKey(&pk));
+  }
+
+  TH_PARAM *params = (TH_PARAM *)malloc(nbThread * sizeof(TH_PARAM));
+  THREAD_HANDLE *thHandles = (THREAD_HANDLE *)malloc(nbThread * sizeof(THREAD_HANDLE));
+  vector<STAT_RESULT> results;
+  int nbConfig = nbJumpTable * (int)grpSizes.size() * (int)dpSizes.size();
+
+  for(int j = 0; j < nbJumpTable; j++) {
+
+    jumpSeed = 0x600DCAFE + j;
+    CreateJumpTable();
+
+    for(size_t g = 0; g < grpSizes.size(); g++) {
+
+      CPU_GRP_SIZE = grpSizes[g];
+      totalRW = (uint64_t)nbThread * CPU_GRP_SIZE;
+
+      for(size_t d = 0; d < dpSizes.size(); d++) {
+
+        int dp = (dpSizes[d] < 0) ? GetSuggestedDP() : dpSizes[d];
+        SetDP(dp);
+        ComputeExpected((double)dp,&expectedNbOp,&expectedMem);
+
+        STAT_RESULT r;
+        r.jumpSeed = jumpSeed;
+        r.grpSize = CPU_GRP_SIZE;
+        r.dpSize = dp;
+        r.nbSolved = 0;
+        r.nbFailed = 0;
+        r.expected = expectedNbOp / sqrtN;
+        r.dead = 0;
+        r.time = 0;
+        vector<double> ops;
+#ifdef WALK_PROFILE
+        vector<WALK_PROF *> prof(nbThread,(WALK_PROF *)NULL);
+#endif
+
+        for(int k = 0; k < nbKey; k++) {
+
+          KEY_PROGRESS kp;
+          kp.status = KEY_PENDING;
+          kp.count = 0;
+          kp.time = 0;
+          keysToSearch.assign(1,keys[k]);
+          keyProgress.assign(1,kp);
+          keyIdx = 0;
+          InitSearchKey();
+
+          endOfSearch = false;
+          collisionInSameHerd = 0;
+          memset(counters,0,sizeof(counters));
+          memset(params,0,nbThread * sizeof(TH_PARAM));
+#ifdef WALK_PROFILE
+          // Profile of the configuration, over all keys
+          for(int i = 0; i < nbThread; i++)
+            params[i].prof = prof[i];
+#endif
+
+          double t0 = Timer::get_tick();
+          for(int i = 0; i < nbThread; i++) {
+            params[i].threadId = i;
+            params[i].isRunning = true;
+            thHandles[i] = LaunchThread(_SolveKeyCPU,params + i);
+          }
+          Process(params,"MK/s");
+          JoinThreads(thHandles,nbThread);
+          FreeHandles(thHandles,nbThread);
+          double t1 = Timer::get_tick();
+#ifdef WALK_PROFILE
+          for(int i = 0; i < nbThread; i++)
+            prof[i] = params[i].prof;
+#endif
+
+          uint64_t count = getCPUCount();
+          if(keyProgress[0].status == KEY_SOLVED) {
+            ops.push_back((double)count / sqrtN);
+            r.nbSolved++;
+            r.dead += (double)collisionInSameHerd;
+            r.time += t1 - t0;
+          } else {
+            r.nbFailed++;
+          }
+          hashTable.Reset();
+
+          ::printf("\n[StatSolve] Config %d/%d Key %d/%d: 2^%.2f ops (%.3f sqrt(N))%s\n",
+                   (int)results.size() + 1,nbConfig,k + 1,nbKey,log2((double)count),(double)count / sqrtN,
+                   (keyProgress[0].status == KEY_SOLVED) ? "" : " FAILED");
+
+        }
+
+        // Mean, sample standard deviation and normal 95% confidence interval
+        double sum = 0.0;
+        double sum2 = 0.0;
+        for(size_t i = 0; i < ops.size(); i++)
+          sum += ops[i];
+        r.mean = (ops.size() > 0) ? sum / (double)ops.size() : 0.0;
+        for(size_t i = 0; i < ops.size(); i++)
+          sum2 += (ops[i] - r.mean) * (ops[i] - r.mean);
+        r.stdDev = (ops.size() > 1) ? sqrt(sum2 / (double)(ops.size() - 1)) : 0.0;
+        r.ci95 = (ops.size() > 1) ? 1.96 * r.stdDev / sqrt((double)ops.size()) : 0.0;
+        if(r.nbSolved > 0) {
+          r.dead /= (double)r.nbSolved;
+          r.time /= (double)r.nbSolved;
+        }
+        results.push_back(r);
+
+#ifdef WALK_PROFILE
+        WalkProfileDump(params,nbThread);
+        for(int i = 0; i < nbThread; i++)
+          free(prof[i]);
+#endif
+
+      }
+
+    }
+
+  }
+
+  free(params);
+  free(thHandles);
+  jumpSeed = 0x600DCAFE;
+
+#ifdef USE_SYMMETRY
+  bool symmetry = true;
+#else
+  bool symmetry = false;
+#endif
+
+  ::printf("\nStatSolve: range 2^%d, %d keys, %d thread(s), symmetry %s, operations in sqrt(N) units\n",
+           rangePower,nbKey,nbThread,symmetry ? "on" : "off");
+  ::printf("%-8s %6s %3s %8s %9s %8s %8s %19s %8s %8s %9s\n","Jump","Grp","DP","Kang","Solved",
+           "Mean","StdDev","CI95","Expected","Dead","Time");
+  for(size_t i = 0; i < results.size(); i++) {
+    STAT_RESULT &r = results[i];
+    ::printf("%08X %6d %3d 2^%6.2f %4d/%-4d %8.3f %8.3f [%8.3f,%8.3f] %8.3f %8.1f %8.2fs\n",
+             r.jumpSeed,r.grpSize,r.dpSize,log2((double)nbThread * r.grpSize),r.nbSolved,r.nbSolved + r.nbFailed,
+             r.mean,r.stdDev,r.mean - r.ci95,r.mean + r.ci95,r.expected,r.dead,r.time);
+  }
+
+  if(jsonFile.length() == 0)
+    return;
+
+  FILE *f = fopen(jsonFile.c_str(),"w");
+  if(f == NULL) {
+    ::printf("StatSolve: Cannot open %s for writing\n",jsonFile.c_str());
+    ::printf("%s\n",::strerror(errno));
+    return;
+  }
+
+  ::fprintf(f,"{\n");
+  ::fprintf(f,"  \"version\": \"%s\",\n",RELEASE);
+  ::fprintf(f,"  \"range_bits\": %d,\n",rangePower);
+  ::fprintf(f,"  \"keys\": %d,\n",nbKey);
+  ::fprintf(f,"  \"threads\": %d,\n",nbThread);
+  ::fprintf(f,"  \"symmetry\": %s,\n",symmetry ? "true" : "false");
+  ::fprintf(f,"  \"results\": [\n");
+  for(size_t i = 0; i < results.size(); i++) {
+    STAT_RESULT &r = results[i];
+    ::fprintf(f,"    { \"jump_seed\": %u, \"grp_size\": %d, \"dp_size\": %d, \"solved\": %d, \"failed\": %d, "
+                "\"mean\": %.5f, \"std_dev\": %.5f, \"ci95\": %.5f, \"expected\": %.5f, \"dead\": %.3f, \"time\": %.3f }%s\n",
+              r.jumpSeed,r.grpSize,r.dpSize,r.nbSolved,r.nbFailed,r.mean,r.stdDev,r.ci95,r.expected,r.dead,r.time,
+              (i + 1 < results.size()) ? "," : "");
+  }
+  ::fprintf(f,"  ]\n");
+  ::fprintf(f,"}\n");
+  ::fclose(f);
+
+  ::printf("StatSolve: results written to %s\n",jsonFile.c_str());
+
+}
+
+// ----------------------------------------------------------------------------
+// DP pipeline counters
+
+// Written at the end of the search (-pstat), one "name value" per line
+void Kangaroo::SavePipeStat(double elapsed) {
+
+  string tmpName = pipeStatFile + ".tmp";
+  FILE *f = fopen(tmpName.c_str(),"w");
+  if(f == NULL) {
+    ::printf("SavePipeStat: Cannot open %s for writing\n",tmpName.c_str());
+    ::printf("%s\n",::strerror(errno));
+    return;
+  }
+
+  pipeStat.nbQueued = dpQueue.getTotalPushed();
+
+  ::fprintf(f,"mode %s\n",clientMode ? "client" : "server");
+  ::fprintf(f,"elapsed %.6f\n",elapsed);
+  ::fprintf(f,"queued %llu\n",(unsigned long long)pipeStat.nbQueued);
+  ::fprintf(f,"max_queue %llu\n",(unsigned long long)pipeStat.maxQueue);
+  ::fprintf(f,"packets %llu\n",(unsigned long long)pipeStat.nbPacket);
+  ::fprintf(f,"sent %llu\n",(unsigned long long)pipeStat.nbSent);
+  ::fprintf(f,"status %llu\n",(unsigned long long)pipeStat.nbStatus);
+  ::fprintf(f,"send_time %.6f\n",pipeStat.sendTime);
+  ::fprintf(f,"wait_time %.6f\n",pipeStat.waitTime);
+  ::fprintf(f,"received %llu\n",(unsigned long long)pipeStat.nbRecv);
+  ::fprintf(f,"added %llu\n",(unsigned long long)pipeStat.nbAdded);
+  ::fprintf(f,"max_pending %llu\n",(unsigned long long)pipeStat.maxPending);
+  ::fprintf(f,"bytes_out %llu\n",(unsigned long long)pipeStat.bytesOut);
+  ::fprintf(f,"bytes_in %llu\n",(unsigned long long)pipeStat.bytesIn);
+  ::fclose(f);
+
+  // The file appears complete (polled by -lbench)
+  remove(pipeStatFile.c_str());
+  rename(tmpName.c_str(),pipeStatFile.c_str());
+
+}
+
+static bool LoadPipeStat(string fileName,PIPE_STAT *s,double *elapsed) {
+
+  FILE *f = fopen(fileName.c_str(),"r");
+  if(f == NULL)
+    return false;
+
+  char name[64];
+  double v;
+  ::memset(s,0,sizeof(PIPE_STAT));
+  *elapsed = 0.0;
+
+  while(::fscanf(f,"%63s",name) == 1) {
+    if(strcmp(name,"mode") == 0) {
+      ::fscanf(f,"%63s",name);
+      continue;
+    }
+    if(::fscanf(f,"%lf",&v) != 1)
+      break;
+    if(strcmp(name,"elapsed") == 0) *elapsed = v;
+    else if(strcmp(name,"queued") == 0) s->nbQueued = (uint64_t)v;
+    else if(strcmp(name,"max_queue") == 0) s->maxQueue = (uint64_t)v;
+    else if(strcmp(name,"packets") == 0) s->nbPacket = (uint64_t)v;
+    else if(strcmp(name,"sent") == 0) s->nbSent = (uint64_t)v;
+    else if(strcmp(name,"status") == 0) s->nbStatus = (uint64_t)v;
+    else if(strcmp(name,"send_time") == 0) s->sendTime = v;
+    else if(strcmp(name,"wait_time") == 0) s->waitTime = v;
+    else if(strcmp(name,"received") == 0) s->nbRecv = (uint64_t)v;
+    else if(strcmp(name,"added") == 0) s->nbAdded = (uint64_t)v;
+    else if(strcmp(name,"max_pending") == 0) s->maxPending = (uint64_t)v;
+    else if(strcmp(name,"bytes_out") == 0) s->bytesOut = (uint64_t)v;
+    else if(strcmp(name,"bytes_in") == 0) s->bytesIn = (uint64_t)v;
+  }
+
+  ::fclose(f);
+  return true;
+
+}
+
+// ----------------------------------------------------------------------------
+// Loopback cluster benchmark
+
+#define LBENCH_SEED        0x4C42454E
+#define LBENCH_START_TIME  30.0   // Server startup timeout (s)
+#define LBENCH_END_TIME    60.0   // Client shutdown timeout, after the key is found (s)
+
+#ifndef WIN64
+
+// Launch this executable with its output redirected to logName
+static pid_t LoopBenchSpawn(vector<string> &args,string logName) {
+
+  pid_t child = fork();
+
+  if(child == 0) {
+    int fd = open(logName.c_str(),O_WRONLY | O_CREAT | O_TRUNC,0644);
+    if(fd >= 0) {
+      dup2(fd,1);
+      dup2(fd,2);
+      close(fd);
+    }
+    vector<char *> argv;
+    for(size_t i = 0; i < args.size(); i++)
+      argv.push_back((char *)args[i].c_str());
+    argv.push_back(NULL);
+    execv("/proc/self/exe",&argv[0]);
+    _exit(127);
+  }
+
+  if(child < 0)
+    ::printf("LoopBench: fork() failed: %s\n",::strerror(errno));
+
+  return child;
+
+}
+
+static bool LoopBenchLogHas(string logName,const char *str) {
+
+  FILE *f = fopen(logName.c_str(),"r");
+  if(f == NULL)
+    return false;
+  char line[1024];
+  bool found = false;
+  while(!found && ::fgets(line,sizeof(line),f) != NULL)
+    found = (strstr(line,str) != NULL);
+  ::fclose(f);
+  return found;
+
+}
+
+static bool FileExists(string fileName) {
+
+  FILE *f = fopen(fileName.c_str(),"r");
+  if(f == NULL)
+    return false;
+  ::fclose(f);
+  return true;
+
+}
+
+#endif
+
+// A server and nbClient CPU clients (separate processes) solve a known key
+// over loopback. Each process dumps its pipeline counters (-pstat), the
+// harness reports time to solve, DP rates of each stage, queue depths and
+// bytes on the wire.
+void Kangaroo::LoopBench(int nbClient,int rangeBits,int nbThread,string jsonFile) {
+
+#ifdef WIN64
+
+  ::printf("LoopBench: not supported on Windows\n");
+
+#else
+
+  if(nbThread < 1) nbThread = 1;
+
+  char tmp[256];
+  ::sprintf(tmp,"lbench_%u",pid);
+  string base = string(tmp);
+  string cfgName = base + ".txt";
+  string outName = base + "_found.txt";
+  vector<string> statNames;
+  vector<string> logNames;
+  statNames.push_back(base + "_server.stat");
+  logNames.push_back(base + "_server.log");
+  for(int i = 0; i < nbClient; i++) {
+    ::sprintf(tmp,"%s_client%d",base.c_str(),i);
+    statNames.push_back(string(tmp) + ".stat");
+    logNames.push_back(string(tmp) + ".log");
+  }
+
+  // Known key in [2^rangeBits,2^(rangeBits+1)[
+  rangeStart.SetInt32(1);
+  rangeStart.ShiftL(rangeBits);
+  rangeEnd.Set(&rangeStart);
+  rangeEnd.ShiftL(1);
+  rangeEnd.SubOne();
+  InitRange();
+
+  rseed(LBENCH_SEED);
+  Int priv;
+  priv.Rand(rangeBits);
+  priv.Add(&rangeStart);
+  Point pub = secp->ComputePublicKey(&priv);
+
+  FILE *f = fopen(cfgName.c_str(),"w");
+  if(f == NULL) {
+    ::printf("LoopBench: Cannot open %s for writing\n",cfgName.c_str());
+    ::printf("%s\n",::strerror(errno));
+    return;
+  }
+  ::fprintf(f,"%s\n%s\n%s\n",rangeStart.GetBase16().c_str(),rangeEnd.GetBase16().c_str(),
+            secp->GetPublicKeyHex(true,pub).c_str());
+  ::fclose(f);
+
+  // DP size: -d or suggested for the kangaroos of all clients
+  totalRW = (uint64_t)nbClient * nbThread * CPU_GRP_SIZE;
+  int dp = (initDPSize < 0) ? GetSuggestedDP() : initDPSize;
+  ComputeExpected((double)dp,&expectedNbOp,&expectedMem);
+
+  ::printf("LoopBench: %d client(s) x %d thread(s), range 2^%d, DP %d, port %d\n",nbClient,nbThread,rangePower,dp,port);
+  ::printf("LoopBench: Expected operations 2^%.2f\n",log2(expectedNbOp));
+
+  // Server
+  vector<string> args;
+  ::sprintf(tmp,"%d",dp);
+  args.push_back("kangaroo"); args.push_back("-s");
+  args.push_back("-d"); args.push_back(string(tmp));
+  ::sprintf(tmp,"%d",port);
+  args.push_back("-sp"); args.push_back(string(tmp));
+  args.push_back("-o"); args.push_back(outName);
+  args.push_back("-pstat"); args.push_back(statNames[0]);
+  args.push_back(cfgName);
+
+  vector<pid_t> pids;
+  pid_t server = LoopBenchSpawn(args,logNames[0]);
+  if(server < 0)
+    return;
+
+  double t0 = Timer::get_tick();
+  bool ready = false;
+  int status;
+  while(!ready && Timer::get_tick() - t0 < LBENCH_START_TIME) {
+    Timer::SleepMillis(50);
+    if(waitpid(server,&status,WNOHANG) == server) {
+      ::printf("LoopBench: Server exited, see %s\n",logNames[0].c_str());
+      return;
+    }
+    ready = LoopBenchLogHas(logNames[0],"listening");
+  }
+  if(!ready) {
+    ::printf("LoopBench: Server not ready after %.0fs, see %s\n",LBENCH_START_TIME,logNames[0].c_str());
+    kill(server,SIGKILL);
+    waitpid(server,&status,0);
+    return;
+  }
+
+  // Clients
+  ::sprintf(tmp,"%d",nbThread);
+  string nbThreadStr = string(tmp);
+  ::sprintf(tmp,"%d",port);
+  string portStr = string(tmp);
+
+  t0 = Timer::get_tick();
+  for(int i = 0; i < nbClient; i++) {
+    args.clear();
+    args.push_back("kangaroo");
+    args.push_back("-t"); args.push_back(nbThreadStr);
+    args.push_back("-c"); args.push_back("127.0.0.1");
+    args.push_back("-sp"); args.push_back(portStr);
+    args.push_back("-pstat"); args.push_back(statNames[i + 1]);
+    pid_t c = LoopBenchSpawn(args,logNames[i + 1]);
+    if(c > 0) pids.push_back(c);
+  }
+
+  // Wait for the key (the server dumps its counters when the search ends)
+  bool serverDead = false;
+  while(!FileExists(statNames[0])) {
+    Timer::SleepMillis(50);
+    if(waitpid(server,&status,WNOHANG) == server) {
+      serverDead = true;
+      break;
+    }
+  }
+  double solveTime = Timer::get_tick() - t0;
+
+  // Clients stop on SERVER_END
+  double t1 = Timer::get_tick();
+  int nbRunning = (int)pids.size();
+  while(nbRunning > 0 && Timer::get_tick() - t1 < LBENCH_END_TIME) {
+    Timer::SleepMillis(50);
+    for(size_t i = 0; i < pids.size(); i++) {
+      if(pids[i] > 0 && waitpid(pids[i],&status,WNOHANG) == pids[i]) {
+        pids[i] = 0;
+        nbRunning--;
+      }
+    }
+  }
+  for(size_t i = 0; i < pids.size(); i++) {
+    if(pids[i] > 0) {
+      ::printf("LoopBench: Client %d did not stop, killed\n",(int)i);
+      kill(pids[i],SIGKILL);
+      waitpid(pids[i],&status,0);
+    }
+  }
+
+  // The server does not exit by itself
+  if(!serverDead) {
+    kill(server,SIGINT);
+    waitpid(server,&status,0);
+  }
+
+  // Check the key
+  bool found = false;
+  f = fopen(outName.c_str(),"r");
+  if(f != NULL) {
+    char line[1024];
+    while(!found && ::fgets(line,sizeof(line),f) != NULL) {
+      char *k = strstr(line,"Priv: 0x");
+      if(k == NULL) continue;
+      char *e = k + 8;
+      while(isxdigit(*e)) e++;
+      *e = 0;
+      Int r;
+      r.SetBase16(k + 8);
+      found = r.IsEqual(&priv);
+    }
+    ::fclose(f);
+  }
+
+  // Aggregate
+  PIPE_STAT srv;
+  PIPE_STAT cli;
+  double srvTime = 0.0;
+  double cliTime = 0.0;
+  bool statOk = LoadPipeStat(statNames[0],&srv,&srvTime);
+  ::memset(&cli,0,sizeof(PIPE_STAT));
+  vector<PIPE_STAT> clis;
+  vector<double> cliTimes;
+  for(int i = 0; i < nbClient; i++) {
+    PIPE_STAT c;
+    double t;
+    if(!LoadPipeStat(statNames[i + 1],&c,&t)) {
+      ::printf("LoopBench: No counters from client %d, see %s\n",i,logNames[i + 1].c_str());
+      statOk = false;
+      ::memset(&c,0,sizeof(PIPE_STAT));
+      t = 0.0;
+    }
+    clis.push_back(c);
+    cliTimes.push_back(t);
+    cli.nbQueued += c.nbQueued;
+    cli.nbPacket += c.nbPacket;
+    cli.nbSent += c.nbSent;
+    cli.nbStatus += c.nbStatus;
+    cli.sendTime += c.sendTime;
+    cli.waitTime += c.waitTime;
+    cli.bytesOut += c.bytesOut;
+    cli.bytesIn += c.bytesIn;
+    if(c.maxQueue > cli.maxQueue) cli.maxQueue = c.maxQueue;
+    if(t > cliTime) cliTime = t;
+  }
+
+  double packets = (cli.nbPacket > 0) ? (double)cli.nbPacket : 1.0;
+
+  ::printf("\nLoopBench: %d client(s) x %d thread(s), range 2^%d, DP %d, key %s\n",nbClient,nbThread,rangePower,dp,
+           found ? "found" : "NOT FOUND");
+  ::printf("Time to solve      %10.3f s (server search %.3f s, slowest client %.3f s)\n",solveTime,srvTime,cliTime);
+  ::printf("%-20s %14s %12s\n","Stage","DP","DP/s");
+  ::printf("%-20s %14.0f %12.0f\n","Walkers > dpQueue",(double)cli.nbQueued,(double)cli.nbQueued / solveTime);
+  ::printf("%-20s %14.0f %12.0f\n","SendToServer (ack)",(double)cli.nbSent,(double)cli.nbSent / solveTime);
+  ::printf("%-20s %14.0f %12.0f\n","HandleRequest",(double)srv.nbRecv,(double)srv.nbRecv / solveTime);
+  ::printf("%-20s %14.0f %12.0f\n","ProcessServer",(double)srv.nbAdded,(double)srv.nbAdded / solveTime);
+  ::printf("Max queue depth    dpQueue %.0f DP (worst client), recvDP %.0f DP\n",(double)cli.maxQueue,(double)srv.maxPending);
+  ::printf("Packets            %.0f (%.0f DP/packet), send %.3f ms/packet, wait %.3f ms/packet, %.0f status round trips\n",
+           (double)cli.nbPacket,(double)cli.nbSent / packets,cli.sendTime * 1000.0 / packets,
+           cli.waitTime * 1000.0 / packets,(double)cli.nbStatus);
+  ::printf("Wire (DP/ack)      clients out %.3f MB, in %.0f bytes | server in %.3f MB, out %.0f bytes | %.3f MB/s\n",
+           (double)cli.bytesOut / (1024.0 * 1024.0),(double)cli.bytesIn,
+           (double)srv.bytesIn / (1024.0 * 1024.0),(double)srv.bytesOut,
+           (double)srv.bytesIn / (1024.0 * 1024.0) / solveTime);
+  for(int i = 0; i < nbClient; i++) {
+    ::printf("Client %-3d         %.0f DP queued, %.0f DP sent in %.0f packets, max queue %.0f, %.3f s\n",i,
+             (double)clis[i].nbQueued,(double)clis[i].nbSent,(double)clis[i].nbPacket,(double)clis[i].maxQueue,cliTimes[i]);
+  }
+
+  if(found && statOk) {
+    remove(cfgName.c_str());
+    remove(outName.c_str());
+    for(size_t i = 0; i < statNames.size(); i++) {
+      remove(statNames[i].c_str());
+      remove(logNames[i].c_str());
+    }
+  } else {
+    ::printf("LoopBench: Logs kept in %s_*.log\n",base.c_str());
+  }
+
+  if(jsonFile.length() == 0)
+    return;
+
+  f = fopen(jsonFile.c_str(),"w");
+  if(f == NULL) {
+    ::printf("LoopBench: Cannot open %s for writing\n",jsonFile.c_str());
+    ::printf("%s\n",::strerror(errno));
+    return;
+  }
+
+  ::fprintf(f,"{\n");
+  ::fprintf(f,"  \"version\": \"%s\",\n",RELEASE);
+  ::fprintf(f,"  \"clients\": %d,\n",nbClient);
+  ::fprintf(f,"  \"threads\": %d,\n",nbThread);
+  ::fprintf(f,"  \"range_bits\": %d,\n",rangePower);
+  ::fprintf(f,"  \"dp_size\": %d,\n",dp);
+  ::fprintf(f,"  \"found\": %s,\n",found ? "true" : "false");
+  ::fprintf(f,"  \"solve_time\": %.6f,\n",solveTime);
+  ::fprintf(f,"  \"expected_ops\": %.0f,\n",expectedNbOp);
+  ::fprintf(f,"  \"server\": { \"time\": %.6f, \"received\": %llu, \"added\": %llu, \"max_pending\": %llu, "
+              "\"bytes_in\": %llu, \"bytes_out\": %llu },\n",
+            srvTime,(unsigned long long)srv.nbRecv,(unsigned long long)srv.nbAdded,(unsigned long long)srv.maxPending,
+            (unsigned long long)srv.bytesIn,(unsigned long long)srv.bytesOut);
+  ::fprintf(f,"  \"client\": [\n");
+  for(int i = 0; i < nbClient; i++) {
+    PIPE_STAT &c = clis[i];
+    ::fprintf(f,"    { \"time\": %.6f, \"queued\": %llu, \"max_queue\": %llu, \"packets\": %llu, \"sent\": %llu, "
+                "\"status\": %llu, \"send_time\": %.6f, \"wait_time\": %.6f, \"bytes_out\": %llu, \"bytes_in\": %llu }%s\n",
+              cliTimes[i],(unsigned long long)c.nbQueued,(unsigned long long)c.maxQueue,(unsigned long long)c.nbPacket,
+              (unsigned long long)c.nbSent,(unsigned long long)c.nbStatus,c.sendTime,c.waitTime,
+              (unsigned long long)c.bytesOut,(unsigned long long)c.bytesIn,(i + 1 < nbClient) ? "," : "");
+  }
+  ::fprintf(f,"  ]\n");
+  ::fprintf(f,"}\n");
+  ::fclose(f);
+
+  ::printf("LoopBench: results written to %s\n",jsonFile.c_str());
+
+#endif
+
+}
+
+// ----------------------------------------------------------------------------
+// CPU walk profiler (compiled with -DWALK_PROFILE, make profile=1)
+
+#ifdef WALK_PROFILE
+
+static volatile sig_atomic_t walkProfileSignal = 0;
+
+static const char *walkProfileName[WP_NB] = { "dx","modinv","add","dist","dpcheck","store" };
+
+// 8 bins per power of 2, bins 0..7 hold 0..7 cycles
+static int WalkProfileBin(uint64_t c) {
+
+  if(c < 8)
+    return (int)c;
+  int l = 63;
+  while(!(c >> l)) l--;
+  return 8 * (l - 2) + (int)((c >> (l - 3)) & 7);
+
+}
+
+static double WalkProfileBinValue(int b) {
+
+  if(b < 8)
+    return (double)b;
+  int l = b / 8 + 2;
+  return (double)(8 + b % 8) * pow(2.0,(double)(l - 3));
+
+}
+
+static double WalkProfilePercentile(uint64_t *hist,uint64_t count,double q) {
+
+  uint64_t target = (uint64_t)(q * (double)count);
+  uint64_t sum = 0;
+  for(int b = 0; b < WP_BIN; b++) {
+    sum += hist[b];
+    if(sum > target)
+      return WalkProfileBinValue(b);
+  }
+  return WalkProfileBinValue(WP_BIN - 1);
+
+}
+
+#ifndef WIN64
+static void WalkProfileHandler(int signo) {
+  walkProfileSignal = 1;
+}
+#endif
+
+void Kangaroo::WalkProfileAdd(WALK_PROF *p,int phase,uint64_t cycles) {
+
+  p->count[phase]++;
+  p->cycles[phase] += cycles;
+  p->hist[phase][WalkProfileBin(cycles)]++;
+
+}
+
+// Dump on SIGUSR1 (Linux)
+void Kangaroo::WalkProfileInit() {
+
+#ifndef WIN64
+  if(signal(SIGUSR1,WalkProfileHandler) == SIG_ERR)
+    ::printf("Warning: Walk profile, cannot install SIGUSR1 handler\n");
+  else
+    ::printf("Walk profile: enabled, kill -USR1 %d to dump\n",(int)Timer::getPID());
+#endif
+
+}
+
+void Kangaroo::WalkProfilePoll(TH_PARAM *threads,int nbThread) {
+
+  if(walkProfileSignal) {
+    walkProfileSignal = 0;
+    WalkProfileDump(threads,nbThread);
+  }
+
+}
+
+// Per phase share of the walk time, cycles per kangaroo and percentiles of
+// the phase duration over the walk iterations (all threads), counters are
+// read on the fly while the threads are walking
+void Kangaroo::WalkProfileDump(TH_PARAM *threads,int nbThread) {
+
+  WALK_PROF tot;
+  memset(&tot,0,sizeof(WALK_PROF));
+  for(int i = 0; i < nbThread; i++) {
+    WALK_PROF *p = threads[i].prof;
+    if(p == NULL)
+      continue;
+    for(int ph = 0; ph < WP_NB; ph++) {
+      tot.count[ph] += p->count[ph];
+      tot.cycles[ph] += p->cycles[ph];
+      for(int b = 0; b < WP_BIN; b++)
+        tot.hist[ph][b] += p->hist[ph][b];
+    }
+  }
+
+  uint64_t nbIter = tot.count[WP_DX];
+  if(nbIter == 0) {
+    ::printf("\nWalk profile: no walk iteration\n");
+    return;
+  }
+
+  double total = 0.0;
+  for(int ph = 0; ph < WP_NB; ph++)
+    total += (double)tot.cycles[ph];
+  double nbStep = (double)nbIter * (double)CPU_GRP_SIZE;
+
+  ::printf("\nWalk profile: %d thread(s), %.0f iterations of %d kangaroos, TSC cycles\n",nbThread,(double)nbIter,CPU_GRP_SIZE);
+  ::printf("%-8s %6s %10s %12s %12s %12s %12s\n","Phase","Share","Cyc/kang","Iter p50","Iter p90","Iter p99","Iter max");
+  for(int ph = 0; ph < WP_NB; ph++) {
+    int maxBin = 0;
+    for(int b = 0; b < WP_BIN; b++)
+      if(tot.hist[ph][b]) maxBin = b;
+    ::printf("%-8s %5.1f%% %10.1f %12.0f %12.0f %12.0f %12.0f\n",walkProfileName[ph],
+             100.0 * (double)tot.cycles[ph] / total,(double)tot.cycles[ph] / nbStep,
+             WalkProfilePercentile(tot.hist[ph],tot.count[ph],0.50),
+             WalkProfilePercentile(tot.hist[ph],tot.count[ph],0.90),
+             WalkProfilePercentile(tot.hist[ph],tot.count[ph],0.99),
+             WalkProfileBinValue(maxBin));
+  }
+  ::printf("%-8s %6s %10.1f\n","Total","",total / nbStep);
+
+  for(int i = 0; i < nbThread; i++) {
+    WALK_PROF *p = threads[i].prof;
+    if(p == NULL || p->count[WP_DX] == 0)
+      continue;
+    double th = 0.0;
+    for(int ph = 0; ph < WP_NB; ph++)
+      th += (double)p->cycles[ph];
+    ::printf("Thread %3d: %.0f iterations, %.1f cycles/kang\n",threads[i].threadId,
+             (double)p->count[WP_DX],th / ((double)p->count[WP_DX] * (double)CPU_GRP_SIZE));
+  }
+
+}
+
+#endif
@@ -30,50 +30,41 @@
 
 using namespace std;
 
-uint32_t Kangaroo::CheckHash(uint32_t h,uint32_t nbItem,HashTable* hT,FILE* f) {
+// DPs are accumulated across buckets into batches of CHECK_BATCH so that the
+// batched inversions of ComputePublicKeys() and AddDirect() are shared by
+// many points. When wrong is given, it receives the status of each DP.
+uint32_t Kangaroo::CheckBatch(vector<ENTRY> &batch,vector<uint8_t> *wrong) {
 
-  bool ok=true;
+  size_t nbItem = batch.size();
   vector<Int> dists;
-  vector<uint32_t> types;
+  vector<uint8_t> neg;
+  vector<Point> Sp;
+  dists.reserve(nbItem);
+  neg.reserve(nbItem);
+  Sp.reserve(nbItem);
   Point Z;
   Z.Clear();
   uint32_t nbWrong = 0;
-  ENTRY *items = NULL;
-  ENTRY* e;
-
-  if( hT ) {
-
-    for(uint32_t i = 0; i < nbItem; i++) {
-      e = hT->E[h].items[i];
-      Int dist;
-      uint32_t kType = e->kType;
-      HashTable::CalcDist(&(e->d),&dist);
-      dists.push_back(dist);
-      types.push_back(kType);
-    }
-
-  } else {
 
-    items = (ENTRY*)malloc(nbItem * sizeof(ENTRY));
+  for(size_t i = 0; i < nbItem; i++) {
 
-    for(uint32_t i = 0; i < nbItem; i++) {
-      ::fread(items+i,32,1,f);
-      e = items + i;
-      Int dist;
-      uint32_t kType = e->kType;
-      HashTable::CalcDist(&(e->d),&dist);
-      dists.push_back(dist);
-      types.push_back(kType);
-    }
+    // Negative distances (wild kangaroos) are computed as -(-d).G, the
+    // scalar is short and needs only a few fixed-base table additions
+    Int dist;
+    HashTable::CalcDist(&batch[i].d,&dist);
+    bool isNeg = (dist.bits64[3] >> 63) != 0;
+    if(isNeg) dist.ModNegK1order();
+    dists.push_back(dist);
+    neg.push_back(isNeg);
 
   }
 
   vector<Point> P = secp->ComputePublicKeys(dists);
-  vector<Point> Sp;
 
-  for(uint32_t i = 0; i < nbItem; i++) {
+  for(size_t i = 0; i < nbItem; i++) {
 
-    if(types[i] == TAME) {
+    if(neg[i]) P[i].y.ModNeg();
+    if(batch[i].kType == TAME) {
       Sp.push_back(Z);
     } else {
       Sp.push_back(keyToSearch);
@@ -81,76 +72,221 @@ uint32_t Kangaroo::CheckHash(uint32_t h,uint32_t nbItem,HashTable* hT,FILE* f) {
 
   }
 
+  // Wild offset added in a single batched affine step
   vector<Point> S = secp->AddDirect(Sp,P);
 
-  for(uint32_t i = 0; i < nbItem; i++) {
+  if(wrong) wrong->resize(nbItem);
 
-    if(hT)    e = hT->E[h].items[i];
-    else      e = items + i;
+  for(size_t i = 0; i < nbItem; i++) {
 
-    ok = (S[i].x.bits64[0] == e->x.i64[0]) && (S[i].x.bits64[1] == e->x.i64[1]) && (S[i].x.bits64[2] == e->x.i64[2]) && (S[i].x.bits64[3] == e->x.i64[3]);;
+    ENTRY *e = &batch[i];
+    bool ok = (S[i].x.bits64[0] == e->x.i64[0]) && (S[i].x.bits64[1] == e->x.i64[1]) &&
+              (S[i].x.bits64[2] == e->x.i64[2]) && (S[i].x.bits64[3] == e->x.i64[3]);
     if(!ok) nbWrong++;
-    //if(!ok) {
-    //  ::printf("\nCheckWorkFile wrong at: %06X [%d]\n",h,i);
-    //  ::printf("X=%s\n",S[i].x.GetBase16().c_str());
-    //  ::printf("X=%08X%08X%08X%08X\n",e->x.i32[3],e->x.i32[2],e->x.i32[1],e->x.i32[0]);
-    //  ::printf("D=%08X%08X%08X%08X\n",e->d.i32[3],e->d.i32[2],e->d.i32[1],e->d.i32[0]);
-    //  exit(0);
-    //}
+    if(wrong) (*wrong)[i] = !ok;
+
+  }
+
+  batch.clear();
+  return nbWrong;
+
+}
 
+// Verify nb kangaroos of a walking thread (index firstIdx..firstIdx+nb-1),
+// a tame kangaroo must be at d.G and a wild one at d.G + K (or d.G - K when
+// the symmetry switched its class). Wrong kangaroos are flagged in wrong[]
+// and counted in the thread error rate, the caller reseeds them.
+uint32_t Kangaroo::CheckKangaroos(TH_PARAM *ph,int nb,Int *px,Int *py,Int *d,uint64_t firstIdx,bool *wrong) {
 
+  vector<Int> dists;
+  vector<Point> Sp;
+  dists.reserve(nb);
+  Sp.reserve(nb);
+  Point Z;
+  Z.Clear();
+  uint32_t nbWrong = 0;
+
+  for(int i = 0; i < nb; i++) {
+    Int dist(&d[i]);
+    if(dist.bits64[3] >> 63) dist.ModNegK1order();
+    dists.push_back(dist);
   }
 
-  if(items) free(items);
+  vector<Point> P = secp->ComputePublicKeys(dists);
+
+  for(int i = 0; i < nb; i++) {
+    if(d[i].bits64[3] >> 63) P[i].y.ModNeg();
+    if((firstIdx + i) % 2 == TAME) {
+      Sp.push_back(Z);
+    } else {
+      Sp.push_back(keyToSearch);
+    }
+  }
+
+  vector<Point> S = secp->AddDirect(Sp,P);
+
+#ifdef USE_SYMMETRY
+  for(int i = 0; i < nb; i++)
+    if((firstIdx + i) % 2 == WILD) Sp[i].y.ModNeg();
+  vector<Point> Sm = secp->AddDirect(Sp,P);
+#endif
+
+  for(int i = 0; i < nb; i++) {
+
+    wrong[i] = !S[i].x.IsEqual(&px[i]) || !S[i].y.IsEqual(&py[i]);
+#ifdef USE_SYMMETRY
+    if(wrong[i] && (firstIdx + i) % 2 == WILD)
+      wrong[i] = !Sm[i].x.IsEqual(&px[i]) || !Sm[i].y.IsEqual(&py[i]);
+#endif
+    if(!wrong[i])
+      continue;
+
+    nbWrong++;
+    ph->nbKWrong++;
+    if(ph->threadId >= 0x80) {
+#ifdef WITHGPU
+      ::printf("\nKangaroo check: GPU#%d kangaroo #%.0f is wrong, reseeded (%.0f wrong / %.0f checked)\n",
+               ph->gpuId,(double)(firstIdx + i),(double)ph->nbKWrong,(double)(ph->nbKChecked + nb));
+#endif
+    } else {
+      ::printf("\nKangaroo check: CPU thread %d kangaroo #%.0f is wrong, reseeded (%.0f wrong / %.0f checked)\n",
+               ph->threadId,(double)(firstIdx + i),(double)ph->nbKWrong,(double)(ph->nbKChecked + nb));
+    }
+
+  }
+
+  ph->nbKChecked += nb;
   return nbWrong;
 
 }
 
+// Next region or partition to check, threads pick them until all are done
+int Kangaroo::NextCheckItem() {
+
+  int item = -1;
+  LOCK(ghMutex);
+  if(checkNext < MERGE_PART) {
+    item = (int)checkNext++;
+    if(item % 4 == 0) ::printf(".");
+  }
+  UNLOCK(ghMutex);
+  return item;
+
+}
+
 bool Kangaroo::CheckPartition(TH_PARAM* p) {
 
-  uint32_t part = p->hStart;
   string pName = string(p->part1Name);
+  vector<ENTRY> batch;
+  batch.reserve(CHECK_BATCH);
+  int part;
 
-  FILE* f1 = OpenPart(pName,"rb",part,false);
-  if(f1 == NULL) return false;
+  while((part = NextCheckItem()) >= 0) {
 
-  uint32_t hStart = part * (HASH_SIZE / MERGE_PART);
-  uint32_t hStop = (part + 1) * (HASH_SIZE / MERGE_PART);
-  p->hStart = 0;
+    FILE* f1 = OpenPart(pName,"rb",part,false);
+    if(f1 == NULL) continue;
 
-  for(uint32_t h = hStart; h < hStop; h++) {
+    uint32_t hStart = part * (HASH_SIZE / MERGE_PART);
+    uint32_t hStop = (part + 1) * (HASH_SIZE / MERGE_PART);
 
-    uint32_t nbItem;
-    uint32_t maxItem;
-    ::fread(&nbItem,sizeof(uint32_t),1,f1);
-    ::fread(&maxItem,sizeof(uint32_t),1,f1);
+    for(uint32_t h = hStart; h < hStop; h++) {
 
-    if(nbItem == 0)
-      continue;
-    p->hStop += CheckHash(h,nbItem,NULL,f1);
-    p->hStart += nbItem;
+      uint32_t nbItem;
+      uint32_t maxItem;
+      ::fread(&nbItem,sizeof(uint32_t),1,f1);
+      ::fread(&maxItem,sizeof(uint32_t),1,f1);
+
+      for(uint32_t i = 0; i < nbItem; i++) {
+        ENTRY e;
+        ::fread(&e.x,32,1,f1);
+        ::fread(&e.d,32,1,f1);
+        ::fread(&e.kType,4,1,f1);
+        batch.push_back(e);
+        if(batch.size() >= CHECK_BATCH)
+          p->nbWrong += CheckBatch(batch);
+      }
+      p->nbChecked += nbItem;
+
+    }
+
+    ::fclose(f1);
 
   }
 
-  ::fclose(f1);
+  if(batch.size() > 0)
+    p->nbWrong += CheckBatch(batch);
+
   return true;
 
 }
 
 bool Kangaroo::CheckWorkFile(TH_PARAM* p) {
 
-  uint32_t nWrong = 0;
+  FILE* f = fopen(p->part1Name,"rb");
+  if(f == NULL) {
+    ::printf("CheckWorkFile: Cannot open %s for reading\n",p->part1Name);
+    return false;
+  }
 
-  for(uint32_t h = p->hStart; h < p->hStop; h++) {
+  vector<uint8_t> buff;
+  vector<ENTRY> batch;
+  batch.reserve(CHECK_BATCH);
+  int r;
+
+  while((r = NextCheckItem()) >= 0) {
+
+    uint64_t start = checkOffsets[r];
+    uint64_t end = checkOffsets[r + 1];
+    buff.resize(end - start);
+    FSeek(f,start);
+    bool ok = ::fread(buff.data(),1,buff.size(),f) == buff.size();
+
+    // v2 file: check region crc first, this localizes corrupted areas
+    if(ok && checkIndexed)
+      ok = HashTable::Crc32(buff.data(),buff.size()) == workIndex.regionCrc[r];
+
+    uint8_t *e = buff.data();
+    uint8_t *eEnd = e + buff.size();
+    for(uint32_t h = 0; h < H_PER_PART && ok; h++) {
+      uint32_t nbItem;
+      if(e + 8 > eEnd) {
+        ok = false;
+        break;
+      }
+      memcpy(&nbItem,e,sizeof(uint32_t));
+      e += 8;
+      if((uint64_t)(eEnd - e) < (uint64_t)nbItem * ENTRY_FILE_SIZE) {
+        ok = false;
+        break;
+      }
+      for(uint32_t i = 0; i < nbItem; i++) {
+        ENTRY en;
+        memcpy(&en.x,e,32);
+        memcpy(&en.d,e + 32,32);
+        memcpy(&en.kType,e + 64,4);
+        e += ENTRY_FILE_SIZE;
+        batch.push_back(en);
+        if(batch.size() >= CHECK_BATCH)
+          p->nbWrong += CheckBatch(batch);
+      }
+      p->nbChecked += nbItem;
+    }
 
-    if(hashTable.E[h].nbItem == 0)
-      continue;
-    nWrong += CheckHash(h,hashTable.E[h].nbItem,&hashTable,NULL);
+    if(!ok) {
+      // Bucket sizes of the region can not be trusted
+      LOCK(ghMutex);
+      ::printf("\nCheckWorkFile: %s in region %d [buckets %d..%d] [offset %.0f]",
+               checkIndexed ? "Checksum error" : "Read error",r,r * H_PER_PART,(r + 1) * H_PER_PART - 1,(double)start);
+      checkBad++;
+      UNLOCK(ghMutex);
+    }
 
   }
 
-  p->hStop = nWrong;
+  if(batch.size() > 0)
+    p->nbWrong += CheckBatch(batch);
 
+  fclose(f);
   return true;
 
 }
@@ -226,9 +362,8 @@ void Kangaroo::CheckPartition(int nbCore,std::string& partName) {
   InitRange();
   InitSearchKey();
 
-  int l2 = (int)log2(nbCore);
-  int nbThread = (int)pow(2.0,l2);
-  if(nbThread > MERGE_PART) nbThread = MERGE_PART;
+  int nbThread = (nbCore < MERGE_PART) ? nbCore : MERGE_PART;
+  if(nbThread < 1) nbThread = 1;
 
   ::printf("Thread: %d\n",nbThread);
   ::printf("CheckingPart");
@@ -238,29 +373,22 @@ void Kangaroo::CheckPartition(int nbCore,std::string& partName) {
   memset(params,0,nbThread * sizeof(TH_PARAM));
   uint64_t nbDP = 0;
   uint64_t nbWrong = 0;
+  checkNext = 0;
 
-  for(int p = 0; p < MERGE_PART; p += nbThread) {
-
-    printf(".");
-
-    for(int i = 0; i < nbThread; i++) {
-      params[i].threadId = i;
-      params[i].isRunning = true;
-      params[i].hStart = p + i;
-      params[i].hStop = 0;
-      params[i].part1Name = _strdup(partName.c_str());
-      thHandles[i] = LaunchThread(_checkPartThread,params + i);
-    }
-
-    JoinThreads(thHandles,nbThread);
-    FreeHandles(thHandles,nbThread);
+  for(int i = 0; i < nbThread; i++) {
+    params[i].threadId = i;
+    params[i].isRunning = true;
+    params[i].part1Name = _strdup(partName.c_str());
+    thHandles[i] = LaunchThread(_checkPartThread,params + i);
+  }
 
-    for(int i = 0; i < nbThread; i++) {
-      free(params[i].part1Name);
-      nbDP += params[i].hStart;
-      nbWrong += params[i].hStop;
-    }
+  JoinThreads(thHandles,nbThread);
+  FreeHandles(thHandles,nbThread);
 
+  for(int i = 0; i < nbThread; i++) {
+    free(params[i].part1Name);
+    nbDP += params[i].nbChecked;
+    nbWrong += params[i].nbWrong;
   }
 
   free(params);
@@ -341,50 +469,46 @@ void Kangaroo::CheckWorkFile(int nbCore,std::string& fileName) {
   InitRange();
   InitSearchKey();
 
-  int l2 = (int)log2(nbCore);
-  int nbThread = (int)pow(2.0,l2);
+  int nbThread = (nbCore < MERGE_PART) ? nbCore : MERGE_PART;
+  if(nbThread < 1) nbThread = 1;
   uint64_t nbDP = 0;
   uint64_t nbWrong = 0;
 
+  // Region boundaries, from the v2 index or by skipping through buckets
+  if(!GetRegionOffsets(f1,v1,checkOffsets,&checkIndexed)) {
+    ::fclose(f1);
+    return;
+  }
+
   ::printf("Thread: %d\n",nbThread);
   ::printf("Checking");
 
   TH_PARAM* params = (TH_PARAM*)malloc(nbThread * sizeof(TH_PARAM));
   THREAD_HANDLE* thHandles = (THREAD_HANDLE*)malloc(nbThread * sizeof(THREAD_HANDLE));
   memset(params,0,nbThread * sizeof(TH_PARAM));
+  checkNext = 0;
+  checkBad = 0;
+
+  for(int i = 0; i < nbThread; i++) {
+    params[i].threadId = i;
+    params[i].isRunning = true;
+    params[i].part1Name = _strdup(fileName.c_str());
+    thHandles[i] = LaunchThread(_checkWorkThread,params + i);
+  }
+  JoinThreads(thHandles,nbThread);
+  FreeHandles(thHandles,nbThread);
 
-  int block = HASH_SIZE / 64;
-
-  for(int s = 0; s < HASH_SIZE; s += block) {
-
-    ::printf(".");
-
-    uint32_t S = s;
-    uint32_t E = s + block;
-
-    // Load hashtables
-    hashTable.LoadTable(f1,S,E);
-
-    int stride = block / nbThread;
-
-    for(int i = 0; i < nbThread; i++) {
-      params[i].threadId = i;
-      params[i].isRunning = true;
-      params[i].hStart = S + i * stride;
-      params[i].hStop = S + (i + 1) * stride;
-      thHandles[i] = LaunchThread(_checkWorkThread,params + i);
-    }
-    JoinThreads(thHandles,nbThread);
-    FreeHandles(thHandles,nbThread);
-
-    for(int i = 0; i < nbThread; i++)
-      nbWrong += params[i].hStop;
-    nbDP += hashTable.GetNbItem();
-
-    hashTable.Reset();
-
+  for(int i = 0; i < nbThread; i++) {
+    free(params[i].part1Name);
+    nbDP += params[i].nbChecked;
+    nbWrong += params[i].nbWrong;
   }
 
+  if(checkIndexed)
+    ::printf("[Regions %d/%d OK]",MERGE_PART - checkBad,MERGE_PART);
+  else if(checkBad > 0)
+    ::printf("\n");
+
   ::fclose(f1);
   free(params);
   free(thHandles);
@@ -24,6 +24,9 @@
 // Use symmetry
 //#define USE_SYMMETRY
 
+// CPU walk profiler, also enabled by make profile=1
+//#define WALK_PROFILE
+
 // Number of random jumps
 // Max 512 for the GPU
 #define NB_JUMP 32
@@ -41,10 +44,33 @@
 // SendDP Period in sec
 #define SEND_PERIOD 2.0
 
+// DP packets sent by a client before it waits for their ack
+#define ACK_WINDOW 4
+
+// Ack polling period in ms of a client with an empty DP queue
+#define ACK_POLL 10
+
 // Timeout before closing connection idle client in sec
 #define CLIENT_TIMEOUT 3600.0
 
+// Client anomaly checks (server): period in sec, time without DP before a
+// client is stalled, and walk rate (jumps/s) of a declared kangaroo above
+// which a client DP rate is not possible
+#define ANOMALY_PERIOD 60.0
+#define ANOMALY_STALL 300.0
+#define ANOMALY_MAX_JUMP 1048576.0
+
+// Sampled DP validation (server): a DP source is quarantined when more than
+// QUARANTINE_WRONG of its sampled DPs are wrong, once QUARANTINE_MIN are
+// sampled, and released after QUARANTINE_TIME sec (0 = until restart)
+#define QUARANTINE_WRONG 0.01
+#define QUARANTINE_MIN 100
+#define QUARANTINE_TIME 3600.0
+
 // Number of merge partition
 #define MERGE_PART 256
 
+// Input bytes buffered per round of a multi-file merge
+#define MERGE_BUFFER (512ULL * 1024ULL * 1024ULL)
+
 #endif //CONSTANTSH
@@ -560,6 +560,43 @@ void GPUEngine::SetKangaroo(uint64_t kIdx,Int *px,Int *py,Int *d) {
 
 }
 
+void GPUEngine::GetKangaroo(uint64_t kIdx,Int *px,Int *py,Int *d) {
+
+  int gSize = KSIZE * GPU_GRP_SIZE;
+  int strideSize = nbThreadPerGroup * KSIZE;
+  int blockSize = nbThreadPerGroup * gSize;
+
+  uint64_t t = kIdx % nbThreadPerGroup;
+  uint64_t g = (kIdx / nbThreadPerGroup) % GPU_GRP_SIZE;
+  uint64_t b = kIdx / (nbThreadPerGroup*GPU_GRP_SIZE);
+  uint64_t *k = inputKangaroo + (b * blockSize + g * strideSize + t);
+
+  // X,Y and D (192-bit distance), one word per copy
+  for(int i = 0; i < 11; i++)
+    cudaMemcpy(inputKangarooPinned + i,k + i * nbThreadPerGroup,8,cudaMemcpyDeviceToHost);
+
+  px->SetInt32(0);
+  py->SetInt32(0);
+  for(int i = 0; i < 4; i++) {
+    px->bits64[i] = inputKangarooPinned[i];
+    py->bits64[i] = inputKangarooPinned[4 + i];
+  }
+
+  Int dOff;
+  dOff.SetInt32(0);
+  dOff.bits64[0] = inputKangarooPinned[8];
+  dOff.bits64[1] = inputKangarooPinned[9];
+  dOff.bits64[2] = inputKangarooPinned[10];
+  if(kIdx % 2 == WILD) dOff.ModSubK1order(&wildOffset);
+  d->Set(&dOff);
+
+  cudaError_t err = cudaGetLastError();
+  if(err != cudaSuccess) {
+    printf("GPUEngine: GetKangaroo: %s\n",cudaGetErrorString(err));
+  }
+
+}
+
 bool GPUEngine::callKernel() {
 
   // Reset nbFound
@@ -16,10 +16,17 @@
 */
 
 #include "HashTable.h"
+#include "Log.h"
 #include <stdio.h>
 #include <math.h>
+#include <errno.h>
 #ifndef WIN64
 #include <string.h>
+#include <algorithm>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
 #endif
 
 #define GET(hash,id) E[hash].items[id]
@@ -27,33 +34,227 @@
 HashTable::HashTable() {
 
   memset(E,0,sizeof(E));
+  totalItem = 0;
+  totalAlloc = 0;
+  mapBase = NULL;
+  mapSize = 0;
+  mapIndex = NULL;
   
 }
 
 void HashTable::Reset() {
+  Reset(0,HASH_SIZE);
+  UnmapTable();
+}
 
-  for(uint32_t h = 0; h < HASH_SIZE; h++) {
+void HashTable::Reset(uint32_t from,uint32_t to) {
+
+  for(uint32_t h = from; h < to; h++) {
     if(E[h].items) {
       for(uint32_t i = 0; i<E[h].nbItem; i++)
-        free(E[h].items[i]);
+        if(!IsMapped(E[h].items[i]))
+          free(E[h].items[i]);
     }
     safe_free(E[h].items);
-    E[h].maxItem = 0;
-    E[h].nbItem = 0;
+    SetNbItem(h,0,0);
   }
 
 }
 
-uint64_t HashTable::GetNbItem() {
+// Bucket size written from outside Add()/Remove()
+void HashTable::SetNbItem(uint32_t h,uint32_t nbItem,uint32_t maxItem) {
+
+  totalItem += (uint64_t)nbItem - E[h].nbItem;
+  totalAlloc += (uint64_t)maxItem - E[h].maxItem;
+  E[h].nbItem = nbItem;
+  E[h].maxItem = maxItem;
+
+}
+
+// ----------------------------------------------------------------------------
+// Mapped work file
+
+bool HashTable::IsMapped(ENTRY *e) {
+  return mapBase && (uint8_t *)e >= mapBase && (uint8_t *)e < mapBase + mapSize;
+}
+
+bool HashTable::IsMappedFile(std::string &fileName) {
+  return mapBase && mapName == fileName;
+}
+
+ENTRY *HashTable::GetItem(uint32_t h,uint32_t i) {
+  if(E[h].items)
+    return E[h].items[i];
+  return (ENTRY *)(mapBase + mapIndex[h].offset) + i;
+}
+
+void HashTable::Remove(uint32_t h,uint32_t i) {
+
+  Materialize(h);
+  if(!IsMapped(E[h].items[i]))
+    free(E[h].items[i]);
+  for(uint32_t j = i + 1; j < E[h].nbItem; j++)
+    E[h].items[j - 1] = E[h].items[j];
+  E[h].nbItem--;
+  totalItem--;
+
+}
+
+void HashTable::Materialize(uint64_t h) {
+
+  // Build the index of a bucket still located in the mapped file
+  if(E[h].items || E[h].nbItem == 0)
+    return;
 
-  uint64_t totalItem = 0;
-  for(uint64_t h = 0; h < HASH_SIZE; h++) 
-    totalItem += (uint64_t)E[h].nbItem;
+  ENTRY *base = (ENTRY *)(mapBase + mapIndex[h].offset);
+  E[h].items = (ENTRY **)malloc(sizeof(ENTRY *) * E[h].maxItem);
+  for(uint32_t i = 0; i < E[h].nbItem; i++)
+    E[h].items[i] = base + i;
+
+}
+
+uint64_t HashTable::MapTable(std::string &fileName,uint64_t indexPos,bool prefault) {
+
+  // Map the whole file read only, return the end of the table (0 on failure)
+  Reset();
+
+#ifdef WIN64
+
+  mapFile = CreateFileA(fileName.c_str(),GENERIC_READ,FILE_SHARE_READ,NULL,OPEN_EXISTING,FILE_ATTRIBUTE_NORMAL,NULL);
+  if(mapFile == INVALID_HANDLE_VALUE) {
+    ::printf("MapTable: Cannot open %s (error %d)\n",fileName.c_str(),GetLastError());
+    return 0;
+  }
+  LARGE_INTEGER size;
+  GetFileSizeEx(mapFile,&size);
+  mapSize = (uint64_t)size.QuadPart;
+  mapHandle = CreateFileMapping(mapFile,NULL,PAGE_READONLY,0,0,NULL);
+  if(mapHandle)
+    mapBase = (uint8_t *)MapViewOfFile(mapHandle,FILE_MAP_READ,0,0,0);
+  if(mapBase == NULL) {
+    ::printf("MapTable: Cannot map %s (error %d)\n",fileName.c_str(),GetLastError());
+    if(mapHandle) CloseHandle(mapHandle);
+    CloseHandle(mapFile);
+    mapSize = 0;
+    return 0;
+  }
+  if(prefault) {
+    WIN32_MEMORY_RANGE_ENTRY range;
+    range.VirtualAddress = mapBase;
+    range.NumberOfBytes = (SIZE_T)mapSize;
+    PrefetchVirtualMemory(GetCurrentProcess(),1,&range,0);
+  }
+
+#else
+
+  int fd = open(fileName.c_str(),O_RDONLY);
+  if(fd < 0) {
+    ::printf("MapTable: Cannot open %s: %s\n",fileName.c_str(),strerror(errno));
+    return 0;
+  }
+  struct stat st;
+  fstat(fd,&st);
+  mapSize = (uint64_t)st.st_size;
+  void *addr = mmap(NULL,mapSize,PROT_READ,MAP_PRIVATE,fd,0);
+  close(fd);
+  if(addr == MAP_FAILED) {
+    ::printf("MapTable: Cannot map %s: %s\n",fileName.c_str(),strerror(errno));
+    mapSize = 0;
+    return 0;
+  }
+  mapBase = (uint8_t *)addr;
+  // Let the kernel read ahead the whole file in background or fault pages on demand
+  madvise(mapBase,mapSize,prefault ? MADV_WILLNEED : MADV_RANDOM);
+
+#endif
+
+  uint64_t dataPos = MAP_ALIGN(indexPos + HASH_SIZE * sizeof(MAP_INDEX));
+  if(dataPos > mapSize) {
+    ::printf("MapTable: %s is truncated\n",fileName.c_str());
+    UnmapTable();
+    return 0;
+  }
+
+  mapIndex = (MAP_INDEX *)(mapBase + indexPos);
+  mapName = fileName;
+  uint64_t endPos = dataPos;
+
+  for(uint32_t h = 0; h < HASH_SIZE; h++) {
+    uint64_t end = mapIndex[h].offset + (uint64_t)mapIndex[h].nbItem * sizeof(ENTRY);
+    if(mapIndex[h].nbItem > 0 && (mapIndex[h].offset < dataPos || end > mapSize)) {
+      ::printf("MapTable: %s wrong index at bucket %d\n",fileName.c_str(),h);
+      Reset(0,h);
+      UnmapTable();
+      return 0;
+    }
+    SetNbItem(h,mapIndex[h].nbItem,mapIndex[h].nbItem);
+    E[h].items = NULL;
+    if(end > endPos) endPos = end;
+  }
+
+  return endPos;
+
+}
+
+void HashTable::UnmapTable() {
+
+  if(mapBase == NULL)
+    return;
+
+#ifdef WIN64
+  UnmapViewOfFile(mapBase);
+  CloseHandle(mapHandle);
+  CloseHandle(mapFile);
+#else
+  munmap(mapBase,mapSize);
+#endif
+
+  mapBase = NULL;
+  mapSize = 0;
+  mapIndex = NULL;
+  mapName = "";
+
+}
+
+// Copy the entries still located in the mapped file to memory and unmap it
+void HashTable::DetachTable() {
+
+  if(mapBase == NULL)
+    return;
+
+  for(uint32_t h = 0; h < HASH_SIZE; h++) {
+    Materialize(h);
+    for(uint32_t i = 0; i < E[h].nbItem; i++) {
+      if(IsMapped(E[h].items[i])) {
+        ENTRY *e = (ENTRY *)malloc(sizeof(ENTRY));
+        memcpy(e,E[h].items[i],sizeof(ENTRY));
+        E[h].items[i] = e;
+      }
+    }
+  }
+
+  UnmapTable();
+
+}
+
+uint64_t HashTable::GetNbItem() {
 
   return totalItem;
 
 }
 
+uint64_t HashTable::GetUsedByte() {
+
+  return HASH_SIZE * 2 * sizeof(uint32_t) + sizeof(ENTRY) * totalItem;
+
+}
+
+uint64_t HashTable::GetTotalByte() {
+
+  return sizeof(E) + sizeof(ENTRY *) * totalAlloc + sizeof(ENTRY) * totalItem;
+
+}
+
 ENTRY *HashTable::CreateEntry(int256_t *x,int256_t *d, uint32_t kType) {
 
   ENTRY *e = (ENTRY *)malloc(sizeof(ENTRY));
@@ -76,7 +277,8 @@ ENTRY *HashTable::CreateEntry(int256_t *x,int256_t *d, uint32_t kType) {
   for (int i = E[h].nbItem; i > st; i--)   \
     E[h].items[i] = E[h].items[i - 1];     \
   E[h].items[st] = entry;                  \
-  E[h].nbItem++;}
+  E[h].nbItem++;                           \
+  totalItem++;}
 
 void HashTable::toint256t(Int *a, int256_t *b)
 {
@@ -100,122 +302,145 @@ void HashTable::Convert(Int *x,Int *d,int256_t *X,int256_t *D) {
   toint256t(d,D);
 }
 
+// CRC-32 (IEEE 802.3), used to protect work file blocks
+struct CRC32Table {
+  uint32_t t[256];
+  CRC32Table() {
+    for(uint32_t i = 0; i < 256; i++) {
+      uint32_t c = i;
+      for(int k = 0; k < 8; k++)
+        c = (c & 1) ? (0xEDB88320 ^ (c >> 1)) : (c >> 1);
+      t[i] = c;
+    }
+  }
+};
 
-#define AV1() if(pnb1) { ::fread(&e1,32,1,f1); pnb1--; }
-#define AV2() if(pnb2) { ::fread(&e2,32,1,f2); pnb2--; }
+uint32_t HashTable::Crc32(const void *buf,size_t size,uint32_t crc) {
 
-int HashTable::MergeH(uint32_t h,FILE* f1,FILE* f2,FILE* fd,uint32_t* nbDP,uint32_t *duplicate,Int* d1,uint32_t* k1,Int* d2,uint32_t* k2) {
+  static const CRC32Table table;
+  const uint8_t *p = (const uint8_t *)buf;
+  crc = ~crc;
+  for(size_t i = 0; i < size; i++)
+    crc = table.t[(crc ^ p[i]) & 0xFF] ^ (crc >> 8);
+  return ~crc;
 
-  // Merge by line
-  // N comparison but avoid slow item allocation
-  // return ADD_OK or ADD_COLLISION if a COLLISION is detected
+}
+
+
+int HashTable::MergeH(uint32_t h,FILE* f1,FILE* f2,FILE* fd,uint32_t* nbDP,uint32_t *duplicate,Int* d1,uint32_t* k1,Int* d2,uint32_t* k2) {
 
+  // Read both buckets and merge them in memory
   uint32_t nb1;
   uint32_t m1;
   uint32_t nb2;
   uint32_t m2;
-  *duplicate = 0;
-  *nbDP = 0;
 
   ::fread(&nb1,sizeof(uint32_t),1,f1);
   ::fread(&m1,sizeof(uint32_t),1,f1);
   ::fread(&nb2,sizeof(uint32_t),1,f2);
   ::fread(&m2,sizeof(uint32_t),1,f2);
 
-  // Maximum in destination
-  uint32_t nbd = 0;
-  uint32_t md = nb1 + nb2;
+  uint64_t size1 = 2 * sizeof(uint32_t) + (uint64_t)ENTRY_FILE_SIZE * nb1;
+  uint64_t size2 = 2 * sizeof(uint32_t) + (uint64_t)ENTRY_FILE_SIZE * nb2;
+  uint8_t *buff = (uint8_t *)malloc(2 * (size1 + size2));
+  uint8_t *b1 = buff;
+  uint8_t *b2 = buff + size1;
+  uint8_t *bd = buff + size1 + size2;
 
-  if(md==0) {
+  memcpy(b1,&nb1,sizeof(uint32_t));
+  memcpy(b2,&nb2,sizeof(uint32_t));
+  ::fread(b1 + 2 * sizeof(uint32_t),ENTRY_FILE_SIZE,nb1,f1);
+  ::fread(b2 + 2 * sizeof(uint32_t),ENTRY_FILE_SIZE,nb2,f2);
 
-    ::fwrite(&md,sizeof(uint32_t),1,fd);
-    ::fwrite(&md,sizeof(uint32_t),1,fd);
-    return ADD_OK;
+  uint8_t *in[2] = { b1,b2 };
+  uint8_t *out = bd;
+  int status = MergeH(h,2,in,&bd,nbDP,duplicate,d1,k1,d2,k2);
+  ::fwrite(out,1,bd - out,fd);
+  free(buff);
 
-  }
+  return status;
+
+}
 
-  ENTRY *output = (ENTRY *)malloc( md * sizeof(ENTRY) );
+bool HashTable::CursorGreater(MERGE_CURSOR *a,MERGE_CURSOR *b) {
+  return compare(&a->x,&b->x) > 0;
+}
 
-  ENTRY e1;
-  ENTRY e2;
+int HashTable::MergeH(uint32_t h,int nbIn,uint8_t** in,uint8_t** bd,uint32_t* nbDP,uint32_t *duplicate,Int* d1,uint32_t* k1,Int* d2,uint32_t* k2) {
 
-  uint32_t pnb1 = nb1;
-  uint32_t pnb2 = nb2;
-  AV1();
-  AV2();
-  bool end1 = (nb1 == 0);
-  bool end2 = (nb2 == 0);
-  bool collisionFound = false;
+  // K-way merge of bucket h from nbIn serialized buffers (see SerializeTable())
+  // using a binary heap of the current entry of each input. Input pointers
+  // are advanced past the bucket.
+  // return ADD_OK or ADD_COLLISION if a COLLISION is detected
 
-  while(!(end1 && end2)) {
-
-    if( !end1 && !end2 ) {
-
-      int comp = compare(&e1.x,&e2.x);
-      if(comp < 0) {
-        memcpy(output+nbd,&e1,32);
-        nbd++;
-        AV1();
-        nb1--;
-      } else if (comp==0) {
-        if((e1.d.i64[0] == e2.d.i64[0]) && (e1.d.i64[1] == e2.d.i64[1]) && (e1.d.i64[2] == e2.d.i64[2]) && (e1.d.i64[3] == e2.d.i64[3])) {
-          *duplicate = *duplicate + 1;
-        } else {
-          // Collision
-	  *k1 = e1.kType;
-	  *k2 = e2.kType;
-          CalcDist(&(e1.d),d1);
-          CalcDist(&(e2.d),d2);
-          collisionFound = true;
-        }
-        memcpy(output + nbd,&e1,32);
-        nbd++;
-        AV1();
-        AV2();
-        nb1--;
-        nb2--;
-      } else {
-        memcpy(output + nbd,&e2,32);
-        nbd++;
-        AV2();
-        nb2--;
-      }
+  std::vector<MERGE_CURSOR> cur(nbIn);
+  std::vector<MERGE_CURSOR *> heap;
+  heap.reserve(nbIn);
+  *duplicate = 0;
+
+  for(int i = 0; i < nbIn; i++) {
+    uint32_t nb;
+    memcpy(&nb,in[i],sizeof(uint32_t));
+    MERGE_CURSOR *c = &cur[i];
+    c->e = in[i] + 2 * sizeof(uint32_t);
+    c->end = c->e + (uint64_t)ENTRY_FILE_SIZE * nb;
+    in[i] = c->end;
+    if(nb > 0) {
+      memcpy(&c->x,c->e,32);
+      heap.push_back(c);
+    }
+  }
 
-    } else if( !end1 && end2 ) {
+  // Min heap on x
+  std::make_heap(heap.begin(),heap.end(),CursorGreater);
 
-      memcpy(output + nbd,&e1,32);
-      nbd++;
-      AV1();
-      nb1--;
+  uint8_t *hd = *bd;
+  uint8_t *ed = hd + 2 * sizeof(uint32_t);
+  uint8_t *last = NULL;
+  int256_t lastX;
+  bool collisionFound = false;
 
-    } else if( end1 && !end2) {
+  while(!heap.empty()) {
 
-      memcpy(output + nbd,&e2,32);
-      nbd++;
-      AV2();
-      nb2--;
+    std::pop_heap(heap.begin(),heap.end(),CursorGreater);
+    MERGE_CURSOR *c = heap.back();
 
+    if(last && compare(&c->x,&lastX) == 0) {
+      if(memcmp(c->e + 32,last + 32,32) == 0) {
+        *duplicate = *duplicate + 1;
+      } else {
+        // Collision
+        int256_t d;
+        memcpy(k1,last + 64,4);
+        memcpy(k2,c->e + 64,4);
+        memcpy(&d,last + 32,32); CalcDist(&d,d1);
+        memcpy(&d,c->e + 32,32); CalcDist(&d,d2);
+        collisionFound = true;
+      }
+    } else {
+      memcpy(ed,c->e,ENTRY_FILE_SIZE);
+      last = ed;
+      lastX = c->x;
+      ed += ENTRY_FILE_SIZE;
     }
 
-    end1 = (nb1 == 0);
-    end2 = (nb2 == 0);
+    c->e += ENTRY_FILE_SIZE;
+    if(c->e < c->end) {
+      memcpy(&c->x,c->e,32);
+      std::push_heap(heap.begin(),heap.end(),CursorGreater);
+    } else {
+      heap.pop_back();
+    }
 
   }
 
-  // write output
-
   // Round md to next multiple of 4
-  if(nbd%4==0) {
-    md = nbd;
-  } else {
-    md = ((nbd/4)+1)*4;
-  }
-
-  ::fwrite(&nbd,sizeof(uint32_t),1,fd);
-  ::fwrite(&md,sizeof(uint32_t),1,fd);
-  ::fwrite(output,32,nbd,fd);
-  free(output);
+  uint32_t nbd = (uint32_t)((ed - hd - 2 * sizeof(uint32_t)) / ENTRY_FILE_SIZE);
+  uint32_t md = ((nbd + 3) / 4) * 4;
+  memcpy(hd,&nbd,sizeof(uint32_t));
+  memcpy(hd + sizeof(uint32_t),&md,sizeof(uint32_t));
 
+  *bd = ed;
   *nbDP = nbd;
   return (collisionFound?ADD_COLLISION:ADD_OK);
 
@@ -235,6 +460,7 @@ int HashTable::Add(Int *x,Int *d,uint32_t type) {
 void HashTable::ReAllocate(uint64_t h,uint32_t add) {
 
   E[h].maxItem += add;
+  totalAlloc += add;
   ENTRY** nitems = (ENTRY**)malloc(sizeof(ENTRY*) * E[h].maxItem);
   memcpy(nitems,E[h].items,sizeof(ENTRY*) * E[h].nbItem);
   free(E[h].items);
@@ -245,31 +471,15 @@ void HashTable::ReAllocate(uint64_t h,uint32_t add) {
 int HashTable::Add(int256_t *x,int256_t *d, uint32_t type) {
   uint64_t h = (x->i64[0] ^ x->i64[1] ^ x->i64[2] ^ x->i64[3]) % HASH_SIZE;
 
-  static uint64_t addCallCount = 0;
-  addCallCount++;
-
-  if(addCallCount <= 20 || addCallCount % 50 == 0) {
-    ::printf("\n[HashTable::Add #%llu] type=%u (%s), hash=%llu, x=%016llX%016llX...",
-             (unsigned long long)addCallCount,
-             type, type == 0 ? "TAME" : "WILD",
-             (unsigned long long)h,
-             (unsigned long long)x->i64[3],
-             (unsigned long long)x->i64[2]);
-    ::printf("\n[HashTable::Add #%llu] Bucket has %u items currently",
-             (unsigned long long)addCallCount,
-             E[h].nbItem);
-  }
+  LOG_RATE(LOGC_TABLE,LOG_TRACE,20,"Add type=%u (%s), hash=%llu, x=%016llX%016llX..., bucket has %u items",
+           type, type == 0 ? "TAME" : "WILD",
+           (unsigned long long)h,
+           (unsigned long long)x->i64[3],
+           (unsigned long long)x->i64[2],
+           E[h].nbItem);
 
   ENTRY *e = CreateEntry(x,d,type);
-  int result = Add(h,e);
-
-  if(addCallCount <= 20 || addCallCount % 50 == 0) {
-    ::printf("\n[HashTable::Add #%llu] Result: %s",
-             (unsigned long long)addCallCount,
-             result == ADD_OK ? "ADD_OK" : (result == ADD_DUPLICATE ? "ADD_DUPLICATE" : "ADD_COLLISION"));
-  }
-
-  return result;
+  return Add(h,e);
 
 }
 
@@ -279,21 +489,19 @@ void HashTable::CalcDist(int256_t *d,Int* kDist) {
 }
 
 int HashTable::Add(uint64_t h,ENTRY* e) {
-  static uint64_t lowLevelAddCount = 0;
-  lowLevelAddCount++;
+
+  Materialize(h);
 
   if(E[h].maxItem == 0) {
     E[h].maxItem = 16;
+    totalAlloc += 16;
     E[h].items = (ENTRY **)malloc(sizeof(ENTRY *) * E[h].maxItem);
   }
 
   if(E[h].nbItem == 0) {
-    if(lowLevelAddCount <= 20) {
-      ::printf("\n[HashTable::Add(h=%llu)] First item in bucket, adding without check",
-               (unsigned long long)h);
-    }
     E[h].items[0] = e;
     E[h].nbItem = 1;
+    totalItem++;
     return ADD_OK;
   }
 
@@ -305,43 +513,20 @@ int HashTable::Add(uint64_t h,ENTRY* e) {
   // Search insertion position
   int st,ed,mi;
   st = 0; ed = E[h].nbItem - 1;
-
-  if(lowLevelAddCount <= 20) {
-    ::printf("\n[HashTable::Add(h=%llu)] Searching through %d items in bucket",
-             (unsigned long long)h, E[h].nbItem);
-  }
-
   while(st <= ed) {
     mi = (st + ed) / 2;
     int comp = compare(&e->x,&GET(h,mi)->x);
-
-    if(lowLevelAddCount <= 20) {
-      ::printf("\n[HashTable::Add(h=%llu)] Compare with item %d: comp=%d",
-               (unsigned long long)h, mi, comp);
-    }
-
-    // ALWAYS log when comp==0 (potential collision)
-    if(comp == 0) {
-      ::printf("\n[HashTable ALERT] Binary search found comp==0 at bucket %llu, item %d",
-               (unsigned long long)h, mi);
-      ::printf("\n[HashTable ALERT] This should trigger collision detection!");
-      ::fflush(stdout);
-    }
-
     if(comp<0) {
       ed = mi - 1;
     } else if (comp==0) {
       ENTRY *ent = GET(h,mi);
 
-      ::printf("\n[HashTable] *** MATCH FOUND *** Same X coordinate!");
-      ::printf("\n[HashTable]   Existing entry: type=%u (%s), x=%016llX%016llX...",
-               ent->kType, ent->kType == 0 ? "TAME" : "WILD",
-               (unsigned long long)ent->x.i64[3],
-               (unsigned long long)ent->x.i64[2]);
-      ::printf("\n[HashTable]   New entry:      type=%u (%s), x=%016llX%016llX...",
-               e->kType, e->kType == 0 ? "TAME" : "WILD",
-               (unsigned long long)e->x.i64[3],
-               (unsigned long long)e->x.i64[2]);
+      LOG(LOGC_TABLE,LOG_DEBUG,"Same x at bucket %llu item %d: x=%016llX%016llX..., existing %s d=%016llX%016llX%016llX%016llX",
+          (unsigned long long)h, mi,
+          (unsigned long long)e->x.i64[3], (unsigned long long)e->x.i64[2],
+          ent->kType == 0 ? "TAME" : "WILD",
+          (unsigned long long)ent->d.i64[3], (unsigned long long)ent->d.i64[2],
+          (unsigned long long)ent->d.i64[1], (unsigned long long)ent->d.i64[0]);
 
       uint64_t d10 = e->d.i64[0];
       uint64_t d11 = e->d.i64[1];
@@ -352,24 +537,17 @@ int HashTable::Add(uint64_t h,ENTRY* e) {
       uint64_t d22 = ent->d.i64[2];
       uint64_t d23 = ent->d.i64[3];
 
-      ::printf("\n[HashTable]   Existing dist:  %016llX%016llX%016llX%016llX",
-               (unsigned long long)d23, (unsigned long long)d22,
-               (unsigned long long)d21, (unsigned long long)d20);
-      ::printf("\n[HashTable]   New dist:       %016llX%016llX%016llX%016llX",
-               (unsigned long long)d13, (unsigned long long)d12,
-               (unsigned long long)d11, (unsigned long long)d10);
-
       if (d10 == d20 && d11 == d21 && d12 == d22 && d13 == d23) {
 	// Same point added twice or collision in the same herd!
-	::printf("\n[HashTable] -> Same distance = DUPLICATE (same herd collision)\n");
+	LOG(LOGC_TABLE,LOG_DEBUG,"Same distance, duplicate");
 	return ADD_DUPLICATE;
       }
 
       // Collision detected between different herds
-      ::printf("\n[HashTable] -> Different distance = COLLISION (cross-herd)!");
-      ::printf("\n[HashTable] -> Types: Existing=%u (%s), New=%u (%s)\n",
-               ent->kType, ent->kType == 0 ? "TAME" : "WILD",
-               e->kType, e->kType == 0 ? "TAME" : "WILD");
+      LOG(LOGC_TABLE,LOG_DEBUG,"Collision, new %s d=%016llX%016llX%016llX%016llX",
+          e->kType == 0 ? "TAME" : "WILD",
+          (unsigned long long)d13, (unsigned long long)d12,
+          (unsigned long long)d11, (unsigned long long)d10);
 
       kType = ent->kType;
       CalcDist(&(ent->d), &kDist);
@@ -380,11 +558,6 @@ int HashTable::Add(uint64_t h,ENTRY* e) {
     }
   }
 
-  if(lowLevelAddCount <= 20) {
-    ::printf("\n[HashTable::Add(h=%llu)] No match found, inserting at position",
-             (unsigned long long)h);
-  }
-
   ADD_ENTRY(e);
   return ADD_OK;
 
@@ -418,14 +591,8 @@ int HashTable::compare(int256_t *i1,int256_t *i2) {
 std::string HashTable::GetSizeInfo() {
 
   char *unit;
-  uint64_t totalByte = sizeof(E);
-  uint64_t usedByte = HASH_SIZE*2*sizeof(uint32_t);
-
-  for (int h = 0; h < HASH_SIZE; h++) {
-    totalByte += sizeof(ENTRY *) * E[h].maxItem;
-    totalByte += sizeof(ENTRY) * E[h].nbItem;
-    usedByte += sizeof(ENTRY) * E[h].nbItem;
-  }
+  uint64_t totalByte = GetTotalByte();
+  uint64_t usedByte = GetUsedByte();
 
   unit = "MB";
   double totalMB = (double)totalByte / (1024.0*1024.0);
@@ -466,16 +633,17 @@ void HashTable::SaveTable(FILE* f) {
 
 void HashTable::SaveTable(FILE* f,uint32_t from,uint32_t to,bool printPoint) {
 
-  uint64_t point = GetNbItem() / 16;
+  uint64_t point = printPoint ? GetNbItem() / 16 : 0;
   uint64_t pointPrint = 0;
 
   for(uint32_t h = from; h < to; h++) {
     fwrite(&E[h].nbItem,sizeof(uint32_t),1,f);
     fwrite(&E[h].maxItem,sizeof(uint32_t),1,f);
     for(uint32_t i = 0; i < E[h].nbItem; i++) {
-      fwrite(&(E[h].items[i]->x),32,1,f);
-      fwrite(&(E[h].items[i]->d),32,1,f);
-      fwrite(&(E[h].items[i]->kType),4,1,f);
+      ENTRY *e = GetItem(h,i);
+      fwrite(&(e->x),32,1,f);
+      fwrite(&(e->d),32,1,f);
+      fwrite(&(e->kType),4,1,f);
       if(printPoint) {
         pointPrint++;
         if(pointPrint > point) {
@@ -515,10 +683,13 @@ void HashTable::SeekNbItem(FILE* f,uint32_t from,uint32_t to) {
 
   for(uint32_t h = from; h < to; h++) {
 
-    fread(&E[h].nbItem,sizeof(uint32_t),1,f);
-    fread(&E[h].maxItem,sizeof(uint32_t),1,f);
+    uint32_t nbItem = 0;
+    uint32_t maxItem = 0;
+    fread(&nbItem,sizeof(uint32_t),1,f);
+    fread(&maxItem,sizeof(uint32_t),1,f);
+    SetNbItem(h,nbItem,maxItem);
 
-    uint64_t hSize = 32ULL * E[h].nbItem;
+    uint64_t hSize = (uint64_t)ENTRY_FILE_SIZE * E[h].nbItem;
 #ifdef WIN64
     _fseeki64(f,hSize,SEEK_CUR);
 #else
@@ -535,8 +706,11 @@ void HashTable::LoadTable(FILE* f,uint32_t from,uint32_t to) {
 
   for(uint32_t h = from; h < to; h++) {
 
-    fread(&E[h].nbItem,sizeof(uint32_t),1,f);
-    fread(&E[h].maxItem,sizeof(uint32_t),1,f);
+    uint32_t nbItem = 0;
+    uint32_t maxItem = 0;
+    fread(&nbItem,sizeof(uint32_t),1,f);
+    fread(&maxItem,sizeof(uint32_t),1,f);
+    SetNbItem(h,nbItem,maxItem);
 
     if(E[h].maxItem > 0)
       // Allocate indexes
@@ -561,6 +735,59 @@ void HashTable::LoadTable(FILE *f) {
 
 }
 
+// Size of buckets [from,to[ in work file format
+uint64_t HashTable::GetTableSize(uint32_t from,uint32_t to) {
+
+  uint64_t size = 0;
+  for(uint32_t h = from; h < to; h++)
+    size += 2 * sizeof(uint32_t) + (uint64_t)ENTRY_FILE_SIZE * E[h].nbItem;
+  return size;
+
+}
+
+// Same as SaveTable() but into a buffer of GetTableSize() bytes
+void HashTable::SerializeTable(uint8_t *buff,uint32_t from,uint32_t to) {
+
+  for(uint32_t h = from; h < to; h++) {
+    memcpy(buff,&E[h].nbItem,sizeof(uint32_t)); buff += sizeof(uint32_t);
+    memcpy(buff,&E[h].maxItem,sizeof(uint32_t)); buff += sizeof(uint32_t);
+    for(uint32_t i = 0; i < E[h].nbItem; i++) {
+      ENTRY *e = GetItem(h,i);
+      memcpy(buff,&(e->x),32); buff += 32;
+      memcpy(buff,&(e->d),32); buff += 32;
+      memcpy(buff,&(e->kType),4); buff += 4;
+    }
+  }
+
+}
+
+// Same as LoadTable() but from a buffer, buckets [from,to[ must be empty
+void HashTable::DeserializeTable(uint8_t *buff,uint32_t from,uint32_t to) {
+
+  for(uint32_t h = from; h < to; h++) {
+
+    uint32_t nbItem;
+    uint32_t maxItem;
+    memcpy(&nbItem,buff,sizeof(uint32_t)); buff += sizeof(uint32_t);
+    memcpy(&maxItem,buff,sizeof(uint32_t)); buff += sizeof(uint32_t);
+    SetNbItem(h,nbItem,maxItem);
+
+    if(E[h].maxItem > 0)
+      // Allocate indexes
+      E[h].items = (ENTRY**)malloc(sizeof(ENTRY*) * E[h].maxItem);
+
+    for(uint32_t i = 0; i < E[h].nbItem; i++) {
+      ENTRY* e = (ENTRY*)malloc(sizeof(ENTRY));
+      memcpy(&(e->x),buff,32); buff += 32;
+      memcpy(&(e->d),buff,32); buff += 32;
+      memcpy(&(e->kType),buff,4); buff += 4;
+      E[h].items[i] = e;
+    }
+
+  }
+
+}
+
 void HashTable::PrintInfo() {
 
   uint16_t max = 0;
@@ -30,6 +30,13 @@
 #define HASH_SIZE (1<<HASH_SIZE_BIT)
 #define HASH_MASK (HASH_SIZE-1)
 
+// Size of an entry in work files (x,d,kType)
+#define ENTRY_FILE_SIZE 68
+
+// Alignment of index and entries in mapped work files
+#define MAP_PAGE 4096
+#define MAP_ALIGN(x) ((((x) + MAP_PAGE - 1) / MAP_PAGE) * MAP_PAGE)
+
 #define ADD_OK        0
 #define ADD_DUPLICATE 1
 #define ADD_COLLISION 2
@@ -61,6 +68,24 @@ typedef struct {
 
 } HASH_ENTRY;
 
+// Bucket index of mapped work files
+typedef struct {
+
+  uint32_t   nbItem;
+  uint32_t   maxItem;
+  uint64_t   offset;  // File offset of the bucket ENTRY array
+
+} MAP_INDEX;
+
+// Current entry of a serialized bucket being merged
+typedef struct {
+
+  int256_t   x;
+  uint8_t   *e;
+  uint8_t   *end;
+
+} MERGE_CURSOR;
+
 class HashTable {
 
 public:
@@ -70,7 +95,10 @@ public:
   int Add(int256_t *x,int256_t *d, uint32_t type);
   int Add(uint64_t h,ENTRY *e);
   uint64_t GetNbItem();
+  uint64_t GetUsedByte();
+  uint64_t GetTotalByte();
   void Reset();
+  void Reset(uint32_t from,uint32_t to);
   std::string GetSizeInfo();
   void PrintInfo();
   void SaveTable(FILE *f);
@@ -78,8 +106,19 @@ public:
   void LoadTable(FILE *f);
   void LoadTable(FILE* f,uint32_t from,uint32_t to);
   void ReAllocate(uint64_t h,uint32_t add);
+  uint64_t GetTableSize(uint32_t from,uint32_t to);
+  void SerializeTable(uint8_t *buff,uint32_t from,uint32_t to);
+  void DeserializeTable(uint8_t *buff,uint32_t from,uint32_t to);
+  uint64_t MapTable(std::string &fileName,uint64_t indexPos,bool prefault);
+  void UnmapTable();
+  void DetachTable();
+  bool IsMapped(ENTRY *e);
+  bool IsMappedFile(std::string &fileName);
+  ENTRY *GetItem(uint32_t h,uint32_t i);
+  void Remove(uint32_t h,uint32_t i);
   void SeekNbItem(FILE* f,bool restorePos = false);
   void SeekNbItem(FILE* f,uint32_t from,uint32_t to);
+  void SetNbItem(uint32_t h,uint32_t nbItem,uint32_t maxItem);
 
   HASH_ENTRY    E[HASH_SIZE];
   // Collision info
@@ -89,14 +128,35 @@ public:
   static void Convert(Int *x,Int *d,int256_t *X,int256_t *D);
   static int MergeH(uint32_t h,FILE* f1,FILE* f2,FILE* fd,uint32_t *nbDP,uint32_t* duplicate,
                     Int* d1,uint32_t* k1,Int* d2,uint32_t* k2);
+  static int MergeH(uint32_t h,int nbIn,uint8_t** in,uint8_t** bd,uint32_t *nbDP,uint32_t* duplicate,
+                    Int* d1,uint32_t* k1,Int* d2,uint32_t* k2);
   static void CalcDist(int256_t *d,Int* kDist);
   static void toint256t(Int *a, int256_t *b);
   static void toInt(int256_t *a, Int *b);
+  static uint32_t Crc32(const void *buf,size_t size,uint32_t crc = 0);
 private:
 
   ENTRY *CreateEntry(int256_t *x,int256_t *d, uint32_t kType);
   static int compare(int256_t *i1,int256_t *i2);
+  static bool CursorGreater(MERGE_CURSOR *a,MERGE_CURSOR *b);
   std::string GetStr(int256_t *i);
+  void Materialize(uint64_t h);
+
+  // Sum of nbItem and maxItem over all buckets, kept up to date by the
+  // methods writing to E[] (status and metrics must not scan the table)
+  uint64_t   totalItem;
+  uint64_t   totalAlloc;
+
+  // Mapped work file, entries of a bucket are used in place until
+  // the bucket is modified
+  uint8_t   *mapBase;
+  uint64_t   mapSize;
+  MAP_INDEX *mapIndex;
+  std::string mapName;
+#ifdef WIN64
+  HANDLE     mapFile;
+  HANDLE     mapHandle;
+#endif
 };
 
 #endif // HASHTABLEH
@@ -19,6 +19,7 @@
 #include <fstream>
 #include "SECPK1/IntGroup.h"
 #include "Timer.h"
+#include "Log.h"
 #include <string.h>
 #define _USE_MATH_DEFINES
 #include <math.h>
@@ -34,7 +35,10 @@ using namespace std;
 // ----------------------------------------------------------------------------
 
 Kangaroo::Kangaroo(Secp256K1 *secp,int32_t initDPSize,bool useGpu,string &workFile,string &iWorkFile,uint32_t savePeriod,bool saveKangaroo,bool saveKangarooByServer,
-                   double maxStep,int wtimeout,int port,int ntimeout,string serverIp,string outputFile,bool splitWorkfile) {
+                   double maxStep,int wtimeout,int port,int ntimeout,string serverIp,string outputFile,bool splitWorkfile,bool useJournal,
+                   bool mapWorkfile,bool prefault,string dropDir,bool compressKangaroo,double sampleRate,
+                   double quarantineWrong,uint64_t quarantineMin,double quarantineTime,
+                   uint64_t kCheckPeriod,string pipeStatFile,int metricsPort,string recFile) {
 
   this->secp = secp;
   this->initDPSize = initDPSize;
@@ -47,7 +51,21 @@ Kangaroo::Kangaroo(Secp256K1 *secp,int32_t initDPSize,bool useGpu,string &workFi
   this->nbLoadedWalk = 0;
   this->clientMode = serverIp.length() > 0;
   this->saveKangarooByServer = this->clientMode && saveKangarooByServer;
-  this->saveKangaroo = saveKangaroo || this->saveKangarooByServer;
+  this->saveKangaroo = saveKangaroo || this->saveKangarooByServer || compressKangaroo;
+  this->compressKangaroo = compressKangaroo && !this->saveKangarooByServer;
+  this->compressedInput = false;
+  this->startKeyIdx = 0;
+  this->sampleRate = sampleRate;
+  this->quarantineWrong = quarantineWrong;
+  this->quarantineMin = quarantineMin;
+  this->quarantineTime = quarantineTime;
+  this->lastClientCheck = 0.0;
+  this->purgeRunning = false;
+  this->purgeBucket = HASH_SIZE;
+  this->purgeNbRemoved = 0;
+  this->purgeInFlight = 0;
+  this->kCheckPeriod = kCheckPeriod;
+  this->jumpSeed = 0x600DCAFE;
   this->fRead = NULL;
   this->maxStep = maxStep;
   this->wtimeout = wtimeout;
@@ -65,6 +83,27 @@ Kangaroo::Kangaroo(Secp256K1 *secp,int32_t initDPSize,bool useGpu,string &workFi
   this->splitWorkfile = splitWorkfile;
   this->pid = Timer::getPID();
   this->networkThreadRunning = false;
+  // Journal only makes sense when a single work file is periodically rewritten
+  this->useJournal = useJournal && workFile.length() > 0 && !splitWorkfile && !this->clientMode;
+  this->journalReady = false;
+  this->journalNbItem = 0;
+  this->baseNbItem = 0;
+  this->mapWorkfile = mapWorkfile;
+  this->prefault = prefault;
+  this->dropDir = dropDir;
+  this->ingestFile = NULL;
+  this->pipeStatFile = pipeStatFile;
+  ::memset(&pipeStat,0,sizeof(PIPE_STAT));
+  this->metricsPort = metricsPort;
+  ::memset(&serverStat,0,sizeof(SERVER_STAT));
+  this->serverBackup = false;
+  this->savePid = 0;
+  this->savePipe = -1;
+  this->saveSerial = false;
+  this->recFile = recFile;
+  this->recMode = REC_STANDALONE;
+  this->recRunning = false;
+  this->recStop = false;
 
   CPU_GRP_SIZE = 1024;
 
@@ -248,6 +287,8 @@ bool Kangaroo::Output(Int *pk,char sInfo,int sType) {
   ::printf("Key# %d Pub:  0x%s \n",keyIdx,secp->GetPublicKeyHex(true,keysToSearch[keyIdx]).c_str());
   if(PR.equals(keysToSearch[keyIdx])) {
     ::printf("       Priv: 0x%s \n",pk->GetBase16().c_str());
+    if(keyIdx < keyProgress.size())
+      keyProgress[keyIdx].status = KEY_SOLVED;
   } else {
     ::printf("       Failed !\n");
     if(needToClose)
@@ -310,19 +351,15 @@ bool  Kangaroo::CheckKey(Int d1,Int d2,uint8_t type) {
 
 bool Kangaroo::CollisionCheck(Int* d1,uint32_t type1,Int* d2,uint32_t type2) {
 
-  ::printf("\n[CollisionCheck] Checking collision: type1=%u (%s), type2=%u (%s)",
-           type1, type1 == 0 ? "TAME" : "WILD",
-           type2, type2 == 0 ? "TAME" : "WILD");
-
   if(type1 == type2) {
 
     // Collision inside the same herd
-    ::printf(" -> Same herd collision (both %s), rejecting\n", type1 == 0 ? "TAME" : "WILD");
+    LOG(LOGC_COLL,LOG_DEBUG,"Same herd collision (both %s), rejected",type1 == TAME ? "TAME" : "WILD");
     return false;
 
   } else {
 
-    ::printf(" -> Different herd collision (TAME vs WILD), checking key...\n");
+    LOG(LOGC_COLL,LOG_DEBUG,"TAME/WILD collision, checking key");
 
     Int Td;
     Int Wd;
@@ -355,8 +392,6 @@ bool Kangaroo::CollisionCheck(Int* d1,uint32_t type1,Int* d2,uint32_t type2) {
       }
       return false;
 
-    } else {
-      ::printf("[CollisionCheck] KEY FOUND!\n");
     }
 
   }
@@ -370,9 +405,18 @@ bool Kangaroo::CollisionCheck(Int* d1,uint32_t type1,Int* d2,uint32_t type2) {
 bool Kangaroo::AddToTable(Int *pos,Int *dist,uint32_t kType) {
 
   int addStatus = hashTable.Add(pos,dist,kType);
+  if(addStatus == ADD_DUPLICATE)
+    serverStat.nbDuplicate++;
   if(addStatus== ADD_COLLISION)
     return CollisionCheck(&hashTable.kDist,hashTable.kType,dist,kType);
 
+  if(addStatus == ADD_OK && useJournal) {
+    ENTRY e;
+    HashTable::Convert(pos,dist,&e.x,&e.d);
+    e.kType = kType;
+    journal.push_back(e);
+  }
+
   return addStatus == ADD_OK;
 
 }
@@ -380,6 +424,8 @@ bool Kangaroo::AddToTable(Int *pos,Int *dist,uint32_t kType) {
 bool Kangaroo::AddToTable(int256_t *x,int256_t *d, uint32_t kType) {
 
   int addStatus = hashTable.Add(x,d,kType);
+  if(addStatus == ADD_DUPLICATE)
+    serverStat.nbDuplicate++;
   if(addStatus== ADD_COLLISION) {
 
     Int dist;
@@ -389,6 +435,14 @@ bool Kangaroo::AddToTable(int256_t *x,int256_t *d, uint32_t kType) {
 
   }
 
+  if(addStatus == ADD_OK && useJournal) {
+    ENTRY e;
+    e.x = *x;
+    e.d = *d;
+    e.kType = kType;
+    journal.push_back(e);
+  }
+
   return addStatus == ADD_OK;
 
 }
@@ -420,13 +474,23 @@ void Kangaroo::SolveKeyCPU(TH_PARAM *ph) {
     ph->px = new Int[CPU_GRP_SIZE];
     ph->py = new Int[CPU_GRP_SIZE];
     ph->distance = new Int[CPU_GRP_SIZE];
-    CreateHerd(CPU_GRP_SIZE,ph->px,ph->py,ph->distance,TAME);
+    if(ph->nbRestore > 0)
+      RestoreHerd(ph,CPU_GRP_SIZE);
+    else
+      CreateHerd(CPU_GRP_SIZE,ph->px,ph->py,ph->distance,TAME);
 
   }
 
   if(keyIdx==0)
     ::printf("SolveKeyCPU Thread %d: %d kangaroos\n",ph->threadId,CPU_GRP_SIZE);
 
+#ifdef WALK_PROFILE
+  if(ph->prof == NULL)
+    ph->prof = (WALK_PROF *)calloc(1,sizeof(WALK_PROF));
+  uint8_t *wpDP = new uint8_t[CPU_GRP_SIZE];
+#endif
+  WP_VARS;
+
   ph->hasStarted = true;
 
   // Using Affine coord
@@ -438,6 +502,8 @@ void Kangaroo::SolveKeyCPU(TH_PARAM *ph) {
 
   while(!endOfSearch) {
 
+    WP_START;
+
     // Random walk
 
     for(int g = 0; g < CPU_GRP_SIZE; g++) {
@@ -454,9 +520,29 @@ void Kangaroo::SolveKeyCPU(TH_PARAM *ph) {
 
     }
 
+    WP_LAP(ph,WP_DX);
+
+#ifdef WALK_PROFILE
+    // Distance update, done in the add loop when not profiling
+    for(int g = 0; g < CPU_GRP_SIZE; g++) {
+
+#ifdef USE_SYMMETRY
+      uint64_t jmp = ph->px[g].bits64[0] % (NB_JUMP / 2) + (NB_JUMP / 2) * ph->symClass[g];
+#else
+      uint64_t jmp = ph->px[g].bits64[0] % NB_JUMP;
+#endif
+      ph->distance[g].ModAddK1order(&jumpDistance[jmp]);
+
+    }
+
+    WP_LAP(ph,WP_DIST);
+#endif
+
     grp->Set(dx);
     grp->ModInv();
 
+    WP_LAP(ph,WP_INV);
+
     for(int g = 0; g < CPU_GRP_SIZE; g++) {
 
 #ifdef USE_SYMMETRY
@@ -481,7 +567,9 @@ void Kangaroo::SolveKeyCPU(TH_PARAM *ph) {
       ry.ModMulK1(&_s);
       ry.ModSub(p2y);
 
+#ifndef WALK_PROFILE
       ph->distance[g].ModAddK1order(&jumpDistance[jmp]);
+#endif
 
 #ifdef USE_SYMMETRY
       // Equivalence symmetry class switch
@@ -496,11 +584,25 @@ void Kangaroo::SolveKeyCPU(TH_PARAM *ph) {
 
     }
 
+    WP_LAP(ph,WP_ADD);
+
+#ifdef WALK_PROFILE
+    // DP check, done in the store loop when not profiling
+    for(int g = 0; g < CPU_GRP_SIZE; g++)
+      wpDP[g] = IsDP(&ph->px[g]);
+
+    WP_LAP(ph,WP_DP);
+#endif
+
     if( clientMode ) {
 
       // Accumulate DPs locally
       for(int g = 0; g < CPU_GRP_SIZE; g++) {
+#ifdef WALK_PROFILE
+        if(wpDP[g]) {
+#else
         if(IsDP(&ph->px[g])) {
+#endif
           ITEM it;
           it.x.Set(&ph->px[g]);
           it.d.Set(&ph->distance[g]);
@@ -524,7 +626,11 @@ void Kangaroo::SolveKeyCPU(TH_PARAM *ph) {
       // Add to table and collision check
       for(int g = 0; g < CPU_GRP_SIZE && !endOfSearch; g++) {
 
+#ifdef WALK_PROFILE
+        if(wpDP[g]) {
+#else
         if(IsDP(&ph->px[g])) {
+#endif
           LOCK(ghMutex);
           if(!endOfSearch) {
 
@@ -545,12 +651,38 @@ void Kangaroo::SolveKeyCPU(TH_PARAM *ph) {
 
     }
 
-    // Save request
-    if(saveRequest && !endOfSearch) {
+    WP_LAP(ph,WP_STORE);
+
+    // Integrity sampling: verify a rotating window of kangaroos
+    if(kCheckPeriod > 0 && ++ph->kCheckIter >= kCheckPeriod && !endOfSearch) {
+      uint64_t k = ph->kCheckIdx;
+      int nb = (int)((CPU_GRP_SIZE - k < KCHECK_SAMPLE) ? CPU_GRP_SIZE - k : KCHECK_SAMPLE);
+      bool wrong[KCHECK_SAMPLE];
+      if(CheckKangaroos(ph,nb,&ph->px[k],&ph->py[k],&ph->distance[k],k,wrong)) {
+        for(int i = 0; i < nb; i++)
+          if(wrong[i]) CreateHerd(1,&ph->px[k + i],&ph->py[k + i],&ph->distance[k + i],(int)((k + i) % 2));
+      }
+      ph->kCheckIdx = (k + nb) % CPU_GRP_SIZE;
+      ph->kCheckIter = 0;
+    }
+
+    // Save request: hand off a copy of the kangaroos and keep walking
+    if(saveRequest && !endOfSearch && !ph->isWaiting) {
+      if(saveKangaroo) {
+        if(ph->snapPx == NULL) {
+          ph->snapPx = new Int[CPU_GRP_SIZE];
+          ph->snapPy = new Int[CPU_GRP_SIZE];
+          ph->snapDistance = new Int[CPU_GRP_SIZE];
+        }
+        for(int g = 0; g < CPU_GRP_SIZE; g++) {
+          ph->snapPx[g].Set(&ph->px[g]);
+          ph->snapPy[g].Set(&ph->py[g]);
+          ph->snapDistance[g].Set(&ph->distance[g]);
+        }
+      }
       ph->isWaiting = true;
-      LOCK(saveMutex);
+    } else if(!saveRequest && ph->isWaiting) {
       ph->isWaiting = false;
-      UNLOCK(saveMutex);
     }
 
   }
@@ -558,9 +690,16 @@ void Kangaroo::SolveKeyCPU(TH_PARAM *ph) {
   // Free
   delete grp;
   delete[] dx;
+#ifdef WALK_PROFILE
+  delete[] wpDP;
+#endif
   safe_delete_array(ph->px);
   safe_delete_array(ph->py);
   safe_delete_array(ph->distance);
+  safe_delete_array(ph->snapPx);
+  safe_delete_array(ph->snapPy);
+  safe_delete_array(ph->snapDistance);
+  ph->isWaiting = false;
 #ifdef USE_SYMMETRY
   safe_delete_array(ph->symClass);
 #endif
@@ -584,10 +723,8 @@ void Kangaroo::SolveKeyGPU(TH_PARAM *ph) {
   vector<ITEM> gpuFound;
   GPUEngine *gpu;
 
-  if(keyIdx == 0) {
-    ::printf("DEBUG: GPU#%d - Creating GPUEngine...\n", ph->gpuId);
-    ::fflush(stdout);
-  }
+  if(keyIdx == 0)
+    LOG(LOGC_GPU,LOG_DEBUG,"GPU#%d: Creating GPUEngine...",ph->gpuId);
 
   gpu = new GPUEngine(ph->gridSizeX,ph->gridSizeY,ph->gpuId,65536 * 2);
 
@@ -607,43 +744,40 @@ void Kangaroo::SolveKeyGPU(TH_PARAM *ph) {
     // Create Kangaroos, if not already loaded
     uint64_t nbThread = gpu->GetNbThread();
 
-    if(keyIdx == 0) {
-      ::printf("DEBUG: GPU#%d - Allocating memory for %llu kangaroos...\n", ph->gpuId, (unsigned long long)ph->nbKangaroo);
-      ::fflush(stdout);
-    }
+    if(keyIdx == 0)
+      LOG(LOGC_GPU,LOG_DEBUG,"GPU#%d: Allocating memory for %llu kangaroos...",ph->gpuId,(unsigned long long)ph->nbKangaroo);
 
     ph->px = new Int[ph->nbKangaroo];
     ph->py = new Int[ph->nbKangaroo];
     ph->distance = new Int[ph->nbKangaroo];
 
-    if(keyIdx == 0) {
-      ::printf("DEBUG: GPU#%d - Creating %llu herds...\n", ph->gpuId, (unsigned long long)nbThread);
+    if(keyIdx == 0)
+      LOG(LOGC_GPU,LOG_DEBUG,"GPU#%d: Creating %llu herds...",ph->gpuId,(unsigned long long)nbThread);
+
+    if(ph->nbRestore > 0) {
+      ::printf("SolveKeyGPU Thread GPU#%d: restoring %.0f kangaroos...\n",ph->gpuId,(double)ph->nbRestore);
       ::fflush(stdout);
+      RestoreHerd(ph,ph->nbKangaroo);
+      nbThread = 0;
     }
 
     for(uint64_t i = 0; i<nbThread; i++) {
-      if(keyIdx == 0 && i % 10000 == 0 && i > 0) {
-        ::printf("DEBUG: GPU#%d - Created %llu/%llu herds (%.1f%%)\n",
-                 ph->gpuId, (unsigned long long)i, (unsigned long long)nbThread,
-                 (i * 100.0) / nbThread);
-        ::fflush(stdout);
-      }
+      if(keyIdx == 0 && i % 10000 == 0 && i > 0)
+        LOG(LOGC_GPU,LOG_DEBUG,"GPU#%d: Created %llu/%llu herds (%.1f%%)",
+            ph->gpuId,(unsigned long long)i,(unsigned long long)nbThread,
+            (i * 100.0) / nbThread);
       CreateHerd(GPU_GRP_SIZE,&(ph->px[i*GPU_GRP_SIZE]),
                               &(ph->py[i*GPU_GRP_SIZE]),
                               &(ph->distance[i*GPU_GRP_SIZE]),
                               TAME);
     }
 
-    if(keyIdx == 0) {
-      ::printf("DEBUG: GPU#%d - All %llu herds created successfully!\n", ph->gpuId, (unsigned long long)nbThread);
-      ::fflush(stdout);
-    }
+    if(keyIdx == 0)
+      LOG(LOGC_GPU,LOG_DEBUG,"GPU#%d: All %llu herds created successfully!",ph->gpuId,(unsigned long long)nbThread);
   }
 
-  if(keyIdx == 0) {
-    ::printf("DEBUG: GPU#%d - Setting GPU parameters...\n", ph->gpuId);
-    ::fflush(stdout);
-  }
+  if(keyIdx == 0)
+    LOG(LOGC_GPU,LOG_DEBUG,"GPU#%d: Setting GPU parameters...",ph->gpuId);
 
 #ifdef USE_SYMMETRY
   gpu->SetWildOffset(&rangeWidthDiv4);
@@ -654,10 +788,8 @@ void Kangaroo::SolveKeyGPU(TH_PARAM *ph) {
   HashTable::toInt(&dMask, &dmaskInt);
   gpu->SetParams(&dmaskInt,jumpDistance,jumpPointx,jumpPointy);
 
-  if(keyIdx == 0) {
-    ::printf("DEBUG: GPU#%d - Setting kangaroos on GPU...\n", ph->gpuId);
-    ::fflush(stdout);
-  }
+  if(keyIdx == 0)
+    LOG(LOGC_GPU,LOG_DEBUG,"GPU#%d: Setting kangaroos on GPU...",ph->gpuId);
 
   gpu->SetKangaroos(ph->px,ph->py,ph->distance);
 
@@ -668,22 +800,17 @@ void Kangaroo::SolveKeyGPU(TH_PARAM *ph) {
     safe_delete_array(ph->distance);
   }
 
-  if(keyIdx == 0) {
-    ::printf("DEBUG: GPU#%d - Calling GPU kernel for initialization...\n", ph->gpuId);
-    ::fflush(stdout);
-  }
+  if(keyIdx == 0)
+    LOG(LOGC_GPU,LOG_DEBUG,"GPU#%d: Calling GPU kernel for initialization...",ph->gpuId);
 
   gpu->callKernel();
 
-  if(keyIdx == 0) {
-    ::printf("DEBUG: GPU#%d - GPU kernel initialization completed\n", ph->gpuId);
-    ::fflush(stdout);
-  }
+  if(keyIdx == 0)
+    LOG(LOGC_GPU,LOG_DEBUG,"GPU#%d: GPU kernel initialization completed",ph->gpuId);
 
   double t1 = Timer::get_tick();
 
   if(keyIdx == 0) {
-    ::printf("DEBUG: GPU#%d - GPU initialization COMPLETE!\n", ph->gpuId);
     ::printf("SolveKeyGPU Thread GPU#%d: 2^%.2f kangaroos [%.1fs]\n",ph->gpuId,log2((double)ph->nbKangaroo),(t1-t0));
     ::fflush(stdout);
   }
@@ -692,10 +819,8 @@ void Kangaroo::SolveKeyGPU(TH_PARAM *ph) {
   // This signals to the main thread that it's safe to start the network thread
   ph->hasStarted = true;
 
-  if(keyIdx == 0) {
-    ::printf("DEBUG: GPU#%d - Set hasStarted=true, GPU is ready for operation\n", ph->gpuId);
-    ::fflush(stdout);
-  }
+  if(keyIdx == 0)
+    LOG(LOGC_GPU,LOG_DEBUG,"GPU#%d: Set hasStarted=true, GPU is ready for operation",ph->gpuId);
 
   while(!endOfSearch) {
 
@@ -737,15 +862,38 @@ void Kangaroo::SolveKeyGPU(TH_PARAM *ph) {
 
     }
 
-    // Save request
-    if(saveRequest && !endOfSearch) {
-      // Get kangaroos
+    // Integrity sampling: read back a rotating window of kangaroos
+    if(kCheckPeriod > 0 && ++ph->kCheckIter >= kCheckPeriod && !endOfSearch) {
+      Int kpx[KCHECK_SAMPLE];
+      Int kpy[KCHECK_SAMPLE];
+      Int kd[KCHECK_SAMPLE];
+      bool wrong[KCHECK_SAMPLE];
+      uint64_t k = ph->kCheckIdx;
+      int nb = (int)((ph->nbKangaroo - k < KCHECK_SAMPLE) ? ph->nbKangaroo - k : KCHECK_SAMPLE);
+      for(int i = 0; i < nb; i++)
+        gpu->GetKangaroo(k + i,&kpx[i],&kpy[i],&kd[i]);
+      if(CheckKangaroos(ph,nb,kpx,kpy,kd,k,wrong)) {
+        for(int i = 0; i < nb; i++) {
+          if(wrong[i]) {
+            CreateHerd(1,&kpx[i],&kpy[i],&kd[i],(int)((k + i) % 2));
+            gpu->SetKangaroo(k + i,&kpx[i],&kpy[i],&kd[i]);
+          }
+        }
+      }
+      ph->kCheckIdx = (k + nb) % ph->nbKangaroo;
+      ph->kCheckIter = 0;
+    }
+
+    // Save request: get back kangaroos and keep walking
+    if(saveRequest && !endOfSearch && !ph->isWaiting) {
       if(saveKangaroo)
         gpu->GetKangaroos(ph->px,ph->py,ph->distance);
+      ph->snapPx = ph->px;
+      ph->snapPy = ph->py;
+      ph->snapDistance = ph->distance;
       ph->isWaiting = true;
-      LOCK(saveMutex);
+    } else if(!saveRequest && ph->isWaiting) {
       ph->isWaiting = false;
-      UNLOCK(saveMutex);
     }
 
   }
@@ -754,6 +902,10 @@ void Kangaroo::SolveKeyGPU(TH_PARAM *ph) {
   safe_delete_array(ph->px);
   safe_delete_array(ph->py);
   safe_delete_array(ph->distance);
+  ph->snapPx = NULL;
+  ph->snapPy = NULL;
+  ph->snapDistance = NULL;
+  ph->isWaiting = false;
   delete gpu;
 
 #else
@@ -803,16 +955,25 @@ void Kangaroo::NetworkThread() {
   size_t lastQueueSize = 0;
   bool highQueueWarned = false;
 
-  ::printf("\n[NetworkThread] Starting network thread (socket_fd=%d, batch_size=%u)\n",
-           serverConn, BATCH_SIZE);
+  LOG(LOGC_NET,LOG_DEBUG,"Network thread started (socket_fd=%d, batch_size=%u)",
+      serverConn,BATCH_SIZE);
 
   while(networkThreadRunning || !dpQueue.empty()) {
 
+    // Nothing to send, wait on the socket so that acks are read (and timed)
+    // when they arrive rather than at the next batch
+    if(isConnected && pendingAck.size() > 0 && dpQueue.empty()) {
+      ReadAcks((int)pendingAck.size(),ACK_POLL);
+      continue;
+    }
+
     // Check for queue explosion (indicates network can't keep up)
     size_t currentQueueSize = dpQueue.size();
+    if(currentQueueSize > pipeStat.maxQueue)
+      pipeStat.maxQueue = currentQueueSize;
     if(currentQueueSize > 1000000 && !highQueueWarned) {
-      ::printf("\n[NetworkThread WARNING] DP queue very high: %zu DPs (network may be too slow)\n",
-               currentQueueSize);
+      LOG(LOGC_NET,LOG_WARN,"DP queue very high: %zu DPs (network may be too slow)",
+          currentQueueSize);
       highQueueWarned = true;
     }
 
@@ -821,6 +982,9 @@ void Kangaroo::NetworkThread() {
       // Timeout or empty queue, check if we should continue
       if(!networkThreadRunning && dpQueue.empty())
         break;
+      // Server status of the acks received meanwhile
+      if(isConnected)
+        ReadAcks(ACK_WINDOW);
       continue;
     }
 
@@ -841,16 +1005,14 @@ void Kangaroo::NetworkThread() {
         batchCount++;
 
         // Periodic stats (every 100 batches)
-        if(batchCount % 100 == 0) {
-          size_t queueSize = dpQueue.size();
-          ::printf("\n[NetworkThread] Sent %llu DPs in %llu batches | Queue: %zu DPs (Avg: %.0f DPs/batch)\n",
-                   (unsigned long long)totalSent, (unsigned long long)batchCount, queueSize,
-                   (double)totalSent / batchCount);
-        }
+        if(batchCount % 100 == 0)
+          LOG(LOGC_NET,LOG_DEBUG,"Sent %llu DPs in %llu batches | Queue: %zu DPs (Avg: %.0f DPs/batch)",
+              (unsigned long long)totalSent,(unsigned long long)batchCount,dpQueue.size(),
+              (double)totalSent / batchCount);
       } else {
         // Network error - connection lost
         // DPs are cleared by SendToServer, they will be regenerated
-        ::printf("\n[NetworkThread ERROR] Send failed for batch of %zu DPs - connection issue\n", batchSize);
+        LOG_RATE(LOGC_NET,LOG_ERROR,1,"Send failed for batch of %zu DPs - connection issue",batchSize);
       }
 
       // Clear for next batch
@@ -860,8 +1022,12 @@ void Kangaroo::NetworkThread() {
     }
   }
 
-  ::printf("\n[NetworkThread] Shutting down. Total sent: %llu DPs in %llu batches\n",
-           (unsigned long long)totalSent, (unsigned long long)batchCount);
+  // Wait for the acks of the last packets
+  if(isConnected)
+    ReadAcks(0);
+
+  LOG(LOGC_NET,LOG_INFO,"Network thread stopped, total sent: %llu DPs in %llu batches",
+      (unsigned long long)totalSent,(unsigned long long)batchCount);
 }
 
 #ifdef WIN64
@@ -869,8 +1035,8 @@ DWORD WINAPI _NetworkThread(LPVOID lpParam) {
 #else
 void *_NetworkThread(void *lpParam) {
 #endif
-  Kangaroo *obj = (Kangaroo *)lpParam;
-  obj->NetworkThread();
+  TH_PARAM *p = (TH_PARAM *)lpParam;
+  p->obj->NetworkThread();
   return 0;
 }
 
@@ -966,8 +1132,8 @@ void Kangaroo::CreateJumpTable() {
   //::printf("Jump Avg distance max: 2^%.2f\n",log2(maxAvg));
   
   // Kangaroo jumps
-  // Constant seed for compatibilty of workfiles
-  rseed(0x600DCAFE);
+  // Constant seed for compatibilty of workfiles (changed only by -statjump)
+  rseed(jumpSeed);
 
 #ifdef USE_SYMMETRY
   Int old;
@@ -1081,6 +1247,22 @@ void Kangaroo::ComputeExpected(double dp,double *op,double *ram,double *overHead
 
 }
 
+// Suggested distinguished bits number for less than 5% overhead (see README)
+int Kangaroo::GetSuggestedDP() {
+
+  double dpOverHead;
+  int suggestedDP = (int)((double)rangePower / 2.0 - log2((double)totalRW));
+  if(suggestedDP<0) suggestedDP=0;
+  ComputeExpected((double)suggestedDP,&expectedNbOp,&expectedMem,&dpOverHead);
+  while(dpOverHead>1.05 && suggestedDP>0) {
+    suggestedDP--;
+    ComputeExpected((double)suggestedDP,&expectedNbOp,&expectedMem,&dpOverHead);
+  }
+
+  return suggestedDP;
+
+}
+
 // ----------------------------------------------------------------------------
 
 void Kangaroo::InitRange() {
@@ -1147,6 +1329,11 @@ void Kangaroo::Run(int nbThread,std::vector<int> gpuId,std::vector<int> gridSize
 
   memset(params, 0,totalThread * sizeof(TH_PARAM));
   memset(counters, 0, sizeof(counters));
+  StartRecorder(clientMode ? REC_CLIENT : REC_STANDALONE);
+
+#ifdef WALK_PROFILE
+  WalkProfileInit();
+#endif
   ::printf("Number of CPU thread: %d\n", nbCPUThread);
 
 #ifdef WITHGPU
@@ -1190,15 +1377,7 @@ void Kangaroo::Run(int nbThread,std::vector<int> gpuId,std::vector<int> gridSize
 
   if( !clientMode ) {
 
-    // Compute suggested distinguished bits number for less than 5% overhead (see README)
-    double dpOverHead;
-    int suggestedDP = (int)((double)rangePower / 2.0 - log2((double)totalRW));
-    if(suggestedDP<0) suggestedDP=0;
-    ComputeExpected((double)suggestedDP,&expectedNbOp,&expectedMem,&dpOverHead);
-    while(dpOverHead>1.05 && suggestedDP>0) {
-      suggestedDP--;
-      ComputeExpected((double)suggestedDP,&expectedNbOp,&expectedMem,&dpOverHead);
-    }
+    int suggestedDP = GetSuggestedDP();
 
     if(initDPSize < 0)
       initDPSize = suggestedDP;
@@ -1220,135 +1399,165 @@ void Kangaroo::Run(int nbThread,std::vector<int> gpuId,std::vector<int> gridSize
   // Fetch kangaroos (if any)
   FectchKangaroos(params);
 
-//#define STATS
-#ifdef STATS
-
-    CPU_GRP_SIZE = 1024;
-    for(; CPU_GRP_SIZE <= 1024; CPU_GRP_SIZE *= 4) {
-
-      uint64_t totalCount = 0;
-      uint64_t totalDead = 0;
+  // Per key progress, restored from the key manifest when resuming
+  if(keyProgress.size() != keysToSearch.size()) {
+    KEY_PROGRESS kp;
+    kp.status = KEY_PENDING;
+    kp.count = 0;
+    kp.time = 0;
+    keyProgress.assign(keysToSearch.size(),kp);
+    startKeyIdx = 0;
+  }
+  bool saveManifest = !clientMode && workFile.length() > 0 && keysToSearch.size() > 1;
 
-#endif
+  // LaunchThread() sets obj, the network thread has no other parameter
+  TH_PARAM netParam;
+  memset(&netParam,0,sizeof(TH_PARAM));
+  double loadedTime = offsetTime;
 
-    for(keyIdx = 0; keyIdx < keysToSearch.size(); keyIdx++) {
+  for(keyIdx = startKeyIdx; keyIdx < keysToSearch.size(); keyIdx++) {
 
-      InitSearchKey();
+    InitSearchKey();
 
-      endOfSearch = false;
-      collisionInSameHerd = 0;
+    endOfSearch = false;
+    collisionInSameHerd = 0;
 
-      // Reset conters
-      memset(counters,0,sizeof(counters));
+    // Reset conters
+    memset(counters,0,sizeof(counters));
 
-      // Lanch CPU threads
-      for(int i = 0; i < nbCPUThread; i++) {
-        params[i].threadId = i;
-        params[i].isRunning = true;
-        thHandles[i] = LaunchThread(_SolveKeyCPU,params + i);
-      }
+    // Lanch CPU threads
+    for(int i = 0; i < nbCPUThread; i++) {
+      params[i].threadId = i;
+      params[i].isRunning = true;
+      thHandles[i] = LaunchThread(_SolveKeyCPU,params + i);
+    }
 
 #ifdef WITHGPU
 
-      // Launch GPU threads
-      for(int i = 0; i < nbGPUThread; i++) {
-        int id = nbCPUThread + i;
-        params[id].threadId = 0x80L + i;
-        params[id].isRunning = true;
-        params[id].gpuId = gpuId[i];
-        thHandles[id] = LaunchThread(_SolveKeyGPU,params + id);
-      }
+    // Launch GPU threads
+    for(int i = 0; i < nbGPUThread; i++) {
+      int id = nbCPUThread + i;
+      params[id].threadId = 0x80L + i;
+      params[id].isRunning = true;
+      params[id].gpuId = gpuId[i];
+      thHandles[id] = LaunchThread(_SolveKeyGPU,params + id);
+    }
 
 #endif
 
-      // CRITICAL: Wait for GPU initialization to complete before starting network thread
-      // The network thread MUST NOT start until all GPU threads have finished initialization
-      if( clientMode && nbGPUThread > 0 ) {
-        ::printf("Waiting for GPU initialization to complete before starting network thread...\n");
-
-        // Wait for ALL GPU threads to complete initialization (hasStarted = true)
-        bool allGPUReady = false;
-        int waitCount = 0;
-        while(!allGPUReady && !endOfSearch) {
-          allGPUReady = true;
-          for(int i = 0; i < nbGPUThread; i++) {
-            int id = nbCPUThread + i;
-            if(!params[id].hasStarted) {
-              allGPUReady = false;
-              break;
-            }
+    // CRITICAL: Wait for GPU initialization to complete before starting network thread
+    // The network thread MUST NOT start until all GPU threads have finished initialization
+    if( clientMode && nbGPUThread > 0 ) {
+      ::printf("Waiting for GPU initialization to complete before starting network thread...\n");
+
+      // Wait for ALL GPU threads to complete initialization (hasStarted = true)
+      bool allGPUReady = false;
+      int waitCount = 0;
+      while(!allGPUReady && !endOfSearch) {
+        allGPUReady = true;
+        for(int i = 0; i < nbGPUThread; i++) {
+          int id = nbCPUThread + i;
+          if(!params[id].hasStarted) {
+            allGPUReady = false;
+            break;
           }
+        }
 
-          if(!allGPUReady) {
-            Timer::SleepMillis(100);  // Check every 100ms
-            waitCount++;
-            if(waitCount % 10 == 0) {  // Print status every 1 second
-              ::printf("Still waiting for GPU initialization... (%d seconds)\n", waitCount / 10);
-            }
+        if(!allGPUReady) {
+          Timer::SleepMillis(100);  // Check every 100ms
+          waitCount++;
+          if(waitCount % 10 == 0) {  // Print status every 1 second
+            ::printf("Still waiting for GPU initialization... (%d seconds)\n", waitCount / 10);
           }
         }
+      }
 
-        if(!endOfSearch) {
-          ::printf("GPU initialization complete! Now starting network thread...\n");
-          networkThreadRunning = true;
-          networkThreadHandle = LaunchThread(_NetworkThread, (TH_PARAM *)this);
-          ::printf("NetworkThread: Started async DP transmission thread\n");
-        }
-      } else if( clientMode && nbGPUThread == 0 ) {
-        // CPU-only mode: start network thread immediately
-        ::printf("Starting async network thread (CPU-only mode)...\n");
+      if(!endOfSearch) {
+        ::printf("GPU initialization complete! Now starting network thread...\n");
         networkThreadRunning = true;
-        networkThreadHandle = LaunchThread(_NetworkThread, (TH_PARAM *)this);
-        ::printf("NetworkThread: Started async DP transmission thread\n");
+        networkThreadHandle = LaunchThread(_NetworkThread, &netParam);
+        LOG(LOGC_NET,LOG_DEBUG,"Started async DP transmission thread");
       }
+    } else if( clientMode && nbGPUThread == 0 ) {
+      // CPU-only mode: start network thread immediately
+      ::printf("Starting async network thread (CPU-only mode)...\n");
+      networkThreadRunning = true;
+      networkThreadHandle = LaunchThread(_NetworkThread, &netParam);
+      LOG(LOGC_NET,LOG_DEBUG,"Started async DP transmission thread");
+    }
 
-      // Wait for end
-      Process(params,"MK/s");
-      JoinThreads(thHandles,nbCPUThread + nbGPUThread);
-      FreeHandles(thHandles,nbCPUThread + nbGPUThread);
+    // Wait for end
+    Process(params,"MK/s");
+    JoinThreads(thHandles,nbCPUThread + nbGPUThread);
+    FreeHandles(thHandles,nbCPUThread + nbGPUThread);
 
-      // Shutdown network thread if in client mode
-      if(clientMode && networkThreadRunning) {
-        ::printf("Shutting down network thread...\n");
-        networkThreadRunning = false;
-        dpQueue.requestShutdown();
+    // Shutdown network thread if in client mode
+    if(clientMode && networkThreadRunning) {
+      LOG(LOGC_NET,LOG_DEBUG,"Shutting down network thread");
+      networkThreadRunning = false;
+      dpQueue.requestShutdown();
 
-        // Wait for network thread to finish sending remaining DPs
+      // Wait for network thread to finish sending remaining DPs
 #ifdef WIN64
-        WaitForSingleObject(networkThreadHandle, INFINITE);
-        CloseHandle(networkThreadHandle);
+      WaitForSingleObject(networkThreadHandle, INFINITE);
+      CloseHandle(networkThreadHandle);
 #else
-        pthread_join(networkThreadHandle, NULL);
+      pthread_join(networkThreadHandle, NULL);
 #endif
-        ::printf("Network thread stopped.\n");
-      }
+    }
 
-      hashTable.Reset();
+    // Record key result, next key starts from scratch
+    if(keyProgress[keyIdx].status != KEY_SOLVED)
+      keyProgress[keyIdx].status = KEY_ABORTED;
+    keyProgress[keyIdx].count = getCPUCount() + getGPUCount() + offsetCount;
+    keyProgress[keyIdx].time = Timer::get_tick() - startTime + offsetTime;
+    offsetCount = 0;
+    offsetTime = 0;
+    if(saveManifest)
+      SaveKeyManifest(workFile,keyIdx + 1);
 
-#ifdef STATS
+    hashTable.Reset();
+    journal.clear();
+    journalReady = false;
 
-      uint64_t count = getCPUCount() + getGPUCount();
-      totalCount += count;
-      totalDead += collisionInSameHerd;
-      double SN = pow(2.0,rangePower / 2.0);
-      double avg = (double)totalCount / (double)(keyIdx + 1);
-      ::printf("\n[%3d] 2^%.3f Dead:%d Avg:2^%.3f DeadAvg:%.1f (%.3f %.3f sqrt(N))\n",
-                              keyIdx, log2((double)count), (int)collisionInSameHerd, 
-                              log2(avg), (double)totalDead / (double)(keyIdx + 1),
-                              avg/SN,expectedNbOp/SN);
-    }
-    string fName = "DP" + ::to_string(dpSize) + ".txt";
-    FILE *f = fopen(fName.c_str(),"a");
-    fprintf(f,"%d %f\n",CPU_GRP_SIZE*nbCPUThread,(double)totalCount);
-    fclose(f);
+  }
 
+#ifdef WALK_PROFILE
+  WalkProfileDump(params,nbCPUThread);
+  for(int i = 0; i < nbCPUThread; i++)
+    free(params[i].prof);
 #endif
 
+  // Integrity sampling report, per device
+  if(kCheckPeriod > 0) {
+    uint64_t nbChecked = 0;
+    uint64_t nbWrong = 0;
+    for(int i = 0; i < (int)totalThread; i++) {
+      nbChecked += params[i].nbKChecked;
+      nbWrong += params[i].nbKWrong;
+      if(params[i].nbKWrong == 0)
+        continue;
+      if(params[i].threadId >= 0x80) {
+#ifdef WITHGPU
+        ::printf("\nKangaroo check: GPU#%d error rate %.3g (%.0f/%.0f)",params[i].gpuId,
+                 (double)params[i].nbKWrong / (double)params[i].nbKChecked,(double)params[i].nbKWrong,(double)params[i].nbKChecked);
+#endif
+      } else {
+        ::printf("\nKangaroo check: CPU thread %d error rate %.3g (%.0f/%.0f)",params[i].threadId,
+                 (double)params[i].nbKWrong / (double)params[i].nbKChecked,(double)params[i].nbKWrong,(double)params[i].nbKChecked);
+      }
+    }
+    ::printf("\nKangaroo check: %.0f kangaroos checked, %.0f wrong",(double)nbChecked,(double)nbWrong);
   }
 
   double t1 = Timer::get_tick();
 
-  ::printf("\nDone: Total time %s \n" , GetTimeStr(t1-t0+offsetTime).c_str());
+  ::printf("\nDone: Total time %s \n" , GetTimeStr(t1-t0+loadedTime).c_str());
+
+  if(clientMode && pipeStatFile.length() > 0)
+    SavePipeStat(t1 - t0);
+
+  StopRecorder();
 
 }
 
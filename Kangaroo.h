@@ -38,6 +38,8 @@ typedef int SOCKET;
 
 #include <string>
 #include <vector>
+#include <map>
+#include <deque>
 #include "SECPK1/SECP256k1.h"
 #include "HashTable.h"
 #include "SECPK1/IntGroup.h"
@@ -56,6 +58,44 @@ typedef pthread_t THREAD_HANDLE;
 
 class Kangaroo;
 
+#ifdef WALK_PROFILE
+
+// CPU walk profiler, TSC cycles of each phase of a walk iteration
+// (CPU_GRP_SIZE kangaroos), dumped at exit and on SIGUSR1
+#define WP_DX    0  // dx = px - jumpx
+#define WP_INV   1  // Batch modular inverse
+#define WP_ADD   2  // Affine addition
+#define WP_DIST  3  // Distance update
+#define WP_DP    4  // DP check
+#define WP_STORE 5  // Table insert or queue push
+#define WP_NB    6
+
+// Histogram bins, 8 bins per power of 2
+#define WP_BIN   512
+
+typedef struct {
+
+  uint64_t count[WP_NB];
+  uint64_t cycles[WP_NB];
+  uint64_t hist[WP_NB][WP_BIN];
+
+} WALK_PROF;
+
+// Phases are separate passes over the group (the distance update and the
+// DP check are split from the add and the store), a single TSC read ends
+// each of them
+#define WP_VARS                uint64_t wpT = 0,wpT1 = 0
+#define WP_START               wpT = Timer::getTSC()
+#define WP_LAP(ph,p)           { wpT1 = Timer::getTSC(); WalkProfileAdd((ph)->prof,p,wpT1 - wpT); wpT = wpT1; }
+
+#else
+
+#define WP_VARS
+#define WP_START
+#define WP_LAP(ph,p)
+
+#endif
+
 // Input thread parameters
 typedef struct {
 
@@ -75,18 +115,45 @@ typedef struct {
   Int *px; // Kangaroo position
   Int *py; // Kangaroo position
   Int *distance; // Travelled distance
+  Int *snapPx; // Kangaroo snapshot handed off for saving
+  Int *snapPy;
+  Int *snapDistance;
 #ifdef USE_SYMMETRY
   uint64_t *symClass; // Last jump
 #endif
   
   SOCKET clientSock;
   char  *clientInfo;
+  uint32_t clientId;
 
   uint32_t hStart;
   uint32_t hStop;
   char *part1Name;
   char *part2Name;
 
+  FILE *f;            // Parallel table save/load
+  uint64_t fOffset;
+  uint8_t *buffer;
+  uint64_t bufferSize;
+  int nbInput;        // Inputs of a region merge
+  uint8_t **input;
+  uint64_t *inputSize;
+  bool resetTable;    // Reset partition once saved
+  bool checkCrc;      // Check v2 region crc on load
+  uint64_t restoreIdx; // Slice of compressed kangaroos rebuilt by the thread
+  uint64_t nbRestore;
+  uint64_t nbChecked;  // Batched DP check results
+  uint64_t nbWrong;
+  uint64_t kCheckIter; // Kangaroo integrity sampling
+  uint64_t kCheckIdx;
+  uint64_t nbKChecked;
+  uint64_t nbKWrong;
+  ENTRY *benchDP;      // Slice of the DP table benchmark stream
+  uint64_t nbBenchDP;
+#ifdef WALK_PROFILE
+  WALK_PROF *prof;
+#endif
+
 } TH_PARAM;
 
 
@@ -113,31 +180,309 @@ typedef struct {
 typedef struct {
   uint32_t nbDP;
   DP *dp;
+  uint32_t clientId; // Sender (server side)
+  uint32_t sourceId;
 } DP_CACHE;
 
+// Sampled DP validation (server)
+#define VALIDATE_QUEUE_MAX (1 << 20)
+
+typedef struct {
+
+  ENTRY    e;
+  uint32_t sourceId;
+
+} VALIDATE_ITEM;
+
+// Table purge, entries copied by ProcessServer and verified by the validators
+#define PURGE_QUEUE_MAX (1 << 18)
+
+typedef struct {
+
+  ENTRY    e;
+  uint32_t h;  // Bucket
+
+} PURGE_ITEM;
+
+typedef struct {
+
+  std::string host;
+  uint64_t nbDP;        // DP received
+  uint64_t nbSampled;   // DP verified
+  uint64_t nbWrong;     // Wrong DP found
+  uint64_t nbRejected;  // DP dropped while quarantined
+  uint32_t nbQuarantined; // Sources in quarantine
+  uint64_t lastNbDP;    // nbDP at the last rate update
+  double   dpRate;      // DP/s received
+  // Accounting
+  uint64_t nbKangaroo;  // Declared by the connected processes (SERVER_SETKNB)
+  uint32_t nbConnection;
+  uint64_t nbByte;      // DP packet bytes received
+  uint64_t nbDuplicate; // DP already in the table
+  uint64_t nbDead;      // DP rejected by the table (same herd or duplicate)
+  uint64_t nbTame;
+  uint64_t nbWild;
+  uint64_t nbNotDP;     // Points not matching the DP mask
+  uint64_t nbBadIdx;    // Kangaroo index beyond the declared count
+  double   firstTime;   // First connection
+  double   lastDPTime;
+  // Anomaly check
+  uint64_t checkNbDP;   // nbDP at the last check
+  double   checkTime;
+  double   walkRate;    // Jumps/s per declared kangaroo implied by the DP rate
+  uint32_t anomaly;     // ANOMALY_ flags
+
+} CLIENT_STAT;
+
+// Client anomalies
+#define ANOMALY_STALLED   0x01  // No DP while some are expected
+#define ANOMALY_RATE_LOW  0x02  // DP rate far below the fleet for the declared kangaroos
+#define ANOMALY_RATE_HIGH 0x04  // DP rate not possible for the declared kangaroos
+#define ANOMALY_DUPLICATE 0x08  // DP sent again
+#define ANOMALY_HERD      0x10  // Unbalanced TAME/WILD
+#define ANOMALY_NOT_DP    0x20  // Points not matching the DP mask
+#define ANOMALY_KIDX      0x40  // Kangaroo index beyond the declared count
+#define ANOMALY_NB        7
+
+// DP source of a client host (DPHEADER processId and gpuId)
+typedef struct {
+
+  uint32_t clientId;
+  uint32_t processId;
+  uint32_t gpuId;       // 0xFFFF for CPU threads
+  uint64_t nbDP;
+  uint64_t nbByte;
+  uint64_t nbDuplicate;
+  uint64_t nbDead;
+  // Sampled DP validation
+  uint64_t nbSampled;
+  uint64_t nbWrong;
+  uint64_t nbRejected;
+  bool     quarantined;
+  double   quarantineTime;
+
+} SOURCE_STAT;
+
+// DP pipeline counters: walkers -> dpQueue -> SendToServer (client),
+// HandleRequest -> recvDP -> ProcessServer (server)
+typedef struct {
+
+  // Client
+  uint64_t nbQueued;    // DP pushed to dpQueue by the walkers
+  uint64_t maxQueue;    // Max dpQueue depth
+  uint64_t nbPacket;    // DP packets acknowledged by the server
+  uint64_t nbSent;      // DP acknowledged by the server
+  uint64_t nbStatus;    // Status round trips (WaitForServer)
+  double   sendTime;    // Time spent sending packets and reading acks
+  double   ackTime;     // Sum of the ack latencies seen by the client (write to ack read)
+  double   waitTime;    // Time spent in WaitForServer
+  // Server
+  uint64_t nbRecv;      // DP received by HandleRequest
+  uint64_t nbAdded;     // DP added to the table by ProcessServer
+  uint64_t nbPending;   // DP waiting in recvDP
+  uint64_t maxPending;  // Max DP waiting in recvDP
+  // DP packets and acks
+  uint64_t bytesOut;
+  uint64_t bytesIn;
+
+} PIPE_STAT;
+
+// Server metrics (-metrics), updated by ProcessServer
+typedef struct {
+
+  uint64_t nbDuplicate;   // DP already in the table
+  uint64_t nbTame;        // DP processed by herd
+  uint64_t nbWild;
+  uint64_t nbSave;        // Work file saves
+  double   saveTime;      // Duration of the last save
+  double   stallTime;     // ProcessServer blocked by the last save
+  double   maxSaveTime;
+  double   totalSaveTime;
+  uint64_t lastNbAdded;   // pipeStat.nbAdded at the last rate update
+  double   lastRateTime;
+  double   dpRate;        // DP/s added to the table
+
+} SERVER_STAT;
+
+// Sent by the server save process
+typedef struct {
+
+  uint64_t size;
+  double   time;
+
+} SAVE_REPORT;
+
+// DP packet waiting for its ack (client)
+typedef struct {
+
+  uint32_t nbDP;
+  double   sendTime;
+
+} PENDING_ACK;
+
+// Flight recorder (-rec), a REC_HEADER at the start of each run followed
+// by a REC_SAMPLE per second, each sample followed by nbThread floats
+// (MK/s of each CPU then GPU thread)
+#define REC_TAG_HEADER 0x4345524BU  // "KREC"
+#define REC_TAG_SAMPLE 0x4C504D53U  // "SMPL"
+#define REC_VERSION    1
+#define REC_MAX_THREAD 256  // Threads with a rate column
+
+#define REC_STANDALONE 0
+#define REC_CLIENT     1
+#define REC_SERVER     2
+
+typedef struct {
+
+  uint32_t tag;         // REC_TAG_HEADER
+  uint32_t version;
+  uint32_t mode;        // REC_STANDALONE, REC_CLIENT or REC_SERVER
+  uint32_t nbThread;
+  uint64_t startTime;   // Unix time of the start of the run
+  uint32_t dpSize;
+  uint32_t pid;
+
+} REC_HEADER;
+
+typedef struct {
+
+  uint32_t tag;         // REC_TAG_SAMPLE
+  uint32_t keyIdx;
+  double   time;        // Seconds since startTime
+  double   keyRate;     // Total MK/s
+  // Client
+  uint64_t nbQueued;    // DP emitted by the walkers
+  uint64_t nbSent;      // DP acknowledged by the server
+  uint64_t queueDepth;  // dpQueue depth
+  uint64_t nbPacket;
+  double   ackTime;     // Sum of the ack latencies (write to ack read)
+  // Server
+  uint64_t nbRecv;      // DP received
+  uint64_t nbAdded;     // DP inserted in the table
+  uint64_t nbPending;   // DP waiting in recvDP
+  uint64_t nbSave;
+  double   saveTime;    // Duration of the last save
+  double   stallTime;   // ProcessServer blocked by the last save
+  uint64_t nbClient;
+  // Both
+  uint64_t bytesOut;
+  uint64_t bytesIn;
+  uint64_t tableItem;
+  uint64_t tableByte;
+
+} REC_SAMPLE;
+
+// Load generator (-loadgen), counters of a worker thread
+typedef struct {
+
+  uint64_t nbDP;        // DP acknowledged
+  uint64_t nbPacket;    // DP packets acknowledged
+  uint64_t nbDup;       // Duplicate DP injected
+  uint64_t nbColl;      // Colliding DP injected (same x, other distance)
+  uint64_t nbBackup;    // SERVER_BACKUP statuses
+  uint64_t nbConnect;   // Connections, including reconnections
+  uint64_t nbError;     // Failed connections or requests
+  uint64_t nbKangSave;  // Kangaroo files saved
+  uint64_t nbKangLoad;  // Kangaroo files loaded
+  uint64_t kangBytes;   // Kangaroo bytes transferred
+  double   kangTime;    // Time spent saving/loading kangaroos
+  uint64_t bytesOut;    // DP packets written
+  bool     ended;       // SERVER_END received
+
+} LG_STAT;
+
 // Work file type
 #define HEADW  0xFA6A8001  // Full work file
 #define HEADK  0xFA6A8002  // Kangaroo only file
 #define HEADKS 0xFA6A8003  // Compressed Kangaroo only file
+#define HEADJ  0xFA6A8004  // DP journal file
+#define HEADM  0xFA6A8005  // Mapped work file (native ENTRY layout)
+#define HEADKC 0xFA6A8006  // Compressed local kangaroo file (distance + type)
+#define HEADKL 0xFA6A8007  // Multi-key manifest (workfile.keys)
+
+// Key status in multi-key manifest
+#define KEY_PENDING 0
+#define KEY_SOLVED  1
+#define KEY_ABORTED 2
+
+typedef struct {
+
+  uint32_t status;
+  uint64_t count;  // Operations spent on the key
+  double   time;   // Time spent on the key
+
+} KEY_PROGRESS;
+
+// Number of kangaroos rebuilt per ComputePublicKeys() batch
+#define RESTORE_BATCH 16384
+
+// Number of DP verified per batch
+#define CHECK_BATCH 4096
+
+// Number of kangaroos of a thread verified per integrity sample
+#define KCHECK_SAMPLE 16
 
 // Number of Hash entry per partition
 #define H_PER_PART (HASH_SIZE / MERGE_PART)
 
+// Number of buckets serialized per ghMutex hold on save
+#define SERIALIZE_CHUNK 64
+
+// Work file version 2: the version 0 stream is followed by a trailer
+//   bucket offsets (HASH_SIZE * uint64), region crc32 (MERGE_PART * uint32),
+//   WORK_FOOTER (at the end of the file)
+// A region is a partition of H_PER_PART buckets.
+#define WORK_VERSION 2
+#define WORK_MAGIC   0x32574B46  // "FKW2"
+
+typedef struct {
+
+  uint64_t nbItem;    // Number of DP
+  uint64_t nbTame;    // Number of tame DP
+  uint64_t nbWalk;    // Number of kangaroo
+  uint64_t tableEnd;  // End of the hash table (offset of nbWalk)
+  uint64_t indexPos;  // Offset of the bucket offsets
+  uint32_t dpSize;
+  uint32_t magic;
+
+} WORK_FOOTER;
+
+typedef struct {
+
+  std::vector<uint64_t> bucketOffset;
+  std::vector<uint32_t> regionCrc;
+  std::vector<uint64_t> regionTame;
+  uint64_t tableEnd;
+
+} WORK_INDEX;
+
 class Kangaroo {
 
 public:
 
   Kangaroo(Secp256K1 *secp,int32_t initDPSize,bool useGpu,std::string &workFile,std::string &iWorkFile,
            uint32_t savePeriod,bool saveKangaroo,bool saveKangarooByServer,double maxStep,int wtimeout,int sport,int ntimeout,
-           std::string serverIp,std::string outputFile,bool splitWorkfile);
+           std::string serverIp,std::string outputFile,bool splitWorkfile,bool useJournal,
+           bool mapWorkfile,bool prefault,std::string dropDir,bool compressKangaroo,double sampleRate,
+           double quarantineWrong,uint64_t quarantineMin,double quarantineTime,
+           uint64_t kCheckPeriod,std::string pipeStatFile,int metricsPort,std::string recFile);
   void Run(int nbThread,std::vector<int> gpuId,std::vector<int> gridSize);
   void RunServer();
   bool ParseConfigFile(std::string &fileName);
   bool LoadWork(std::string &fileName);
   void Check(std::vector<int> gpuId,std::vector<int> gridSize);
+  void Bench(std::string jsonFile);
+  void BenchTable(uint64_t nbDP,double dupRate,int nbThread,std::string replayFile,std::string jsonFile);
+  void StatSolve(int nbThread,int nbKey,int rangeBits,std::vector<int> dpSizes,std::vector<int> grpSizes,
+                 int nbJumpTable,std::string jsonFile);
+  void LoopBench(int nbClient,int rangeBits,int nbThread,std::string jsonFile);
+  void LoadGen(int nbConn,double dpRate,int nbThread,uint32_t batchSize,double dupRate,double collRate,
+               double stormPeriod,uint64_t nbKang,double duration,std::string jsonFile);
   void MergeDir(std::string& dirname,std::string& dest);
   bool MergeWork(std::string &file1,std::string &file2,std::string &dest,bool printStat=true);
+  bool MergeWorkFiles(std::vector<std::string> &files,std::string &dest,bool printStat);
   void WorkInfo(std::string &fileName);
+  bool RecordDump(std::string &recFile,std::string &csvFile);
   bool MergeWorkPart(std::string& file1,std::string& file2,bool printStat);
   bool MergeWorkPartPart(std::string& part1Name,std::string& part2Name);
   static void CreateEmptyPartWork(std::string& partName);
@@ -152,16 +497,26 @@ public:
   bool MergePartition(TH_PARAM* p);
   bool CheckPartition(TH_PARAM* p);
   bool CheckWorkFile(TH_PARAM* p);
+  bool SerializeTablePart(TH_PARAM* p);
+  bool WriteTablePart(TH_PARAM* p);
+  bool LoadTablePart(TH_PARAM* p);
+  bool MergeRegion(TH_PARAM* p);
   void ProcessServer();
+  void ValidateDP(TH_PARAM *p);
+  void BenchTableAdd(TH_PARAM *p);
   void NetworkThread();
+  void LoadGenThread(TH_PARAM *p);
+  void MetricsServer();
+  void RecordThread();
 
   void AddConnectedClient();
   void RemoveConnectedClient();
-  void RemoveConnectedKangaroo(uint64_t nb);
+  void RemoveConnectedKangaroo(uint32_t clientId,uint64_t nb);
 
 private:
 
   bool IsDP(Int *x);
+  void BenchOp(int op,int size,void *ctx,uint64_t n);
   void SetDP(int size);
   void CreateHerd(int nbKangaroo,Int *px, Int *py, Int *d, int firstType,bool lock=true);
   void CreateJumpTable();
@@ -173,27 +528,72 @@ private:
   bool CheckKey(Int d1,Int d2,uint8_t type);
   bool CollisionCheck(Int* d1, uint32_t type1,Int* d2, uint32_t type2);
   void ComputeExpected(double dp,double *op,double *ram,double* overHead = NULL);
+  int GetSuggestedDP();
   void InitRange();
   void InitSearchKey();
   std::string GetTimeStr(double s);
   bool Output(Int* pk,char sInfo,int sType);
 
   // Backup stuff
-  void SaveWork(std::string fileName,FILE *f,int type,uint64_t totalCount,double totalTime);
+  bool SaveWork(std::string fileName,FILE *f,int type,uint64_t totalCount,double totalTime,bool resetTable=false);
   void SaveWork(uint64_t totalCount,double totalTime,TH_PARAM *threads,int nbThread);
   void SaveServerWork();
+  uint64_t WriteServerWork(std::string &fileName,bool journalSave);
+  void EndServerWork(uint64_t size,double time);
+  void PollServerWork(bool wait);
+  bool SaveTable(FILE *f,bool resetTable);
+  bool SaveMappedTable(FILE *f);
+  bool ReplaceFile(std::string &tmpName,std::string &fileName);
+  void IngestDropDir();
+  bool OpenIngestFile();
+  void CloseIngestFile(const char *ext);
+  bool LoadTable(FILE *f,uint32_t version);
+  void IndexRegion(TH_PARAM *p);
+  bool GetRegionOffsets(FILE *f,uint32_t version,std::vector<uint64_t> &offsets,bool *indexed);
+  void SaveTrailer(FILE *f,uint64_t nbWalk);
+  bool ReadTrailer(FILE *f,WORK_FOOTER *footer,bool readIndex);
+  bool UseJournalSave();
+  uint64_t SaveJournal(std::string &fileName,uint64_t totalCount,double totalTime);
+  void ResetJournal(std::string &fileName);
+  bool LoadJournal(std::string &fileName);
+  uint64_t SaveKangarooFile(std::string &fileName,TH_PARAM *threads,int nbThread);
+  bool SaveKeyManifest(std::string &fileName,uint32_t nextKey);
+  bool LoadKeyManifest(std::string &fileName);
+  uint64_t SaveKangaroos(FILE *f,TH_PARAM *threads,int nbThread);
+  uint64_t SaveCompressedKangaroos(FILE *f,TH_PARAM *threads,int nbThread);
+  bool FetchCompressedKangaroos(TH_PARAM *threads);
+  void RestoreHerd(TH_PARAM *ph,uint64_t nbKangaroo);
   void FetchWalks(uint64_t nbWalk,Int *x,Int *y,Int *d);
   void FetchWalks(uint64_t nbWalk,std::vector<int256_t>& kangs,Int* x,Int* y,Int* d);
   void FectchKangaroos(TH_PARAM *threads);
   FILE *ReadHeader(std::string fileName,uint32_t *version,int type);
-  bool  SaveHeader(std::string fileName,FILE* f,int type,uint64_t totalCount,double totalTime);
+  uint32_t GetFileHead(std::string &fileName);
+  bool  SaveHeader(std::string fileName,FILE* f,int type,uint64_t totalCount,double totalTime,uint32_t version=0);
   int FSeek(FILE *stream,uint64_t pos);
   uint64_t FTell(FILE *stream);
   int IsDir(std::string dirName);
   bool IsEmpty(std::string fileName);
   static std::string GetPartName(std::string& partName,int i,bool tmpPart);
   static FILE* OpenPart(std::string& partName,char* mode,int i,bool tmpPart=false);
-  uint32_t CheckHash(uint32_t h,uint32_t nbItem,HashTable* hT,FILE* f);
+  uint32_t CheckBatch(std::vector<ENTRY> &batch,std::vector<uint8_t> *wrong = NULL);
+  uint32_t CheckKangaroos(TH_PARAM *ph,int nb,Int *px,Int *py,Int *d,uint64_t firstIdx,bool *wrong);
+  uint32_t GetClientId(char *clientInfo);
+  void SampleDP(uint32_t sourceId,DP *dp,uint32_t nbDP,uint64_t *rnd);
+  void PurgeTable();
+  uint32_t GetSourceId(uint32_t clientId,uint32_t processId,uint32_t gpuId);
+  std::string GetSourceName(SOURCE_STAT *ss);
+  void ReleaseSources(double t);
+  void CheckClients(double t);
+  int NextCheckItem();
+  void SavePipeStat(double elapsed);
+  void StartRecorder(int mode);
+  void StopRecorder();
+#ifdef WALK_PROFILE
+  void WalkProfileAdd(WALK_PROF *p,int phase,uint64_t cycles);
+  void WalkProfileInit();
+  void WalkProfilePoll(TH_PARAM *threads,int nbThread);
+  void WalkProfileDump(TH_PARAM *threads,int nbThread);
+#endif
 
 
   // Network stuff
@@ -205,9 +605,14 @@ private:
   bool ConnectToServer(SOCKET *retSock);
   void InitSocket();
   void WaitForServer();
+  bool ReadAcks(int maxPending,int timeout = 0);
   int32_t GetServerStatus();
  bool SendKangaroosToServer(std::string& fileName,std::vector<int256_t>& kangs);
   bool GetKangaroosFromServer(std::string& fileName,std::vector<int256_t>& kangs);
+  bool LoadGenConnect(SOCKET *sock,int threadId);
+  bool LoadGenKangaroos(SOCKET sock,uint32_t connId,bool save,int threadId);
+  void UpdateServerRates(double t);
+  std::string GetMetrics();
 
 #ifdef WIN64
   HANDLE ghMutex;
@@ -227,7 +632,7 @@ private:
   uint64_t getGPUCount();
   bool isAlive(TH_PARAM *p);
   bool hasStarted(TH_PARAM *p);
-  bool isWaiting(TH_PARAM *p);
+  bool isWaiting(TH_PARAM *p,bool waiting=true);
 
   Secp256K1 *secp;
   HashTable hashTable;
@@ -260,6 +665,7 @@ private:
   double maxStep;
   uint64_t totalRW;
 
+  uint32_t jumpSeed;
   Int jumpDistance[NB_JUMP];
   Int jumpPointx[NB_JUMP];
   Int jumpPointy[NB_JUMP];
@@ -278,10 +684,69 @@ private:
   bool saveRequest;
   bool saveKangaroo;
   bool saveKangarooByServer;
+  bool compressKangaroo;             // Save kangaroos as HEADKC
+  bool compressedInput;              // fRead is a HEADKC file
+  std::vector<int256_t> restoreDist; // Loaded HEADKC distances
+  std::vector<uint8_t> restoreType;  // Loaded HEADKC type bitmap
   int wtimeout;
   int ntimeout;
   bool splitWorkfile;
 
+  // DP journal (incremental save)
+  bool useJournal;
+  bool journalReady;
+  std::vector<ENTRY> journal;  // DP added since last save
+  uint64_t journalNbItem;      // DP already in the journal file
+  uint64_t baseNbItem;         // DP in the base work file
+
+  // Multi-key progress (workfile.keys)
+  std::vector<KEY_PROGRESS> keyProgress;
+  uint32_t startKeyIdx;
+
+  // Batched DP check, regions or partitions are handed out on demand
+  std::vector<uint64_t> checkOffsets;
+  bool checkIndexed;
+  uint32_t checkNext;
+  uint32_t checkBad;
+
+  // Work file v2 index (filled by SaveTable)
+  WORK_INDEX workIndex;
+
+  // Mapped work file (instant restart)
+  bool mapWorkfile;
+  bool prefault;
+
+  // Drop directory ingestion (server)
+  std::string dropDir;
+  std::string ingestName;
+  FILE *ingestFile;
+  uint32_t ingestBucket;
+  uint64_t ingestNbDP;
+  uint64_t ingestNbAdded;
+  int ingestProgress;
+  double ingestStart;
+
+  // Sampled DP validation and client accounting (server)
+  double sampleRate;
+  double quarantineWrong;   // Wrong/sampled ratio of a quarantined source
+  uint64_t quarantineMin;   // Sampled DPs before a source can be quarantined
+  double quarantineTime;    // Quarantine duration, 0 = until restart
+  std::map<std::string,uint32_t> clientIds;
+  std::vector<CLIENT_STAT> clientStats;
+  std::map<uint64_t,uint32_t> sourceIds;
+  std::vector<SOURCE_STAT> sourceStats;
+  double lastClientCheck;
+  std::deque<VALIDATE_ITEM> validateQueue;  // Oldest first
+  bool purgeRunning;
+  uint32_t purgeBucket;     // Next bucket to copy to purgeQueue
+  uint64_t purgeNbRemoved;
+  std::deque<PURGE_ITEM> purgeQueue;   // Entries waiting for verification
+  std::vector<PURGE_ITEM> purgeWrong;  // Wrong entries to remove
+  uint32_t purgeInFlight;              // Entries being verified
+
+  // Kangaroo integrity sampling, every kCheckPeriod walk iterations
+  uint64_t kCheckPeriod;
+
   // Network stuff
   int port;
   std::string lastError;
@@ -292,12 +757,47 @@ private:
   bool  clientMode;
   bool  isConnected;
   SOCKET serverConn;
+  std::deque<PENDING_ACK> pendingAck; // Packets waiting for their ack
+  bool serverBackup;               // Last status was SERVER_BACKUP
   std::vector<DP_CACHE> recvDP;
   std::vector<DP_CACHE> localCache;
   std::string serverStatus;
   int connectedClient;
   uint32_t pid;
 
+  // DP pipeline counters (-pstat)
+  PIPE_STAT pipeStat;
+  std::string pipeStatFile;
+
+  // Server metrics endpoint
+  SERVER_STAT serverStat;
+  int metricsPort;
+  int savePid;   // Server save process
+  int savePipe;
+  bool saveSerial; // No thread, set in the save process
+
+  // Flight recorder
+  std::string recFile;
+  int recMode;
+  bool recRunning;
+  volatile bool recStop;
+  THREAD_HANDLE recThread;
+
+  // Load generator (-loadgen)
+  int lgNbConn;
+  double lgRate;                 // DP/s of each worker thread, 0 = unlimited
+  uint32_t lgBatch;
+  double lgDupRate;
+  double lgCollRate;
+  double lgStorm;                // Reconnect storm period (s), 0 = none
+  uint64_t lgNbKang;             // Kangaroos saved/loaded per connection
+  double lgStart;
+  double lgEnd;
+  std::vector<LG_STAT> lgStat;
+  std::vector<std::vector<float> > lgAck;      // SERVER_SENDDP ack latency (ms)
+  std::vector<std::vector<float> > lgStatus;   // SERVER_STATUS round trip (ms)
+  std::vector<std::vector<float> > lgConnect;  // Connection time (ms)
+
   // Async network architecture
   DPQueue dpQueue;
   THREAD_HANDLE networkThreadHandle;
@@ -0,0 +1,295 @@
+/*
+ * This file is part of the BSGS distribution (https://github.com/JeanLucPons/Kangaroo).
+ * Copyright (c) 2020 Jean Luc PONS.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "Log.h"
+#include "Timer.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <errno.h>
+#ifdef WIN64
+#include <windows.h>
+#else
+#include <pthread.h>
+#endif
+
+using namespace std;
+
+#ifdef WIN64
+#define LOG_CAS(p,o,n) (InterlockedCompareExchange((volatile LONG *)(p),(LONG)(n),(LONG)(o)) == (LONG)(o))
+#define LOG_INC(p) ((uint32_t)InterlockedIncrement((volatile LONG *)(p)))
+#define LOG_XCHG(p,v) ((uint32_t)InterlockedExchange((volatile LONG *)(p),(LONG)(v)))
+#define LOG_BARRIER() MemoryBarrier()
+#else
+#define LOG_CAS(p,o,n) __sync_bool_compare_and_swap(p,o,n)
+#define LOG_INC(p) __sync_add_and_fetch(p,1)
+#define LOG_XCHG(p,v) __sync_lock_test_and_set(p,v)
+#define LOG_BARRIER() __sync_synchronize()
+#endif
+
+static const char *levelNames[] = { "error","warn","info","debug","trace" };
+static const char *catNames[] = { "table","server","net","gpu","coll" };
+
+int Log::level[LOGC_NB] = { LOG_INFO,LOG_INFO,LOG_INFO,LOG_INFO,LOG_INFO };
+
+// Sink state. Slot sequence of lap n (pos / LOG_RING_SIZE): 2n when free,
+// 2n+1 when the message is ready, the zero initialised ring is free.
+static LOG_SLOT ring[LOG_RING_SIZE];
+static volatile uint32_t ringHead = 0;  // Next slot to reserve (producers)
+static uint32_t ringTail = 0;           // Next slot to write (flush thread)
+static volatile uint32_t nbDropped = 0;
+static volatile bool running = false;
+static volatile bool stopping = false;
+static FILE *logFile = NULL;
+#ifdef WIN64
+static HANDLE flushThread;
+#else
+static pthread_t flushThread;
+#endif
+
+// ----------------------------------------------------------------------------
+
+int Log::GetLevel(string name) {
+
+  for(int i = 0; i <= LOG_TRACE; i++)
+    if(name == levelNames[i])
+      return i;
+  return -1;
+
+}
+
+int Log::GetCategory(string name) {
+
+  for(int i = 0; i < LOGC_NB; i++)
+    if(name == catNames[i])
+      return i;
+  return -1;
+
+}
+
+// "level" or "cat=level,cat=level,..."
+bool Log::SetLevels(string spec) {
+
+  int maxLevel = 0;
+  size_t pos = 0;
+  while(pos <= spec.length()) {
+
+    size_t end = spec.find(',',pos);
+    if(end == string::npos) end = spec.length();
+    string item = spec.substr(pos,end - pos);
+    size_t eq = item.find('=');
+
+    if(eq == string::npos) {
+      int l = GetLevel(item);
+      if(l < 0) {
+        ::printf("Invalid log level: %s\n",item.c_str());
+        return false;
+      }
+      for(int i = 0; i < LOGC_NB; i++)
+        level[i] = l;
+    } else {
+      int c = GetCategory(item.substr(0,eq));
+      int l = GetLevel(item.substr(eq + 1));
+      if(c < 0 || l < 0) {
+        ::printf("Invalid log setting: %s\n",item.c_str());
+        return false;
+      }
+      level[c] = l;
+    }
+
+    for(int i = 0; i < LOGC_NB; i++)
+      if(level[i] > maxLevel) maxLevel = level[i];
+    pos = end + 1;
+
+  }
+
+  if(maxLevel > LOG_MAX_LEVEL)
+    ::printf("Warning, %s messages are not compiled in (make loglevel=%d)\n",levelNames[maxLevel],maxLevel);
+
+  return true;
+
+}
+
+bool Log::SetFile(string fileName) {
+
+  logFile = fopen(fileName.c_str(),"a");
+  if(logFile == NULL) {
+    ::printf("Cannot open log file %s: %s\n",fileName.c_str(),strerror(errno));
+    return false;
+  }
+  return true;
+
+}
+
+// ----------------------------------------------------------------------------
+
+#define LAP(pos) (2 * ((pos) / LOG_RING_SIZE))
+
+void Log::Write(int cat,int lvl,const char *fmt,...) {
+
+  char buff[LOG_MSG_SIZE];
+  char *msg = buff;
+  uint32_t pos = 0;
+  LOG_SLOT *s = NULL;
+
+  if(running) {
+
+    // Reserve a slot, drop the message when the ring is full
+    pos = ringHead;
+    while(true) {
+      s = &ring[pos & (LOG_RING_SIZE - 1)];
+      int32_t diff = (int32_t)(s->seq - LAP(pos));
+      if(diff == 0) {
+        if(LOG_CAS(&ringHead,pos,pos + 1))
+          break;
+        pos = ringHead;
+      } else if(diff < 0) {
+        LOG_INC(&nbDropped);
+        return;
+      } else {
+        pos = ringHead;
+      }
+    }
+    msg = s->msg;
+
+  }
+
+  int n = snprintf(msg,LOG_MSG_SIZE,"[%.3f][%s %s] ",Timer::get_tick(),catNames[cat],levelNames[lvl]);
+  va_list args;
+  va_start(args,fmt);
+  vsnprintf(msg + n,LOG_MSG_SIZE - n,fmt,args);
+  va_end(args);
+
+  if(s) {
+    LOG_BARRIER();
+    s->seq = LAP(pos) + 1;
+  } else {
+    // Sink not started
+    fprintf(logFile ? logFile : stdout,"%s\n",msg);
+  }
+
+}
+
+// Write ready messages, return the number of messages written
+static int Flush() {
+
+  FILE *f = logFile ? logFile : stdout;
+  int nb = 0;
+
+  while(true) {
+    LOG_SLOT *s = &ring[ringTail & (LOG_RING_SIZE - 1)];
+    if(s->seq != LAP(ringTail) + 1)
+      break;
+    LOG_BARRIER();
+    // Break the status line (\r) before the first message
+    if(nb == 0 && f == stdout) fputc('\n',f);
+    fputs(s->msg,f);
+    fputc('\n',f);
+    LOG_BARRIER();
+    s->seq = LAP(ringTail + LOG_RING_SIZE);
+    ringTail++;
+    nb++;
+  }
+
+  uint32_t dropped = LOG_XCHG(&nbDropped,0);
+  if(dropped) {
+    fprintf(f,"[log] %u message(s) dropped, log ring full\n",dropped);
+    nb++;
+  }
+
+  if(nb) fflush(f);
+  return nb;
+
+}
+
+#ifdef WIN64
+static DWORD WINAPI _flushThread(LPVOID lpParam) {
+#else
+static void *_flushThread(void *lpParam) {
+#endif
+
+  while(true) {
+    if(Flush() == 0) {
+      if(stopping) break;
+      Timer::SleepMillis(10);
+    }
+  }
+  return 0;
+
+}
+
+// At most maxPerSec messages per second, the number of suppressed
+// messages is reported with the first message of the next second
+bool Log::Allow(LOG_LIMIT *l,int maxPerSec,int cat,int lvl) {
+
+  uint32_t now = (uint32_t)Timer::get_tick();
+  uint32_t sec = l->sec;
+  if(sec != now && LOG_CAS(&l->sec,sec,now)) {
+    LOG_XCHG(&l->count,0);
+    uint32_t dropped = LOG_XCHG(&l->dropped,0);
+    if(dropped)
+      Write(cat,lvl,"%u similar message(s) suppressed",dropped);
+  }
+
+  if(LOG_INC(&l->count) <= (uint32_t)maxPerSec)
+    return true;
+  LOG_INC(&l->dropped);
+  return false;
+
+}
+
+// ----------------------------------------------------------------------------
+
+void Log::Start() {
+
+  if(running)
+    return;
+
+  stopping = false;
+#ifdef WIN64
+  DWORD thid;
+  flushThread = CreateThread(NULL,0,_flushThread,NULL,0,&thid);
+  if(flushThread == NULL)
+    return;
+#else
+  if(pthread_create(&flushThread,NULL,&_flushThread,NULL) != 0)
+    return;
+#endif
+  running = true;
+  atexit(Log::Stop);
+
+}
+
+void Log::Stop() {
+
+  if(!running)
+    return;
+
+  stopping = true;
+#ifdef WIN64
+  WaitForSingleObject(flushThread,INFINITE);
+  CloseHandle(flushThread);
+#else
+  pthread_join(flushThread,NULL);
+#endif
+  running = false;
+  // Messages written while the flush thread was exiting
+  Flush();
+  if(logFile) fflush(logFile);
+
+}
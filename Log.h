@@ -0,0 +1,98 @@
+/*
+ * This file is part of the BSGS distribution (https://github.com/JeanLucPons/Kangaroo).
+ * Copyright (c) 2020 Jean Luc PONS.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef LOGH
+#define LOGH
+
+#include <stdint.h>
+#include <string>
+
+// Levels
+#define LOG_ERROR 0
+#define LOG_WARN  1
+#define LOG_INFO  2
+#define LOG_DEBUG 3
+#define LOG_TRACE 4
+
+// Messages above LOG_MAX_LEVEL are compiled out (make loglevel=N)
+#ifndef LOG_MAX_LEVEL
+#define LOG_MAX_LEVEL LOG_DEBUG
+#endif
+
+// Categories
+#define LOGC_TABLE  0   // Hash table
+#define LOGC_SERVER 1   // Server DP processing
+#define LOGC_NET    2   // Client network
+#define LOGC_GPU    3   // GPU threads
+#define LOGC_COLL   4   // Collision check
+#define LOGC_NB     5
+
+#define LOG_MSG_SIZE  256   // Ring slot size (message truncated)
+#define LOG_RING_SIZE 4096  // Must be a power of 2
+
+// Rate limiter of a call site
+typedef struct {
+
+  volatile uint32_t sec;
+  volatile uint32_t count;
+  volatile uint32_t dropped;
+
+} LOG_LIMIT;
+
+// Ring slot
+typedef struct {
+
+  volatile uint32_t seq;
+  char msg[LOG_MSG_SIZE];
+
+} LOG_SLOT;
+
+// Leveled logging. A disabled message costs a compare, a message above
+// LOG_MAX_LEVEL costs nothing (arguments are not evaluated). Enabled
+// messages are formatted into a lock free ring and written by a flush
+// thread, a full ring drops messages instead of blocking the caller.
+class Log {
+
+public:
+
+  static bool SetLevels(std::string spec);
+  static bool SetFile(std::string fileName);
+  static void Start();
+  static void Stop();
+  static void Write(int cat,int level,const char *fmt,...);
+  static bool Allow(LOG_LIMIT *l,int maxPerSec,int cat,int level);
+
+  static int level[LOGC_NB];
+
+private:
+
+  static int GetLevel(std::string name);
+  static int GetCategory(std::string name);
+
+};
+
+#define LOG_ON(cat,lvl) ((lvl) <= LOG_MAX_LEVEL && (lvl) <= Log::level[cat])
+
+#define LOG(cat,lvl,...) \
+  do { if(LOG_ON(cat,lvl)) Log::Write(cat,lvl,__VA_ARGS__); } while(0)
+
+// At most n messages per second from this call site
+#define LOG_RATE(cat,lvl,n,...) \
+  do { if(LOG_ON(cat,lvl)) { static LOG_LIMIT _ll = {0,0,0}; \
+       if(Log::Allow(&_ll,n,cat,lvl)) Log::Write(cat,lvl,__VA_ARGS__); } } while(0)
+
+#endif // LOGH
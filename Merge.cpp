@@ -30,6 +30,73 @@
 
 using namespace std;
 
+// Threaded proc
+#ifdef WIN64
+extern DWORD WINAPI _writeTablePart(LPVOID lpParam);
+#else
+extern void* _writeTablePart(void* lpParam);
+#endif
+
+bool Kangaroo::MergeRegion(TH_PARAM* p) {
+
+  // Merge region [hStart,hStop[ of all inputs into buffer
+  uint64_t size = 0;
+  for(int i = 0; i < p->nbInput; i++)
+    size += p->inputSize[i];
+
+  p->buffer = (uint8_t*)malloc(size);
+  if(p->buffer == NULL) {
+    ::printf("\nMergeWork: Cannot allocate %.1f MB\n",(double)size / (1024.0 * 1024.0));
+    p->bufferSize = 0;
+    return false;
+  }
+
+  vector<uint8_t *> in(p->input,p->input + p->nbInput);
+  uint8_t *bd = p->buffer;
+  uint32_t hDP;
+  uint32_t hDuplicate;
+  uint64_t nbDuplicate = 0;
+  Int d1;
+  uint32_t type1;
+  Int d2;
+  uint32_t type2;
+
+  for(uint32_t h = p->hStart; h < p->hStop && !endOfSearch; h++) {
+
+    int mStatus = HashTable::MergeH(h,p->nbInput,in.data(),&bd,&hDP,&hDuplicate,&d1,&type1,&d2,&type2);
+    if(mStatus == ADD_COLLISION) {
+      LOCK(ghMutex);
+      CollisionCheck(&d1,type1,&d2,type2);
+      UNLOCK(ghMutex);
+    }
+    nbDuplicate += hDuplicate;
+
+  }
+
+  LOCK(ghMutex);
+  collisionInSameHerd += nbDuplicate;
+  UNLOCK(ghMutex);
+
+  p->bufferSize = bd - p->buffer;
+  if(!endOfSearch)
+    IndexRegion(p);
+
+  return true;
+
+}
+
+// Threaded proc
+#ifdef WIN64
+DWORD WINAPI _mergeRegionThread(LPVOID lpParam) {
+#else
+void* _mergeRegionThread(void* lpParam) {
+#endif
+  TH_PARAM* p = (TH_PARAM*)lpParam;
+  p->obj->MergeRegion(p);
+  p->isRunning = false;
+  return 0;
+}
+
 bool Kangaroo::MergeWork(std::string& file1,std::string& file2,std::string& dest,bool printStat) {
 
   if(IsDir(file1) && IsDir(file2)) {
@@ -40,6 +107,30 @@ bool Kangaroo::MergeWork(std::string& file1,std::string& file2,std::string& dest
     return MergeWorkPart(file1,file2,true);
   }
 
+  vector<string> files;
+  files.push_back(file1);
+  files.push_back(file2);
+  return MergeWorkFiles(files,dest,printStat);
+
+}
+
+// Input of a k-way merge
+typedef struct {
+
+  std::string name;
+  FILE *f;
+  uint32_t version;
+  uint32_t dp;
+  uint64_t count;
+  double time;
+  bool indexed;
+  std::vector<uint64_t> offsets;
+  std::vector<uint32_t> crc;
+
+} MERGE_INPUT;
+
+bool Kangaroo::MergeWorkFiles(std::vector<std::string>& files,std::string& dest,bool printStat) {
+
   if(dest.length()==0) {
     ::printf("MergeWork: destination argument missing\n");
     return true;
@@ -47,104 +138,96 @@ bool Kangaroo::MergeWork(std::string& file1,std::string& file2,std::string& dest
 
   double t0;
   double t1;
-  uint32_t v1;
-  uint32_t v2;
 
   t0 = Timer::get_tick();
 
   // ---------------------------------------------------
-  FILE* f1 = ReadHeader(file1,&v1,HEADW);
-  if(f1 == NULL)
-    return false;
+  // Check all headers before merging, incompatible files are skipped
 
-  uint32_t dp1;
+  vector<MERGE_INPUT> inputs;
   Point k1;
-  uint64_t count1;
-  double time1;
   Int RS1;
   Int RE1;
+  uint64_t totalCount = 0;
+  double totalTime = 0;
+  uint32_t dpMin = 0;
+
+  for(int i = 0; i < (int)files.size(); i++) {
+
+    MERGE_INPUT in;
+    in.name = files[i];
+    in.f = ReadHeader(in.name,&in.version,HEADW);
+    if(in.f == NULL)
+      continue;
+
+    Point k;
+    Int RS;
+    Int RE;
+
+    // Read global param
+    ::fread(&in.dp,sizeof(uint32_t),1,in.f);
+    ::fread(&RS.bits64,32,1,in.f); RS.bits64[4] = 0;
+    ::fread(&RE.bits64,32,1,in.f); RE.bits64[4] = 0;
+    ::fread(&k.x.bits64,32,1,in.f); k.x.bits64[4] = 0;
+    ::fread(&k.y.bits64,32,1,in.f); k.y.bits64[4] = 0;
+    ::fread(&in.count,sizeof(uint64_t),1,in.f);
+    ::fread(&in.time,sizeof(double),1,in.f);
+
+    bool ok = true;
+    k.z.SetInt32(1);
+    if(in.version > WORK_VERSION) {
+      ::printf("MergeWork: %s unknown version, skipped\n",in.name.c_str());
+      ok = false;
+    } else if(!secp->EC(k)) {
+      ::printf("MergeWork: key of %s does not lie on elliptic curve, skipped\n",in.name.c_str());
+      ok = false;
+    } else if(inputs.size() > 0 && (!RS1.IsEqual(&RS) || !RE1.IsEqual(&RE))) {
+      ::printf("MergeWork: %s range differs, skipped\n",in.name.c_str());
+      ::printf("RS1: %s\n",RS1.GetBase16().c_str());
+      ::printf("RE1: %s\n",RE1.GetBase16().c_str());
+      ::printf("RS2: %s\n",RS.GetBase16().c_str());
+      ::printf("RE2: %s\n",RE.GetBase16().c_str());
+      ok = false;
+    } else if(inputs.size() > 0 && !k1.equals(k)) {
+      ::printf("MergeWork: %s key differs, multiple keys not yet supported, skipped\n",in.name.c_str());
+      ok = false;
+    } else if(!GetRegionOffsets(in.f,in.version,in.offsets,&in.indexed)) {
+      ::printf("MergeWork: %s is truncated, skipped\n",in.name.c_str());
+      ok = false;
+    }
 
-  // Read global param
-  ::fread(&dp1,sizeof(uint32_t),1,f1);
-  ::fread(&RS1.bits64,32,1,f1); RS1.bits64[4] = 0;
-  ::fread(&RE1.bits64,32,1,f1); RE1.bits64[4] = 0;
-  ::fread(&k1.x.bits64,32,1,f1); k1.x.bits64[4] = 0;
-  ::fread(&k1.y.bits64,32,1,f1); k1.y.bits64[4] = 0;
-  ::fread(&count1,sizeof(uint64_t),1,f1);
-  ::fread(&time1,sizeof(double),1,f1);
-
-  k1.z.SetInt32(1);
-  if(!secp->EC(k1)) {
-    ::printf("MergeWork: key1 does not lie on elliptic curve\n");
-    fclose(f1);
-    return true;
-  }
-
-
-  // ---------------------------------------------------
-
-  FILE* f2 = ReadHeader(file2,&v2,HEADW);
-  if(f2 == NULL) {
-    fclose(f1);
-    return true;
-  }
-
-  uint32_t dp2;
-  Point k2;
-  uint64_t count2;
-  double time2;
-  Int RS2;
-  Int RE2;
-
-  // Read global param
-  ::fread(&dp2,sizeof(uint32_t),1,f2);
-  ::fread(&RS2.bits64,32,1,f2); RS2.bits64[4] = 0;
-  ::fread(&RE2.bits64,32,1,f2); RE2.bits64[4] = 0;
-  ::fread(&k2.x.bits64,32,1,f2); k2.x.bits64[4] = 0;
-  ::fread(&k2.y.bits64,32,1,f2); k2.y.bits64[4] = 0;
-  ::fread(&count2,sizeof(uint64_t),1,f2);
-  ::fread(&time2,sizeof(double),1,f2);
-
-  if(v1 != v2) {
-    ::printf("MergeWork: cannot merge workfile of different version\n");
-    fclose(f1);
-    fclose(f2);
-    return true;
-  }
+    if(!ok) {
+      fclose(in.f);
+      continue;
+    }
 
-  k2.z.SetInt32(1);
-  if(!secp->EC(k2)) {
-    ::printf("MergeWork: key2 does not lie on elliptic curve\n");
-    fclose(f1);
-    fclose(f2);
-    return true;
-  }
+    if(in.indexed)
+      in.crc = workIndex.regionCrc;
+    FSeek(in.f,in.offsets[0]);
 
-  if(!RS1.IsEqual(&RS2) || !RE1.IsEqual(&RE2)) {
+    if(inputs.size() == 0) {
+      k1 = k;
+      RS1.Set(&RS);
+      RE1.Set(&RE);
+      dpMin = in.dp;
+    }
+    if(in.dp < dpMin) dpMin = in.dp;
+    totalCount += in.count;
+    totalTime += in.time;
 
-    ::printf("MergeWork: File range differs\n");
-    ::printf("RS1: %s\n",RS1.GetBase16().c_str());
-    ::printf("RE1: %s\n",RE1.GetBase16().c_str());
-    ::printf("RS2: %s\n",RS2.GetBase16().c_str());
-    ::printf("RE2: %s\n",RE2.GetBase16().c_str());
-    fclose(f1);
-    fclose(f2);
-    return true;
+    ::printf("File %s: [DP%d]\n",in.name.c_str(),in.dp);
+    inputs.push_back(in);
 
   }
 
-  if(!k1.equals(k2)) {
-
-    ::printf("MergeWork: key differs, multiple keys not yet supported\n");
-    fclose(f1);
-    fclose(f2);
+  int nbIn = (int)inputs.size();
+  if(nbIn < 2) {
+    ::printf("MergeWork: less than 2 valid work files\n");
+    for(int i = 0; i < nbIn; i++)
+      fclose(inputs[i].f);
     return true;
-
   }
 
-  ::printf("File %s: [DP%d]\n",file1.c_str(),dp1);
-  ::printf("File %s: [DP%d]\n",file2.c_str(),dp2);
-
   endOfSearch = false;
 
   // Set starting parameters
@@ -171,47 +254,159 @@ bool Kangaroo::MergeWork(std::string& file1,std::string& file2,std::string& dest
   if(f == NULL) {
     ::printf("\nMergeWork: Cannot open %s for writing\n",tmpName.c_str());
     ::printf("%s\n",::strerror(errno));
-    fclose(f1);
-    fclose(f2);
+    for(int i = 0; i < nbIn; i++)
+      fclose(inputs[i].f);
     return true;
   }
-  dpSize = (dp1 < dp2) ? dp1 : dp2;
-  if( !SaveHeader(tmpName,f,HEADW,count1 + count2,time1 + time2) ) {
-    fclose(f1);
-    fclose(f2);
+  dpSize = dpMin;
+  if( !SaveHeader(tmpName,f,HEADW,totalCount,totalTime,WORK_VERSION) ) {
+    for(int i = 0; i < nbIn; i++)
+      fclose(inputs[i].f);
     fclose(f);
     return true;
   }
 
-  uint64_t nbDP = 0;
-  uint32_t hDP;
-  uint32_t hDuplicate;
-  Int d1;
-  uint32_t type1;
-  Int d2;
-  uint32_t type2;
+  int nbThread = Timer::getCoreNumber();
+  if(nbThread > MERGE_PART) nbThread = MERGE_PART;
+#ifdef WIN64
+  // No pwrite(), regions are written in order by the calling thread
+  nbThread = 1;
+#endif
 
-  for(uint32_t h=0;h<HASH_SIZE && !endOfSearch;h++) {
+  workIndex.bucketOffset.resize(HASH_SIZE);
+  workIndex.regionCrc.resize(MERGE_PART);
+  workIndex.regionTame.resize(MERGE_PART);
+
+  TH_PARAM* params = (TH_PARAM*)malloc(nbThread * sizeof(TH_PARAM));
+  THREAD_HANDLE* thHandles = (THREAD_HANDLE*)malloc(nbThread * sizeof(THREAD_HANDLE));
+  memset(params,0,nbThread * sizeof(TH_PARAM));
+  for(int i = 0; i < nbThread; i++) {
+    params[i].nbInput = nbIn;
+    params[i].input = (uint8_t **)calloc(nbIn,sizeof(uint8_t *));
+    params[i].inputSize = (uint64_t *)calloc(nbIn,sizeof(uint64_t));
+  }
 
-    if(h % (HASH_SIZE / 64) == 0) ::printf(".");
+  ::fflush(f);
+  uint64_t offset = FTell(f);
+  bool ok = true;
+
+  // Single pass: each input is read sequentially region by region, regions
+  // are merged concurrently into per thread output buffers and written at
+  // their offset in the destination file. Regions of a round are limited
+  // to MERGE_BUFFER bytes of input (at least one region), the output
+  // buffers take about as much.
+  int n;
+  for(int p = 0; p < MERGE_PART && ok && !endOfSearch; p += n) {
+
+    uint64_t roundSize = 0;
+    for(n = 0; n < nbThread && p + n < MERGE_PART; n++) {
+      uint64_t size = 0;
+      for(int j = 0; j < nbIn; j++)
+        size += inputs[j].offsets[p + n + 1] - inputs[j].offsets[p + n];
+      if(n > 0 && roundSize + size > (uint64_t)MERGE_BUFFER)
+        break;
+      roundSize += size;
+    }
 
-    int mStatus = HashTable::MergeH(h,f1,f2,f,&hDP,&hDuplicate,&d1,&type1,&d2,&type2);
-    switch(mStatus) {
-      case ADD_OK:
-      break;
-      case ADD_COLLISION:
-      CollisionCheck(&d1,type1,&d2,type2);
-      break;
+    for(int i = 0; i < n && ok; i++) {
+      int r = p + i;
+      params[i].threadId = i;
+      params[i].isRunning = true;
+      params[i].hStart = r * H_PER_PART;
+      params[i].hStop = (r + 1) * H_PER_PART;
+      for(int j = 0; j < nbIn && ok; j++) {
+        MERGE_INPUT *in = &inputs[j];
+        uint64_t size = in->offsets[r + 1] - in->offsets[r];
+        params[i].inputSize[j] = size;
+        params[i].input[j] = (uint8_t*)malloc(size);
+        if(params[i].input[j] == NULL) {
+          ::printf("\nMergeWork: Cannot allocate %.1f MB\n",(double)size / (1024.0 * 1024.0));
+          ok = false;
+        } else if(::fread(params[i].input[j],1,size,in->f) != size) {
+          ::printf("\nMergeWork: Read error in region %d of %s\n",r,in->name.c_str());
+          ok = false;
+        } else if(in->indexed && HashTable::Crc32(params[i].input[j],size) != in->crc[r]) {
+          ::printf("\nMergeWork: Checksum error in region %d of %s\n",r,in->name.c_str());
+          ok = false;
+        }
+      }
     }
 
-    nbDP += hDP;
-    collisionInSameHerd += hDuplicate;
+    if(ok) {
+      if(n > 1) {
+        for(int i = 0; i < n; i++)
+          thHandles[i] = LaunchThread(_mergeRegionThread,params + i);
+        JoinThreads(thHandles,n);
+        FreeHandles(thHandles,n);
+      } else {
+        MergeRegion(params);
+      }
+      for(int i = 0; i < n; i++)
+        ok = ok && (params[i].buffer != NULL);
+    }
 
+    if(ok && !endOfSearch) {
+      for(int i = 0; i < n; i++) {
+        params[i].isRunning = true;
+        params[i].f = f;
+        params[i].fOffset = offset;
+        offset += params[i].bufferSize;
+        for(uint32_t h = params[i].hStart; h < params[i].hStop; h++)
+          workIndex.bucketOffset[h] += params[i].fOffset;
+        if(n > 1) {
+          thHandles[i] = LaunchThread(_writeTablePart,params + i);
+        } else if(::fwrite(params[i].buffer,1,params[i].bufferSize,f) != params[i].bufferSize) {
+          ::printf("\nMergeWork: Write error at %.0f: %s\n",(double)params[i].fOffset,::strerror(errno));
+          params[i].bufferSize = 0;
+        }
+      }
+      if(n > 1) {
+        JoinThreads(thHandles,n);
+        FreeHandles(thHandles,n);
+      }
+      for(int i = 0; i < n; i++)
+        ok = ok && (params[i].bufferSize > 0);
+    }
+
+    for(int i = 0; i < n; i++) {
+      safe_free(params[i].buffer);
+      for(int j = 0; j < nbIn; j++)
+        safe_free(params[i].input[j]);
+    }
+
+    for(int d = (p * 64) / MERGE_PART; d < ((p + n) * 64) / MERGE_PART; d++)
+      ::printf(".");
+
+  }
+
+  for(int i = 0; i < nbThread; i++) {
+    free(params[i].input);
+    free(params[i].inputSize);
   }
+  free(params);
+  free(thHandles);
 
-  fclose(f1);
-  fclose(f2);
-  fclose(f);
+  uint64_t nbDP = 0;
+  if(ok && !endOfSearch) {
+    // Merged file has no kangaroo
+    uint64_t totalWalk = 0;
+    FSeek(f,offset);
+    workIndex.tableEnd = offset;
+    ::fwrite(&totalWalk,sizeof(uint64_t),1,f);
+    SaveTrailer(f,totalWalk);
+    nbDP = (offset - workIndex.bucketOffset[0] - 2 * sizeof(uint32_t) * HASH_SIZE) / ENTRY_FILE_SIZE;
+  }
+
+  for(int i = 0; i < nbIn; i++)
+    fclose(inputs[i].f);
+  ok = ok && !ferror(f);
+  ok = (fclose(f) == 0) && ok;
+
+  if(!ok) {
+    ::printf("\nMergeWork: %s failed, %s is not written\n",tmpName.c_str(),dest.c_str());
+    remove(tmpName.c_str());
+    return true;
+  }
 
   t1 = Timer::get_tick();
 
@@ -235,10 +430,10 @@ bool Kangaroo::MergeWork(std::string& file1,std::string& file2,std::string& dest
 #else
     ::printf("Dead kangaroo: %" PRId64 "\n",collisionInSameHerd);
 #endif
-    ::printf("Total f1+f2: DP count 2^%.2f\n",log2((double)nbDP));
+    ::printf("Total: DP count 2^%.2f\n",log2((double)nbDP));
   } else {
-    offsetTime = time1 + time2;
-    offsetCount = count1 + count2;
+    offsetTime = totalTime;
+    offsetCount = totalCount;
   }
 
   return false;
@@ -326,21 +521,188 @@ void Kangaroo::MergeDir(std::string& dirName,std::string& dest) {
 
   } else {
 
-    // Standard merge
+    // Standard merge, all files in a single pass
     if(listFiles.size() < 2) {
       ::printf("MergeDir: less than 2 work files in the directory\n");
       return;
     }
 
-    int i = 0;
-    ::printf("\n## File #1/%d\n",lgth - 1);
-    bool end = MergeWork(listFiles[0].name,listFiles[1].name,dest,lgth == 2);
-    for(int i = 2; i < lgth && !end; i++) {
-      ::printf("\n## File #%d/%d\n",i,lgth - 1);
-      end = MergeWork(dest,listFiles[i].name,dest,i == lgth - 1);
-    }
+    vector<string> files;
+    for(int i = 0; i < lgth; i++)
+      files.push_back(listFiles[i].name);
+    MergeWorkFiles(files,dest,true);
 
   }
 
  
 }
+
+// ----------------------------------------------------------------------------
+// Drop directory ingestion (server)
+// Work files moved (renamed) into the drop directory are added to the live
+// table through AddToTable(), a time slice per ProcessServer() loop so that
+// incoming DPs are still processed. Ingested files are renamed to .done,
+// incompatible ones to .rejected. Hidden and .tmp files are ignored.
+
+static bool EndsWith(const string &s,const char *ext) {
+  size_t l = strlen(ext);
+  return s.length() >= l && s.compare(s.length() - l,l,ext) == 0;
+}
+
+static bool IsIngestCandidate(const string &name) {
+  return name.length() > 0 && name[0] != '.' &&
+         !EndsWith(name,".done") && !EndsWith(name,".rejected") && !EndsWith(name,".tmp");
+}
+
+bool Kangaroo::OpenIngestFile() {
+
+  vector<string> names;
+
+#ifdef WIN64
+  WIN32_FIND_DATA ffd;
+  HANDLE hFind = FindFirstFile((dropDir + string("\\*")).c_str(),&ffd);
+  if(hFind == INVALID_HANDLE_VALUE)
+    return false;
+  do {
+    if((ffd.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) == 0 && IsIngestCandidate(string(ffd.cFileName)))
+      names.push_back(dropDir + string("\\") + string(ffd.cFileName));
+  } while(FindNextFile(hFind,&ffd) != 0);
+  FindClose(hFind);
+#else
+  DIR *dir = opendir(dropDir.c_str());
+  if(dir == NULL)
+    return false;
+  struct dirent *ent;
+  while((ent = readdir(dir)) != NULL) {
+    if(ent->d_type == DT_REG && IsIngestCandidate(string(ent->d_name)))
+      names.push_back(dropDir + "/" + string(ent->d_name));
+  }
+  closedir(dir);
+#endif
+
+  if(names.size() == 0)
+    return false;
+  std::sort(names.begin(),names.end());
+
+  ingestName = names[0];
+  ::printf("\n[Ingest] %s\n",ingestName.c_str());
+
+  uint32_t version;
+  ingestFile = ReadHeader(ingestName,&version,HEADW);
+  if(ingestFile == NULL) {
+    CloseIngestFile(".rejected");
+    return false;
+  }
+
+  uint32_t dp;
+  Point key;
+  Int RS;
+  Int RE;
+  uint64_t count;
+  double time;
+  ::fread(&dp,sizeof(uint32_t),1,ingestFile);
+  ::fread(&RS.bits64,32,1,ingestFile); RS.bits64[4] = 0;
+  ::fread(&RE.bits64,32,1,ingestFile); RE.bits64[4] = 0;
+  ::fread(&key.x.bits64,32,1,ingestFile); key.x.bits64[4] = 0;
+  ::fread(&key.y.bits64,32,1,ingestFile); key.y.bits64[4] = 0;
+  ::fread(&count,sizeof(uint64_t),1,ingestFile);
+  ::fread(&time,sizeof(double),1,ingestFile);
+
+  if(version > WORK_VERSION) {
+    ::printf("[Ingest] Unknown version %d, rejected\n",version);
+    CloseIngestFile(".rejected");
+    return false;
+  }
+  if(!RS.IsEqual(&rangeStart) || !RE.IsEqual(&rangeEnd)) {
+    ::printf("[Ingest] Range differs, rejected\n");
+    CloseIngestFile(".rejected");
+    return false;
+  }
+  if(!key.x.IsEqual(&keysToSearch[keyIdx].x) || !key.y.IsEqual(&keysToSearch[keyIdx].y)) {
+    ::printf("[Ingest] Key differs, rejected\n");
+    CloseIngestFile(".rejected");
+    return false;
+  }
+  if(dp != dpSize)
+    ::printf("[Ingest] Warning: file has DP%d, server uses DP%d\n",dp,dpSize);
+
+  ingestBucket = 0;
+  ingestNbDP = 0;
+  ingestNbAdded = 0;
+  ingestProgress = 0;
+  ingestStart = Timer::get_tick();
+  return true;
+
+}
+
+void Kangaroo::CloseIngestFile(const char *ext) {
+
+  if(ingestFile) {
+    fclose(ingestFile);
+    ingestFile = NULL;
+  }
+  string newName = ingestName + ext;
+  remove(newName.c_str());
+  if(rename(ingestName.c_str(),newName.c_str()) != 0) {
+    ::printf("[Ingest] Cannot rename %s, removing it\n",ingestName.c_str());
+    remove(ingestName.c_str());
+  }
+
+}
+
+void Kangaroo::IngestDropDir() {
+
+  if(ingestFile == NULL && !OpenIngestFile())
+    return;
+
+  // Time slice, leave the remaining of the loop period to network DPs
+  double t0 = Timer::get_tick();
+  vector<uint8_t> buff;
+
+  while(ingestBucket < HASH_SIZE && !endOfSearch && (Timer::get_tick() - t0) < SEND_PERIOD / 2.0) {
+
+    uint32_t nbItem[2];
+    if(::fread(nbItem,sizeof(uint32_t),2,ingestFile) != 2) {
+      ::printf("\n[Ingest] %s: unexpected end of file at bucket %d, rejected\n",ingestName.c_str(),ingestBucket);
+      CloseIngestFile(".rejected");
+      return;
+    }
+    if(nbItem[0] > 0) {
+      buff.resize((size_t)ENTRY_FILE_SIZE * nbItem[0]);
+      if(::fread(buff.data(),ENTRY_FILE_SIZE,nbItem[0],ingestFile) != nbItem[0]) {
+        ::printf("\n[Ingest] %s: unexpected end of file at bucket %d, rejected\n",ingestName.c_str(),ingestBucket);
+        CloseIngestFile(".rejected");
+        return;
+      }
+      for(uint32_t i = 0; i < nbItem[0] && !endOfSearch; i++) {
+        int256_t x;
+        int256_t d;
+        uint32_t kType;
+        uint8_t *e = buff.data() + (size_t)ENTRY_FILE_SIZE * i;
+        memcpy(&x,e,32);
+        memcpy(&d,e + 32,32);
+        memcpy(&kType,e + 64,4);
+        // Same path as network DPs, DPs already known are not counted
+        // as dead kangaroos
+        if(AddToTable(&x,&d,kType))
+          ingestNbAdded++;
+      }
+      ingestNbDP += nbItem[0];
+    }
+    ingestBucket++;
+
+  }
+
+  int progress = (int)(((uint64_t)ingestBucket * 10) / HASH_SIZE);
+  if(progress > ingestProgress && ingestBucket < HASH_SIZE) {
+    ingestProgress = progress;
+    ::printf("\n[Ingest] %s: %d%% [%.0f DP]\n",ingestName.c_str(),progress * 10,(double)ingestNbDP);
+  }
+
+  if(ingestBucket == HASH_SIZE) {
+    ::printf("\n[Ingest] %s: done [%.0f DP, %.0f new] [%s]\n",ingestName.c_str(),(double)ingestNbDP,
+             (double)ingestNbAdded,GetTimeStr(Timer::get_tick() - ingestStart).c_str());
+    CloseIngestFile(".done");
+  }
+
+}
@@ -19,6 +19,7 @@
 #include <fstream>
 #include "SECPK1/IntGroup.h"
 #include "Timer.h"
+#include "Log.h"
 #include <string.h>
 #define _USE_MATH_DEFINES
 #include <math.h>
@@ -26,6 +27,7 @@
 #include <signal.h>
 #ifndef WIN64
 #include <pthread.h>
+#include <poll.h>
 #else
 #include "WindowsErrors.h"
 #endif
@@ -119,10 +121,13 @@ void sig_handler(int signo) {
 
 int Kangaroo::WaitFor(SOCKET sock,int timeout,int mode) {
 
+  int result;
+
+#ifdef WIN64
+
   fd_set fdset;
   fd_set *rd = NULL,*wr = NULL;
   struct timeval tmout;
-  int result;
 
   FD_ZERO(&fdset);
   FD_SET(sock,&fdset);
@@ -136,10 +141,20 @@ int Kangaroo::WaitFor(SOCKET sock,int timeout,int mode) {
 
   do
     result = select((int)sock + 1,rd,wr,NULL,&tmout);
-#ifdef WIN64
   while(result < 0 && WSAGetLastError() == WSAEINTR);
+
 #else
+
+  // poll() has no FD_SETSIZE limit on the socket number (thousands of connections)
+  struct pollfd pfd;
+  pfd.fd = sock;
+  pfd.events = (mode == WAIT_FOR_READ) ? POLLIN : POLLOUT;
+  pfd.revents = 0;
+
+  do
+    result = poll(&pfd,1,timeout);
   while(result < 0 && errno == EINTR);
+
 #endif
 
   if(result == 0) {
@@ -292,6 +307,12 @@ bool Kangaroo::HandleRequest(TH_PARAM *p) {
   int nbRead;
   int nbWrite;
   int32_t state;
+  uint32_t clientId = GetClientId(p->clientInfo);
+  p->clientId = clientId;
+  LOCK(ghMutex);
+  clientStats[clientId].nbConnection++;
+  UNLOCK(ghMutex);
+  uint64_t rnd = ((uint64_t)Timer::getSeed32() << 32) | (uint64_t)(clientId + 1);
 
   while( p->isRunning ) {
 
@@ -323,6 +344,9 @@ bool Kangaroo::HandleRequest(TH_PARAM *p) {
     case SERVER_SETKNB: {
       GET("nbKangaroo",p->clientSock,&p->nbKangaroo,sizeof(uint64_t),ntimeout);
       totalRW += p->nbKangaroo;
+      LOCK(ghMutex);
+      clientStats[clientId].nbKangaroo += p->nbKangaroo;
+      UNLOCK(ghMutex);
     } break;
 
     // ----------------------------------------------------------------------------------------
@@ -556,55 +580,63 @@ bool Kangaroo::HandleRequest(TH_PARAM *p) {
 
         } else {
 
-//#define VALIDITY_POINT_CHECK
-#ifdef VALIDITY_POINT_CHECK
-          // Check validity
-          for(uint32_t i=0;i< head.nbDP;i++) {
-            
-            uint64_t h = (uint64_t)dp[i].h;
-            if(h >= HASH_SIZE) {
-              ::printf("\nInvalid data from: %s [dp=%d PID=%u thId=%u gpuId=%u]\n",p->clientInfo,i,
-                                                            head.processId,head.threadId,head.gpuId);
-              free(dp);
-              CLIENT_ABORT();
-            }
-
-            Int dist;
-            uint32_t kType;
-            HashTable::CalcDistAndType(dp[i].d,&dist,&kType);
-            Point P = secp->ComputePublicKey(&dist);
-
-            if(kType == WILD)
-              P = secp->AddDirect(keyToSearch,P);
-            
-	    uint32_t hC = dp[i].h & HASH_MASK;
-            bool ok = (hC == h) && (P.x.bits64[0] == dp[i].x.i64[0]) && (P.x.bits64[1] == dp[i].x.i64[1]) &&
-		    (P.x.bits64[2] == dp[i].x.i64[2]) && (P.x.bits64[3] == dp[i].x.i64[3]);
-            if(!ok) {
-              if(kType==TAME) {
-                ::printf("\nWrong TAME point from: %s [dp=%d PID=%u thId=%u gpuId=%u]\n",p->clientInfo,i,
-                  head.processId,head.threadId,head.gpuId);
-              } else {
-                ::printf("\nWrong WILD point from: %s [dp=%d PID=%u thId=%u gpuId=%u]\n",p->clientInfo,i,
-                  head.processId,head.threadId,head.gpuId);
-              }
-              //::printf("X=%s\n",P.x.GetBase16().c_str());
-              //::printf("X=%08X%08X%08X%08X\n",dp[i].x.i32[3],dp[i].x.i32[2],dp[i].x.i32[1],dp[i].x.i32[0]);
-              //::printf("D=%08X%08X%08X%08X\n",dp[i].d.i32[3],dp[i].d.i32[2],dp[i].d.i32[1],dp[i].d.i32[0]);
-              free(dp);
-              CLIENT_ABORT();
-            }
+          LOCK(ghMutex);
+          uint32_t sourceId = GetSourceId(clientId,head.processId,head.gpuId);
+          UNLOCK(ghMutex);
 
+          // Verify a random sample in background, before the DPs are
+          // handed to the table (and freed)
+          if(sampleRate > 0.0)
+            SampleDP(sourceId,dp,head.nbDP,&rnd);
+
+          // Points that are not DPs at the server DP size, kangaroo
+          // indexes beyond the declared kangaroos
+          uint64_t nbNotDP = 0;
+          uint64_t nbBadIdx = 0;
+          for(uint32_t i = 0; i < head.nbDP; i++) {
+            if((dp[i].x.i64[3] & dMask.i64[3]) | (dp[i].x.i64[2] & dMask.i64[2]) |
+               (dp[i].x.i64[1] & dMask.i64[1]) | (dp[i].x.i64[0] & dMask.i64[0]))
+              nbNotDP++;
+            if(p->nbKangaroo > 0 && dp[i].kIdx >= p->nbKangaroo)
+              nbBadIdx++;
           }
-#endif
+          uint64_t nbByte = 1 + sizeof(DPHEADER) + sizeof(DP) * head.nbDP;
 
           LOCK(ghMutex);
-          DP_CACHE dc;
-          dc.nbDP = head.nbDP;
-          dc.dp = dp;
-          recvDP.push_back(dc);
+          pipeStat.nbRecv += head.nbDP;
+          pipeStat.bytesIn += nbByte;
+          pipeStat.bytesOut += sizeof(int32_t);
+          CLIENT_STAT *cs = &clientStats[clientId];
+          cs->nbByte += nbByte;
+          cs->nbNotDP += nbNotDP;
+          cs->nbBadIdx += nbBadIdx;
+          cs->lastDPTime = Timer::get_tick();
+          SOURCE_STAT *ss = &sourceStats[sourceId];
+          ss->nbByte += nbByte;
+          bool quarantined = ss->quarantined;
+          if(quarantined) {
+            cs->nbRejected += head.nbDP;
+            ss->nbRejected += head.nbDP;
+          } else {
+            cs->nbDP += head.nbDP;
+            ss->nbDP += head.nbDP;
+            pipeStat.nbPending += head.nbDP;
+            if(pipeStat.nbPending > pipeStat.maxPending)
+              pipeStat.maxPending = pipeStat.nbPending;
+            DP_CACHE dc;
+            dc.nbDP = head.nbDP;
+            dc.dp = dp;
+            dc.clientId = clientId;
+            dc.sourceId = sourceId;
+            recvDP.push_back(dc);
+          }
           UNLOCK(ghMutex);
 
+          if(quarantined) {
+            free(dp);
+            CLIENT_ABORT();
+          }
+
         }
 
       }
@@ -624,6 +656,247 @@ bool Kangaroo::HandleRequest(TH_PARAM *p) {
 
 }
 
+// ----------------------------------------------------------------------------
+// Sampled DP validation
+// Connection threads copy a random sample of the received DPs to a queue
+// which is verified in background by batches. A DP source (process and GPU
+// of a client host) sending more than quarantineWrong wrong DPs is
+// quarantined: its pending and future DPs are dropped until its release and
+// the table is purged of wrong DPs. ProcessServer copies the table, bucket by
+// bucket, to the validators and removes the wrong DPs they report.
+
+uint32_t Kangaroo::GetClientId(char *clientInfo) {
+
+  string host(clientInfo);
+  size_t pos = host.find(':');
+  if(pos != string::npos)
+    host = host.substr(0,pos);
+
+  LOCK(ghMutex);
+  uint32_t id;
+  std::map<string,uint32_t>::iterator it = clientIds.find(host);
+  if(it == clientIds.end()) {
+    CLIENT_STAT cs;
+    cs.host = host;
+    cs.nbDP = 0;
+    cs.nbSampled = 0;
+    cs.nbWrong = 0;
+    cs.nbRejected = 0;
+    cs.nbQuarantined = 0;
+    cs.lastNbDP = 0;
+    cs.dpRate = 0.0;
+    cs.nbKangaroo = 0;
+    cs.nbConnection = 0;
+    cs.nbByte = 0;
+    cs.nbDuplicate = 0;
+    cs.nbDead = 0;
+    cs.nbTame = 0;
+    cs.nbWild = 0;
+    cs.nbNotDP = 0;
+    cs.nbBadIdx = 0;
+    cs.firstTime = Timer::get_tick();
+    cs.lastDPTime = 0.0;
+    cs.checkNbDP = 0;
+    cs.checkTime = cs.firstTime;
+    cs.walkRate = 0.0;
+    cs.anomaly = 0;
+    id = (uint32_t)clientStats.size();
+    clientStats.push_back(cs);
+    clientIds[host] = id;
+  } else {
+    id = it->second;
+  }
+  UNLOCK(ghMutex);
+
+  return id;
+
+}
+
+void Kangaroo::SampleDP(uint32_t sourceId,DP *dp,uint32_t nbDP,uint64_t *rnd) {
+
+  vector<VALIDATE_ITEM> items;
+  uint64_t threshold = (uint64_t)(sampleRate * 4294967296.0);
+  uint64_t r = *rnd;
+
+  for(uint32_t i = 0; i < nbDP; i++) {
+    // xorshift64
+    r ^= r << 13;
+    r ^= r >> 7;
+    r ^= r << 17;
+    if((r >> 32) < threshold) {
+      VALIDATE_ITEM it;
+      it.e.x = dp[i].x;
+      it.e.d = dp[i].d;
+      it.e.kType = dp[i].kIdx % 2;
+      it.sourceId = sourceId;
+      items.push_back(it);
+    }
+  }
+  *rnd = r;
+
+  if(items.size() == 0)
+    return;
+
+  // Never throttle ingest, the sample is dropped when validators lag behind
+  LOCK(ghMutex);
+  if(!sourceStats[sourceId].quarantined && validateQueue.size() + items.size() <= VALIDATE_QUEUE_MAX)
+    validateQueue.insert(validateQueue.end(),items.begin(),items.end());
+  UNLOCK(ghMutex);
+
+}
+
+void Kangaroo::ValidateDP(TH_PARAM *p) {
+
+  vector<ENTRY> batch;
+  vector<uint32_t> ids;
+  vector<PURGE_ITEM> items;
+  vector<uint8_t> wrong;
+
+  while(!endOfSearch) {
+
+    // Table purge first, then sampled DPs
+    LOCK(ghMutex);
+    size_t nb = purgeQueue.size();
+    if(nb > CHECK_BATCH) nb = CHECK_BATCH;
+    for(size_t i = 0; i < nb; i++) {
+      batch.push_back(purgeQueue.front().e);
+      items.push_back(purgeQueue.front());
+      purgeQueue.pop_front();
+    }
+    purgeInFlight += (uint32_t)nb;
+    if(nb == 0) {
+      nb = validateQueue.size();
+      if(nb > CHECK_BATCH) nb = CHECK_BATCH;
+      for(size_t i = 0; i < nb; i++) {
+        batch.push_back(validateQueue.front().e);
+        ids.push_back(validateQueue.front().sourceId);
+        validateQueue.pop_front();
+      }
+    }
+    UNLOCK(ghMutex);
+
+    if(items.size() > 0) {
+      CheckBatch(batch,&wrong);
+      LOCK(ghMutex);
+      for(size_t i = 0; i < items.size(); i++)
+        if(wrong[i]) purgeWrong.push_back(items[i]);
+      purgeInFlight -= (uint32_t)items.size();
+      UNLOCK(ghMutex);
+      items.clear();
+      continue;
+    }
+
+    if(ids.size() == 0) {
+      Timer::SleepMillis(100);
+      continue;
+    }
+
+    CheckBatch(batch,&wrong);
+
+    LOCK(ghMutex);
+    for(size_t i = 0; i < ids.size(); i++) {
+      SOURCE_STAT *ss = &sourceStats[ids[i]];
+      CLIENT_STAT *cs = &clientStats[ss->clientId];
+      ss->nbSampled++;
+      cs->nbSampled++;
+      if(wrong[i]) {
+        ss->nbWrong++;
+        cs->nbWrong++;
+      }
+      if(!ss->quarantined && ss->nbSampled >= quarantineMin &&
+         (double)ss->nbWrong > quarantineWrong * (double)ss->nbSampled) {
+        ss->quarantined = true;
+        ss->quarantineTime = Timer::get_tick();
+        cs->nbQuarantined++;
+        ::printf("\nValidation: %s quarantined [Wrong DP %.0f/%.0f sampled] [%.0f DP received]\n",
+                 GetSourceName(ss).c_str(),(double)ss->nbWrong,(double)ss->nbSampled,(double)ss->nbDP);
+        // (Re)start a purge of the table
+        purgeRunning = true;
+        purgeBucket = 0;
+      }
+    }
+    UNLOCK(ghMutex);
+
+    ids.clear();
+
+  }
+
+}
+
+// Called by ProcessServer (single writer of the table): removes the wrong
+// DPs reported by the validators and copies the next buckets to purgeQueue,
+// up to PURGE_QUEUE_MAX entries waiting for verification.
+void Kangaroo::PurgeTable() {
+
+  vector<PURGE_ITEM> items;
+
+  LOCK(ghMutex);
+  bool running = purgeRunning;
+  uint32_t hStart = purgeBucket;
+  size_t nbQueued = purgeQueue.size();
+  items.swap(purgeWrong);
+  UNLOCK(ghMutex);
+
+  if(!running)
+    return;
+
+  // Indexes change with insertions, look the entries up again
+  for(size_t k = 0; k < items.size(); k++) {
+    uint32_t h = items[k].h;
+    for(uint32_t i = 0; i < hashTable.E[h].nbItem; i++) {
+      ENTRY *e = hashTable.GetItem(h,i);
+      if(memcmp(&e->x,&items[k].e.x,sizeof(int256_t)) == 0 &&
+         memcmp(&e->d,&items[k].e.d,sizeof(int256_t)) == 0) {
+        hashTable.Remove(h,i);
+        purgeNbRemoved++;
+        break;
+      }
+    }
+  }
+  items.clear();
+
+  // Whole buckets
+  uint32_t h = hStart;
+  while(h < HASH_SIZE && nbQueued + items.size() < PURGE_QUEUE_MAX) {
+    for(uint32_t i = 0; i < hashTable.E[h].nbItem; i++) {
+      PURGE_ITEM it;
+      it.e = *hashTable.GetItem(h,i);
+      it.h = h;
+      items.push_back(it);
+    }
+    h++;
+  }
+
+  LOCK(ghMutex);
+  purgeQueue.insert(purgeQueue.end(),items.begin(),items.end());
+  // Keep a restart requested meanwhile by a new quarantine
+  if(purgeBucket == hStart) purgeBucket = h;
+  bool done = (purgeBucket == HASH_SIZE && purgeQueue.empty() && purgeInFlight == 0 && purgeWrong.empty());
+  if(done) purgeRunning = false;
+  UNLOCK(ghMutex);
+
+  if(done) {
+    ::printf("\nValidation: table purged [%.0f wrong DP removed]\n",(double)purgeNbRemoved);
+    // Next save must rewrite the whole table
+    if(purgeNbRemoved > 0)
+      journalReady = false;
+    purgeNbRemoved = 0;
+  }
+
+}
+
+// Threaded proc
+#ifdef WIN64
+DWORD WINAPI _validateThread(LPVOID lpParam) {
+#else
+void *_validateThread(void *lpParam) {
+#endif
+  TH_PARAM *p = (TH_PARAM *)lpParam;
+  p->obj->ValidateDP(p);
+  free(p);
+  return 0;
+}
+
 // Threaded proc
 #ifdef WIN64
 DWORD WINAPI _acceptThread(LPVOID lpParam) {
@@ -634,7 +907,7 @@ void *_acceptThread(void *lpParam) {
   p->obj->AddConnectedClient();
   p->obj->HandleRequest(p);
   p->obj->RemoveConnectedClient();
-  p->obj->RemoveConnectedKangaroo(p->nbKangaroo);
+  p->obj->RemoveConnectedKangaroo(p->clientId,p->nbKangaroo);
   p->isRunning = false;
   free(p->clientInfo);
   free(p);
@@ -646,8 +919,426 @@ DWORD WINAPI _processServer(LPVOID lpParam) {
 #else
 void *_processServer(void *lpParam) {
 #endif
-  Kangaroo *obj = (Kangaroo *)lpParam;
-  obj->ProcessServer();
+  TH_PARAM *p = (TH_PARAM *)lpParam;
+  p->obj->ProcessServer();
+  return 0;
+}
+
+// ------------------------------------------------------------------------------------------------------
+// Client accounting: DP, bytes, duplicates and dead hits per client host and
+// per DP source (processId, gpuId) of a host. Every ANOMALY_PERIOD the DP rate
+// of each client is compared to what its declared kangaroos and the DP size
+// predict, and misconfigured, stalled or cheating clients are flagged.
+// ------------------------------------------------------------------------------------------------------
+
+static const char *anomalyNames[ANOMALY_NB] = {
+  "stalled","DP rate too low","DP rate too high","duplicate DPs","unbalanced herds","not DPs","bad kangaroo index"
+};
+
+static string GetAnomalyStr(uint32_t anomaly) {
+
+  string s;
+  for(int i = 0; i < ANOMALY_NB; i++) {
+    if(anomaly & (1U << i)) {
+      if(s.length() > 0) s.append(", ");
+      s.append(anomalyNames[i]);
+    }
+  }
+  return s;
+
+}
+
+// Called with ghMutex locked
+string Kangaroo::GetSourceName(SOURCE_STAT *ss) {
+
+  char name[128];
+  if(ss->gpuId == 0xFFFF)
+    ::sprintf(name,"%s [pid %u, cpu]",clientStats[ss->clientId].host.c_str(),ss->processId);
+  else
+    ::sprintf(name,"%s [pid %u, gpu %u]",clientStats[ss->clientId].host.c_str(),ss->processId,ss->gpuId);
+  return string(name);
+
+}
+
+// Release quarantined sources, called with ghMutex locked. The ratio of a
+// released source restarts from zero.
+void Kangaroo::ReleaseSources(double t) {
+
+  if(quarantineTime <= 0.0)
+    return;
+
+  for(int i = 0; i < (int)sourceStats.size(); i++) {
+    SOURCE_STAT *ss = &sourceStats[i];
+    if(ss->quarantined && t - ss->quarantineTime >= quarantineTime) {
+      ss->quarantined = false;
+      ss->nbSampled = 0;
+      ss->nbWrong = 0;
+      clientStats[ss->clientId].nbQuarantined--;
+      ::printf("\nValidation: %s released [%.0f DP rejected]\n",GetSourceName(ss).c_str(),(double)ss->nbRejected);
+    }
+  }
+
+}
+
+// Called with ghMutex locked
+uint32_t Kangaroo::GetSourceId(uint32_t clientId,uint32_t processId,uint32_t gpuId) {
+
+  uint64_t key = ((uint64_t)clientId << 48) | ((uint64_t)(gpuId & 0xFFFF) << 32) | (uint64_t)processId;
+  std::map<uint64_t,uint32_t>::iterator it = sourceIds.find(key);
+  if(it != sourceIds.end())
+    return it->second;
+
+  SOURCE_STAT ss;
+  ::memset(&ss,0,sizeof(SOURCE_STAT));
+  ss.clientId = clientId;
+  ss.processId = processId;
+  ss.gpuId = gpuId;
+  uint32_t id = (uint32_t)sourceStats.size();
+  sourceStats.push_back(ss);
+  sourceIds[key] = id;
+  return id;
+
+}
+
+// Called by ProcessServer
+void Kangaroo::CheckClients(double t) {
+
+  if(lastClientCheck == 0.0)
+    lastClientCheck = t;
+  if(t - lastClientCheck < ANOMALY_PERIOD)
+    return;
+  lastClientCheck = t;
+
+  double dpWeight = pow(2.0,(double)dpSize);
+
+  LOCK(ghMutex);
+
+  // Walk rate per declared kangaroo implied by the DP rate
+  vector<double> rates;
+  for(int i = 0; i < (int)clientStats.size(); i++) {
+    CLIENT_STAT *cs = &clientStats[i];
+    double dt = t - cs->checkTime;
+    double dpRate = (dt > 0.0) ? (double)(cs->nbDP - cs->checkNbDP) / dt : 0.0;
+    cs->walkRate = (cs->nbKangaroo > 0) ? dpRate * dpWeight / (double)cs->nbKangaroo : 0.0;
+    cs->checkNbDP = cs->nbDP;
+    cs->checkTime = t;
+    if(cs->walkRate > 0.0)
+      rates.push_back(cs->walkRate);
+  }
+
+  // Fleet reference
+  double median = 0.0;
+  if(rates.size() > 0) {
+    std::sort(rates.begin(),rates.end());
+    median = rates[rates.size() / 2];
+  }
+
+  for(int i = 0; i < (int)clientStats.size(); i++) {
+
+    CLIENT_STAT *cs = &clientStats[i];
+    uint32_t anomaly = 0;
+    bool active = cs->nbConnection > 0 && cs->nbKangaroo > 0 && cs->nbQuarantined == 0;
+
+    if(active) {
+
+      // No DP for ANOMALY_STALL while at least 10 are expected (fleet rate
+      // for the declared kangaroos, or the client's own average)
+      double last = (cs->lastDPTime > 0.0) ? cs->lastDPTime : cs->firstTime;
+      double expRate = 0.0;
+      if(median > 0.0)
+        expRate = median * (double)cs->nbKangaroo / dpWeight;
+      else if(cs->nbDP > 0 && cs->lastDPTime > cs->firstTime)
+        expRate = (double)cs->nbDP / (cs->lastDPTime - cs->firstTime);
+      if(t - last > ANOMALY_STALL && expRate * (t - last) >= 10.0)
+        anomaly |= ANOMALY_STALLED;
+
+      if(cs->walkRate > ANOMALY_MAX_JUMP)
+        anomaly |= ANOMALY_RATE_HIGH;
+      if(rates.size() >= 3 && cs->walkRate > 0.0 && cs->walkRate < median / 64.0)
+        anomaly |= ANOMALY_RATE_LOW;
+
+    }
+
+    if(cs->nbDP >= 1000 && cs->nbDuplicate * 100 > cs->nbDP)
+      anomaly |= ANOMALY_DUPLICATE;
+    uint64_t nbHerd = cs->nbTame + cs->nbWild;
+    if(nbHerd >= 10000) {
+      double tame = (double)cs->nbTame / (double)nbHerd;
+      if(tame < 0.45 || tame > 0.55)
+        anomaly |= ANOMALY_HERD;
+    }
+    if(cs->nbNotDP > 0)
+      anomaly |= ANOMALY_NOT_DP;
+    if(cs->nbBadIdx > 0)
+      anomaly |= ANOMALY_KIDX;
+
+    uint32_t raised = anomaly & ~cs->anomaly;
+    uint32_t cleared = cs->anomaly & ~anomaly;
+    if(raised)
+      LOG(LOGC_SERVER,LOG_WARN,"Client %s flagged: %s [%.0f DP, %.0f kangaroos, %.3g jumps/s/kangaroo]",
+          cs->host.c_str(),GetAnomalyStr(raised).c_str(),(double)cs->nbDP,(double)cs->nbKangaroo,cs->walkRate);
+    if(cleared)
+      LOG(LOGC_SERVER,LOG_INFO,"Client %s cleared: %s",cs->host.c_str(),GetAnomalyStr(cleared).c_str());
+    cs->anomaly = anomaly;
+
+  }
+
+  UNLOCK(ghMutex);
+
+}
+
+// ------------------------------------------------------------------------------------------------------
+// Metrics endpoint: read only HTTP server bound to the loopback interface,
+// answers any GET with a text snapshot of the server counters (Prometheus
+// text format). Nothing here scans the table, counters are incremental.
+// ------------------------------------------------------------------------------------------------------
+
+// Rates over the last ProcessServer period, called by ProcessServer
+void Kangaroo::UpdateServerRates(double t) {
+
+  if(serverStat.lastRateTime == 0.0) {
+    serverStat.lastRateTime = t;
+    return;
+  }
+
+  double dt = t - serverStat.lastRateTime;
+  if(dt < 1.0)
+    return;
+
+  LOCK(ghMutex);
+  serverStat.dpRate = (double)(pipeStat.nbAdded - serverStat.lastNbAdded) / dt;
+  serverStat.lastNbAdded = pipeStat.nbAdded;
+  for(int i = 0; i < (int)clientStats.size(); i++) {
+    CLIENT_STAT *cs = &clientStats[i];
+    cs->dpRate = (double)(cs->nbDP - cs->lastNbDP) / dt;
+    cs->lastNbDP = cs->nbDP;
+  }
+  serverStat.lastRateTime = t;
+  UNLOCK(ghMutex);
+
+}
+
+static void AddMetric(string &s,const char *name,double value,const char *help = NULL) {
+
+  char line[512];
+  if(help) {
+    ::sprintf(line,"# HELP %s %s\n",name,help);
+    s.append(line);
+  }
+  ::sprintf(line,"%s %.15g\n",name,value);
+  s.append(line);
+
+}
+
+static void AddClientMetric(string &s,const char *name,string &host,double value) {
+
+  char line[512];
+  ::sprintf(line,"%s{host=\"%s\"} %.15g\n",name,host.c_str(),value);
+  s.append(line);
+
+}
+
+static void AddSourceMetric(string &s,const char *name,string &host,SOURCE_STAT *ss,double value) {
+
+  char line[512];
+  char gpu[16];
+  if(ss->gpuId == 0xFFFF) ::strcpy(gpu,"cpu");
+  else                    ::sprintf(gpu,"%u",ss->gpuId);
+  ::sprintf(line,"%s{host=\"%s\",pid=\"%u\",gpu=\"%s\"} %.15g\n",name,host.c_str(),ss->processId,gpu,value);
+  s.append(line);
+
+}
+
+string Kangaroo::GetMetrics() {
+
+  string s;
+  double t = Timer::get_tick();
+  double nbItem = (double)hashTable.GetNbItem();
+  double expectedDP = expectedNbOp / pow(2.0,(double)dpSize);
+
+  LOCK(ghMutex);
+
+  AddMetric(s,"kangaroo_uptime_seconds",t - startTime,"Time since the server started");
+  AddMetric(s,"kangaroo_dp_bits",(double)dpSize,"Number of distinguished bits");
+  AddMetric(s,"kangaroo_clients_connected",(double)connectedClient,"Connected clients");
+  AddMetric(s,"kangaroo_kangaroos",(double)totalRW,"Kangaroos of the connected clients");
+
+  // Ingest
+  AddMetric(s,"kangaroo_dp_received_total",(double)pipeStat.nbRecv,"DP received from clients");
+  AddMetric(s,"kangaroo_dp_added_total",(double)pipeStat.nbAdded,"DP handed to the table");
+  AddMetric(s,"kangaroo_dp_rate",serverStat.dpRate,"DP/s handed to the table");
+  AddMetric(s,"kangaroo_dp_bytes_in_total",(double)pipeStat.bytesIn,"DP packet bytes received");
+  AddMetric(s,"kangaroo_duplicates_total",(double)serverStat.nbDuplicate,"DP already in the table");
+  AddMetric(s,"kangaroo_dead_total",(double)collisionInSameHerd,"Same herd collisions (dead kangaroos)");
+
+  // Queues
+  AddMetric(s,"kangaroo_recv_queue",(double)pipeStat.nbPending,"DP waiting for ProcessServer");
+  AddMetric(s,"kangaroo_recv_queue_max",(double)pipeStat.maxPending,"Max DP waiting for ProcessServer");
+  AddMetric(s,"kangaroo_validate_queue",(double)validateQueue.size(),"Sampled DP waiting for validation");
+  AddMetric(s,"kangaroo_journal",(double)journal.size(),"DP added since the last save");
+
+  // Table
+  AddMetric(s,"kangaroo_table_entries",nbItem,"DP stored in the table");
+  AddMetric(s,"kangaroo_table_used_bytes",(double)hashTable.GetUsedByte(),"Memory used by the entries");
+  AddMetric(s,"kangaroo_table_alloc_bytes",(double)hashTable.GetTotalByte(),"Memory allocated by the table");
+
+  // Saves
+  AddMetric(s,"kangaroo_save_total",(double)serverStat.nbSave,"Work file saves");
+  AddMetric(s,"kangaroo_save_last_seconds",serverStat.saveTime,"Duration of the last save");
+  AddMetric(s,"kangaroo_save_max_seconds",serverStat.maxSaveTime,"Longest save");
+  AddMetric(s,"kangaroo_save_stall_seconds",serverStat.stallTime,"Time the last save blocked ProcessServer");
+  AddMetric(s,"kangaroo_save_seconds_total",serverStat.totalSaveTime,"Time spent saving");
+
+  // Progress, the expected number of DP is a mean (the key is found at
+  // 100% on average), ETA is -1 while no DP is coming
+  double eta = -1.0;
+  if(serverStat.dpRate > 0.0)
+    eta = (nbItem < expectedDP) ? (expectedDP - nbItem) / serverStat.dpRate : 0.0;
+  AddMetric(s,"kangaroo_expected_dp",expectedDP,"Expected number of DP to solve");
+  AddMetric(s,"kangaroo_progress_ratio",(expectedDP > 0.0) ? nbItem / expectedDP : 0.0,"Stored DP / expected DP");
+  AddMetric(s,"kangaroo_eta_seconds",eta,"Time to reach the expected number of DP at the current rate");
+
+  // Clients (per host)
+  s.append("# HELP kangaroo_client_dp_total DP received per client host\n");
+  for(int i = 0; i < (int)clientStats.size(); i++)
+    AddClientMetric(s,"kangaroo_client_dp_total",clientStats[i].host,(double)clientStats[i].nbDP);
+  s.append("# HELP kangaroo_client_dp_rate DP/s received per client host\n");
+  for(int i = 0; i < (int)clientStats.size(); i++)
+    AddClientMetric(s,"kangaroo_client_dp_rate",clientStats[i].host,clientStats[i].dpRate);
+  if(sampleRate > 0.0) {
+    for(int i = 0; i < (int)clientStats.size(); i++) {
+      AddClientMetric(s,"kangaroo_client_dp_wrong_total",clientStats[i].host,(double)clientStats[i].nbWrong);
+      AddClientMetric(s,"kangaroo_client_quarantined",clientStats[i].host,(double)clientStats[i].nbQuarantined);
+    }
+  }
+  s.append("# HELP kangaroo_client_kangaroos Kangaroos declared by the connected processes of a client host\n");
+  for(int i = 0; i < (int)clientStats.size(); i++)
+    AddClientMetric(s,"kangaroo_client_kangaroos",clientStats[i].host,(double)clientStats[i].nbKangaroo);
+  s.append("# HELP kangaroo_client_bytes_total DP packet bytes received per client host\n");
+  for(int i = 0; i < (int)clientStats.size(); i++)
+    AddClientMetric(s,"kangaroo_client_bytes_total",clientStats[i].host,(double)clientStats[i].nbByte);
+  s.append("# HELP kangaroo_client_duplicates_total DP already in the table per client host\n");
+  for(int i = 0; i < (int)clientStats.size(); i++)
+    AddClientMetric(s,"kangaroo_client_duplicates_total",clientStats[i].host,(double)clientStats[i].nbDuplicate);
+  s.append("# HELP kangaroo_client_dead_total DP rejected by the table (same herd) per client host\n");
+  for(int i = 0; i < (int)clientStats.size(); i++)
+    AddClientMetric(s,"kangaroo_client_dead_total",clientStats[i].host,(double)clientStats[i].nbDead);
+  s.append("# HELP kangaroo_client_walk_rate Jumps/s per declared kangaroo implied by the DP rate\n");
+  for(int i = 0; i < (int)clientStats.size(); i++)
+    AddClientMetric(s,"kangaroo_client_walk_rate",clientStats[i].host,clientStats[i].walkRate);
+  s.append("# HELP kangaroo_client_anomaly Anomaly flags (1 stalled, 2 rate low, 4 rate high, 8 duplicates, 16 herds, 32 not DP, 64 kangaroo index)\n");
+  for(int i = 0; i < (int)clientStats.size(); i++)
+    AddClientMetric(s,"kangaroo_client_anomaly",clientStats[i].host,(double)clientStats[i].anomaly);
+
+  // DP sources (per process and GPU of a client host)
+  s.append("# HELP kangaroo_source_dp_total DP received per process and GPU\n");
+  for(int i = 0; i < (int)sourceStats.size(); i++)
+    AddSourceMetric(s,"kangaroo_source_dp_total",clientStats[sourceStats[i].clientId].host,&sourceStats[i],(double)sourceStats[i].nbDP);
+  s.append("# HELP kangaroo_source_bytes_total DP packet bytes received per process and GPU\n");
+  for(int i = 0; i < (int)sourceStats.size(); i++)
+    AddSourceMetric(s,"kangaroo_source_bytes_total",clientStats[sourceStats[i].clientId].host,&sourceStats[i],(double)sourceStats[i].nbByte);
+  s.append("# HELP kangaroo_source_duplicates_total DP already in the table per process and GPU\n");
+  for(int i = 0; i < (int)sourceStats.size(); i++)
+    AddSourceMetric(s,"kangaroo_source_duplicates_total",clientStats[sourceStats[i].clientId].host,&sourceStats[i],(double)sourceStats[i].nbDuplicate);
+  s.append("# HELP kangaroo_source_dead_total DP rejected by the table per process and GPU\n");
+  for(int i = 0; i < (int)sourceStats.size(); i++)
+    AddSourceMetric(s,"kangaroo_source_dead_total",clientStats[sourceStats[i].clientId].host,&sourceStats[i],(double)sourceStats[i].nbDead);
+  if(sampleRate > 0.0) {
+    for(int i = 0; i < (int)sourceStats.size(); i++) {
+      AddSourceMetric(s,"kangaroo_source_dp_wrong_total",clientStats[sourceStats[i].clientId].host,&sourceStats[i],(double)sourceStats[i].nbWrong);
+      AddSourceMetric(s,"kangaroo_source_quarantined",clientStats[sourceStats[i].clientId].host,&sourceStats[i],sourceStats[i].quarantined ? 1.0 : 0.0);
+    }
+  }
+
+  UNLOCK(ghMutex);
+
+  return s;
+
+}
+
+void Kangaroo::MetricsServer() {
+
+  SOCKET sock = socket(AF_INET,SOCK_STREAM,0);
+  if(sock < 0) {
+    ::printf("Warning: Metrics endpoint disabled: %s\n",GetNetworkError().c_str());
+    return;
+  }
+
+  int32_t yes = 1;
+  setsockopt(sock,SOL_SOCKET,SO_REUSEADDR,(char *)&yes,sizeof(yes));
+
+  struct sockaddr_in soc_addr;
+  memset(&soc_addr,0,sizeof(soc_addr));
+  soc_addr.sin_family = AF_INET;
+  soc_addr.sin_port = htons(metricsPort);
+  soc_addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+  if(bind(sock,(struct sockaddr*)&soc_addr,sizeof(soc_addr)) || listen(sock,16) < 0) {
+    ::printf("Warning: Metrics endpoint disabled, cannot listen to port %d: %s\n",metricsPort,GetNetworkError().c_str());
+    close_socket(sock);
+    return;
+  }
+
+  ::printf("Metrics endpoint: http://127.0.0.1:%d/metrics\n",metricsPort);
+
+  while(!endOfSearch) {
+
+    // Do not block in accept(), the endpoint is closed at the end of the search
+    if(WaitFor(sock,1000,WAIT_FOR_READ) <= 0)
+      continue;
+
+    struct sockaddr_in client_add;
+    socklen_t len = sizeof(sockaddr_in);
+    SOCKET s = accept(sock,(struct sockaddr*)&client_add,&len);
+    if(s < 0)
+      continue;
+
+    // Read the request header (or what comes within the timeout)
+    char req[1024];
+    int nbRead = 0;
+    req[0] = 0;
+    while(nbRead < (int)sizeof(req) - 1 && WaitFor(s,1000,WAIT_FOR_READ) > 0) {
+      int rd = recv(s,req + nbRead,(int)sizeof(req) - 1 - nbRead,0);
+      if(rd <= 0) break;
+      nbRead += rd;
+      req[nbRead] = 0;
+      if(strstr(req,"\r\n\r\n") || strstr(req,"\n\n")) break;
+    }
+
+    string body;
+    const char *status = "200 OK";
+    if(strncmp(req,"GET ",4) != 0) {
+      status = "405 Method Not Allowed";
+      body = "Only GET is supported\n";
+    } else if(strncmp(req + 4,"/ ",2) != 0 && strncmp(req + 4,"/metrics",8) != 0) {
+      status = "404 Not Found";
+      body = "Not found, try /metrics\n";
+    } else {
+      body = GetMetrics();
+    }
+
+    char head[256];
+    ::sprintf(head,"HTTP/1.0 %s\r\nContent-Type: text/plain; version=0.0.4\r\nContent-Length: %d\r\nConnection: close\r\n\r\n",
+              status,(int)body.length());
+    string answer = string(head) + body;
+    Write(s,(char *)answer.c_str(),(int)answer.length(),ntimeout);
+    close_socket(s);
+
+  }
+
+  close_socket(sock);
+
+}
+
+// Threaded proc
+#ifdef WIN64
+DWORD WINAPI _metricsThread(LPVOID lpParam) {
+#else
+void *_metricsThread(void *lpParam) {
+#endif
+  TH_PARAM *p = (TH_PARAM *)lpParam;
+  p->obj->MetricsServer();
+  free(p);
   return 0;
 }
 
@@ -741,9 +1432,40 @@ void Kangaroo::RunServer() {
   }
 
   // Main thread of server (handle backup and collision check)
-  LaunchThread(_processServer,(TH_PARAM *)this);
+  TH_PARAM *sp = (TH_PARAM *)malloc(sizeof(TH_PARAM));
+  ::memset(sp,0,sizeof(TH_PARAM));
+  LaunchThread(_processServer,sp);
   Timer::SleepMillis(100);
 
+  // Local metrics endpoint
+  if(metricsPort > 0) {
+    TH_PARAM *mp = (TH_PARAM *)malloc(sizeof(TH_PARAM));
+    ::memset(mp,0,sizeof(TH_PARAM));
+    LaunchThread(_metricsThread,mp);
+  }
+
+  // Flight recorder
+  StartRecorder(REC_SERVER);
+
+  // Background verification of sampled DPs
+  if(sampleRate > 0.0) {
+    int nbValidator = Timer::getCoreNumber() / 2;
+    if(nbValidator < 1) nbValidator = 1;
+    for(int i = 0; i < nbValidator; i++) {
+      TH_PARAM *p = (TH_PARAM *)malloc(sizeof(TH_PARAM));
+      ::memset(p,0,sizeof(TH_PARAM));
+      p->obj = this;
+      p->threadId = i;
+      LaunchThread(_validateThread,p);
+    }
+    ::printf("DP validation: %.2f%% of DPs verified by %d thread(s)\n",sampleRate * 100.0,nbValidator);
+    ::printf("DP validation: quarantine above %.2f%% wrong DP (%.0f sampled), ",quarantineWrong * 100.0,(double)quarantineMin);
+    if(quarantineTime > 0.0)
+      ::printf("release after %s\n",GetTimeStr(quarantineTime).c_str());
+    else
+      ::printf("no release\n");
+  }
+
   // Server stuff
 
   InitSocket();
@@ -940,6 +1662,10 @@ void Kangaroo::WaitForServer() {
   int32_t status;
   bool ok = false;
 
+  // Pending acks first, the status answer follows them
+  if(isConnected)
+    ReadAcks(0);
+
   while(!ok) {
     
     // Wait for connection
@@ -990,6 +1716,7 @@ void Kangaroo::WaitForServer() {
       } else {
 
         nbRead = Read(serverConn,(char *)(&status),sizeof(int32_t),ntimeout);
+        pipeStat.nbStatus++;
         if( nbRead<=0 ) {
           if(nbRead<0)
             ::printf("\nRecvFromServer(Status): %s\n",lastError.c_str()); 
@@ -1185,30 +1912,93 @@ bool Kangaroo::SendKangaroosToServer(std::string& fileName,std::vector<int256_t>
 
 }
 
+// Read the DP acks, each one carries the server status. Acks already
+// received are read without blocking (the first one may be waited for
+// timeout ms), the call blocks while more than maxPending packets are
+// not acknowledged.
+bool Kangaroo::ReadAcks(int maxPending,int timeout) {
+
+  while(pendingAck.size() > 0) {
+
+    if((int)pendingAck.size() <= maxPending && WaitFor(serverConn,timeout,WAIT_FOR_READ) <= 0)
+      break;
+    timeout = 0;
+
+    int32_t status;
+    int nbRead = Read(serverConn,(char *)&status,sizeof(int32_t),ntimeout);
+    if(nbRead != (int)sizeof(int32_t)) {
+      LOG(LOGC_NET,LOG_ERROR,"Read status failed, %d packet(s) not acknowledged: %s",
+          (int)pendingAck.size(),lastError.c_str());
+      isConnected = false;
+      close_socket(serverConn);
+      pendingAck.clear();
+      return false;
+    }
+
+    pipeStat.nbSent += pendingAck.front().nbDP;
+    pipeStat.ackTime += Timer::get_tick() - pendingAck.front().sendTime;
+    pipeStat.bytesIn += sizeof(int32_t);
+    pipeStat.nbPacket++;
+    pendingAck.pop_front();
+
+    // Check server status response
+    if(status == SERVER_OK) {
+      serverStatus = "OK";
+    } else if(status == SERVER_END) {
+      LOG(LOGC_NET,LOG_INFO,"Server reports search ended (collision found)");
+      serverStatus = "END";
+      endOfSearch = true;
+    } else if(status == SERVER_BACKUP) {
+      // Next packet waits for the server (WaitForServer())
+      serverStatus = "Backup";
+      serverBackup = true;
+    } else {
+      LOG(LOGC_NET,LOG_WARN,"Unexpected server status: %d (expected %d=OK, %d=END, %d=BACKUP)",
+          status,SERVER_OK,SERVER_END,SERVER_BACKUP);
+    }
+
+    // Log every 100 packets for detailed tracking
+    if(pipeStat.nbPacket % 100 == 0)
+      LOG(LOGC_NET,LOG_DEBUG,"Sends: %llu | Avg time: %.1fms | Avg batch: %.0f DPs (%.0f bytes) | Total: %llu DPs (%llu bytes)",
+          (unsigned long long)pipeStat.nbPacket,pipeStat.sendTime * 1000.0 / pipeStat.nbPacket,
+          (double)pipeStat.nbSent / pipeStat.nbPacket,(double)pipeStat.bytesOut / pipeStat.nbPacket,
+          (unsigned long long)pipeStat.nbSent,(unsigned long long)pipeStat.bytesOut);
+
+  }
+
+  return true;
+
+}
+
 // Send DP to Server (Optimized with batching and reduced allocations)
+// The server status comes with the DP acks: in steady state a packet costs
+// one write, acks are read when available and the sender only blocks when
+// more than ACK_WINDOW packets are in flight. The status round trip of
+// WaitForServer() is only done after a connection loss or a SERVER_BACKUP.
 bool Kangaroo::SendToServer(std::vector<ITEM> &dps,uint32_t threadId,uint32_t gpuId) {
 
-  int nbRead;
   int nbWrite;
   uint32_t nbDP = (uint32_t)dps.size();
   if(dps.size()==0)
     return false;
 
-  // Verify connection state before attempting to send
-  if(!isConnected) {
-    ::printf("\n[SendToServer ERROR] Not connected to server (isConnected=false)\n");
-    dps.clear();
-    return false;
+  double t0 = Timer::get_tick();
+  double t1 = t0;
+  if(!isConnected || serverBackup) {
+    WaitForServer();
+    serverBackup = false;
+    t1 = Timer::get_tick();
+    pipeStat.waitTime += t1 - t0;
   }
 
-  WaitForServer();
-
   if(!endOfSearch) {
 
-    int32_t status;
-
     // Performance tracking
-    double t0 = Timer::get_tick();
+    t0 = t1;
+
+    // Acks received during the batching delay
+    if(!ReadAcks((int)pendingAck.size()))
+      return false;
 
     // Pre-allocate send buffer to hold everything: cmd(1) + header(20) + DPs(72*nbDP)
     size_t totalSize = 1 + sizeof(DPHEADER) + sizeof(DP)*nbDP;
@@ -1249,88 +2039,51 @@ bool Kangaroo::SendToServer(std::vector<ITEM> &dps,uint32_t threadId,uint32_t gp
     }
 
     // Single write call for entire packet (cmd + header + DPs)
+    double tw = Timer::get_tick();
     if((nbWrite = Write(serverConn,sendBuffer,totalSize,ntimeout)) < 0) {
-      ::printf("\n[SendToServer ERROR] Write failed for %u DPs (%zu bytes): %s\n",
-               nbDP, totalSize, lastError.c_str());
+      LOG(LOGC_NET,LOG_ERROR,"Write failed for %u DPs (%zu bytes): %s",
+          nbDP,totalSize,lastError.c_str());
       isConnected = false;
       close_socket(serverConn);
+      pendingAck.clear();
       free(sendBuffer);
       return false;
     }
 
     // Verify we sent the entire packet
     if((size_t)nbWrite != totalSize) {
-      ::printf("\n[SendToServer ERROR] Partial write: sent %d of %zu bytes (missing %zu bytes) for %u DPs\n",
-               nbWrite, totalSize, totalSize - nbWrite, nbDP);
+      LOG(LOGC_NET,LOG_ERROR,"Partial write: sent %d of %zu bytes (missing %zu bytes) for %u DPs",
+          nbWrite,totalSize,totalSize - nbWrite,nbDP);
       isConnected = false;
       close_socket(serverConn);
+      pendingAck.clear();
       free(sendBuffer);
       return false;
     }
 
-    // Get server status
-    if((nbRead = Read(serverConn,(char *)&status,sizeof(int32_t),ntimeout)) < 0) {
-      ::printf("\n[SendToServer ERROR] Read status failed after sending %u DPs: %s\n",
-               nbDP, lastError.c_str());
-      isConnected = false;
-      close_socket(serverConn);
-      free(sendBuffer);
-      return false;
-    }
-
-    // Verify we got the full status response
-    if(nbRead != sizeof(int32_t)) {
-      ::printf("\n[SendToServer ERROR] Partial status read: got %d of %zu bytes\n",
-               nbRead, sizeof(int32_t));
-      isConnected = false;
-      close_socket(serverConn);
-      free(sendBuffer);
-      return false;
-    }
-
-    // Check server status response
-    if(status == SERVER_END) {
-      ::printf("\n[SendToServer] Server reports search ended (collision found)\n");
-      endOfSearch = true;
-    } else if(status == SERVER_BACKUP) {
-      ::printf("\n[SendToServer] Server is performing backup, DPs may be queued\n");
-    } else if(status != SERVER_OK) {
-      ::printf("\n[SendToServer WARNING] Unexpected server status: %d (expected %d=OK, %d=END, %d=BACKUP)\n",
-               status, SERVER_OK, SERVER_END, SERVER_BACKUP);
-    }
-
+    PENDING_ACK pa;
+    pa.nbDP = nbDP;
+    pa.sendTime = tw;
+    pendingAck.push_back(pa);
     dps.clear();
     free(sendBuffer);
+    pipeStat.bytesOut += totalSize;
 
-    // Performance logging (every ~100 sends)
-    static uint64_t sendCount = 0;
-    static double totalTime = 0.0;
-    static uint64_t totalDPs = 0;
-    static uint64_t totalBytes = 0;
+    bool ok = ReadAcks(ACK_WINDOW);
 
-    double t1 = Timer::get_tick();
+    t1 = Timer::get_tick();
     double sendTime = (t1 - t0);
-    totalTime += sendTime;
-    totalDPs += nbDP;
-    totalBytes += totalSize;
-    sendCount++;
-
-    // Log every successful send for detailed tracking
-    if(sendCount % 100 == 0) {
-      double avgTime = totalTime / sendCount;
-      double avgBatch = (double)totalDPs / sendCount;
-      double avgBytes = (double)totalBytes / sendCount;
-      ::printf("\n[Network Stats] Sends: %llu | Avg time: %.1fms | Avg batch: %.0f DPs (%.0f bytes) | Total: %llu DPs (%llu bytes)\n",
-               (unsigned long long)sendCount, avgTime * 1000.0, avgBatch, avgBytes,
-               (unsigned long long)totalDPs, (unsigned long long)totalBytes);
-    }
+    pipeStat.sendTime += sendTime;
 
     // Detailed logging for very slow sends (>500ms is a problem)
     if(sendTime > 0.5) {
-      ::printf("\n[Network WARNING] Slow send detected: %.1fms for %u DPs (%zu bytes)\n",
-               sendTime * 1000.0, nbDP, totalSize);
+      LOG_RATE(LOGC_NET,LOG_WARN,1,"Slow send detected: %.1fms for %u DPs (%zu bytes)",
+               sendTime * 1000.0,nbDP,totalSize);
     }
 
+    if(!ok)
+      return false;
+
   }
 
   return true;
@@ -1345,8 +2098,12 @@ void Kangaroo::RemoveConnectedClient() {
   connectedClient--;
 }
 
-void Kangaroo::RemoveConnectedKangaroo(uint64_t nb) {
+void Kangaroo::RemoveConnectedKangaroo(uint32_t clientId,uint64_t nb) {
   totalRW -= nb;
+  LOCK(ghMutex);
+  clientStats[clientId].nbKangaroo -= nb;
+  clientStats[clientId].nbConnection--;
+  UNLOCK(ghMutex);
 }
 
 // Get configuration from server
@@ -1401,3 +2158,514 @@ bool Kangaroo::GetConfigFromServer() {
 
 }
 
+
+// ------------------------------------------------------------------------------------------------------
+// Load generator: simulated clients that send random DPs over the client protocol, no EC work
+// ------------------------------------------------------------------------------------------------------
+
+#define LG_RECENT 4096  // DPs kept per thread for duplicate/collision injection
+
+// Connection (and SETKNB, as WaitForServer does on reconnection)
+bool Kangaroo::LoadGenConnect(SOCKET *sock,int threadId) {
+
+  double t0 = Timer::get_tick();
+
+  // ConnectToServer() shares lastError and the resolved host
+  LOCK(ghMutex);
+  bool ok = ConnectToServer(sock);
+  UNLOCK(ghMutex);
+  if(!ok)
+    return false;
+
+  char cmd = SERVER_SETKNB;
+  uint64_t nbKangaroo = CPU_GRP_SIZE;
+  if(Write(*sock,&cmd,1,ntimeout) <= 0 ||
+     Write(*sock,(char *)&nbKangaroo,sizeof(uint64_t),ntimeout) <= 0) {
+    close_socket(*sock);
+    return false;
+  }
+
+  lgConnect[threadId].push_back((float)((Timer::get_tick() - t0) * 1000.0));
+  lgStat[threadId].nbConnect++;
+  return true;
+
+}
+
+// Save (or load back) the kangaroos of a simulated client, same frames as
+// SendKangaroosToServer() and GetKangaroosFromServer()
+bool Kangaroo::LoadGenKangaroos(SOCKET sock,uint32_t connId,bool save,int threadId) {
+
+  char fileName[64];
+  ::sprintf(fileName,"loadgen_%u_%u.kang",pid,connId);
+  uint32_t fileNameSize = (uint32_t)strlen(fileName);
+  uint64_t nbKangaroo = lgNbKang;
+  uint64_t r = ((uint64_t)connId << 32) | (uint64_t)(pid + 1);
+  int256_t *KBuff = (int256_t *)malloc(KANG_PER_BLOCK * sizeof(int256_t));
+  Int checkSum;
+  Int K;
+  bool ok = true;
+
+  double t0 = Timer::get_tick();
+  char cmd = save ? SERVER_SAVEKANG : SERVER_LOADKANG;
+  ok = Write(sock,&cmd,1,ntimeout) > 0 &&
+       Write(sock,(char *)&fileNameSize,sizeof(uint32_t),ntimeout) > 0 &&
+       Write(sock,fileName,fileNameSize,ntimeout) > 0;
+  if(ok) {
+    if(save)
+      ok = Write(sock,(char *)&nbKangaroo,sizeof(uint64_t),ntimeout) > 0;
+    else
+      ok = Read(sock,(char *)&nbKangaroo,sizeof(uint64_t),ntimeout) > 0;
+  }
+
+  checkSum.SetInt32(0);
+  uint64_t nbLeft = nbKangaroo;
+  while(ok && nbLeft > 0) {
+    uint32_t nbK = (nbLeft > KANG_PER_BLOCK) ? KANG_PER_BLOCK : (uint32_t)nbLeft;
+    if(save) {
+      for(uint32_t k = 0; k < nbK; k++) {
+        for(int i = 0; i < 4; i++) {
+          r ^= r << 13;
+          r ^= r >> 7;
+          r ^= r << 17;
+          KBuff[k].i64[i] = r;
+        }
+        KBuff[k].i64[3] &= 0x3FFFFFFFFFFFFFFFULL;
+        K.SetInt32(0);
+        K.bits64[3] = KBuff[k].i64[3];
+        K.bits64[2] = KBuff[k].i64[2];
+        K.bits64[1] = KBuff[k].i64[1];
+        K.bits64[0] = KBuff[k].i64[0];
+        checkSum.Add(&K);
+      }
+      ok = Write(sock,(char *)KBuff,nbK * 32,ntimeout) > 0;
+    } else {
+      ok = Read(sock,(char *)KBuff,nbK * 32,ntimeout) > 0;
+    }
+    nbLeft -= nbK;
+  }
+
+  if(ok) {
+    if(save)
+      ok = Write(sock,(char *)checkSum.bits64,32,ntimeout) > 0;
+    else if(nbKangaroo > 0)
+      ok = Read(sock,(char *)checkSum.bits64,32,ntimeout) > 0;
+  }
+
+  free(KBuff);
+
+  if(ok) {
+    LG_STAT *st = &lgStat[threadId];
+    if(save) st->nbKangSave++;
+    else     st->nbKangLoad++;
+    st->kangBytes += nbKangaroo * 32;
+    st->kangTime += Timer::get_tick() - t0;
+  }
+
+  return ok;
+
+}
+
+void Kangaroo::LoadGenThread(TH_PARAM *p) {
+
+  int t = p->threadId;
+  LG_STAT *st = &lgStat[t];
+
+  // Connections of this thread, served round robin
+  vector<uint32_t> ids;
+  for(int i = t; i < lgNbConn; i += nbCPUThread)
+    ids.push_back(i);
+  size_t nbConn = ids.size();
+  vector<SOCKET> socks(nbConn);
+  vector<bool> connected(nbConn,false);
+  vector<double> lastSave(nbConn,0.0);
+  vector<double> retry(nbConn,0.0);
+  vector<bool> ready(nbConn,false);
+
+  uint64_t r = ((uint64_t)Timer::getSeed32() << 32) | (uint64_t)(t + 1);
+  vector<DP> recent(LG_RECENT);
+  uint32_t nbRecent = 0;
+  uint32_t recentPos = 0;
+  uint64_t dupThreshold = (uint64_t)(lgDupRate * 4294967296.0);
+  uint64_t collThreshold = (uint64_t)((lgDupRate + lgCollRate) * 4294967296.0);
+  int dWords = (rangePower + 63) / 64;
+  uint64_t dMaskTop = (rangePower % 64 == 0) ? 0xFFFFFFFFFFFFFFFFULL : ((1ULL << (rangePower % 64)) - 1);
+
+  size_t packetSize = 1 + sizeof(DPHEADER) + sizeof(DP) * lgBatch;
+  char *packet = (char *)malloc(packetSize);
+  packet[0] = SERVER_SENDDP;
+  DPHEADER *head = (DPHEADER *)(packet + 1);
+  DP *dp = (DP *)(packet + 1 + sizeof(DPHEADER));
+  head->header = SERVER_HEADER;
+  head->nbDP = lgBatch;
+  head->processId = pid;
+  head->gpuId = 0xFFFF;
+
+  double nextStorm = lgStart + lgStorm;
+  uint64_t nbSent = 0;
+  size_t c = 0;
+
+  p->hasStarted = true;
+
+  while(!endOfSearch && Timer::get_tick() < lgEnd) {
+
+    // Rate limit
+    double now = Timer::get_tick();
+    if(lgRate > 0.0) {
+      double due = lgStart + (double)nbSent / lgRate;
+      if(due > now) {
+        Timer::SleepMillis((uint32_t)((due - now) * 1000.0));
+        now = Timer::get_tick();
+      }
+    }
+
+    // Reconnect storm, every simulated client drops its connection at once
+    if(lgStorm > 0.0 && now >= nextStorm) {
+      for(size_t i = 0; i < nbConn; i++) {
+        if(connected[i]) {
+          close_socket(socks[i]);
+          connected[i] = false;
+        }
+      }
+      nextStorm += lgStorm;
+    }
+
+    // Server busy (backup), retry 1s later as WaitForServer() does
+    if(now < retry[c]) {
+      c = (c + 1) % nbConn;
+      if(c == 0) Timer::SleepMillis(10);
+      continue;
+    }
+
+    if(!connected[c]) {
+      if(!LoadGenConnect(&socks[c],t)) {
+        st->nbError++;
+        c = (c + 1) % nbConn;
+        Timer::SleepMillis(100);
+        continue;
+      }
+      connected[c] = true;
+      ready[c] = false;
+      // A restarted client gets its kangaroos back
+      if(lgNbKang > 0 && lastSave[c] > 0.0 && !LoadGenKangaroos(socks[c],ids[c],false,t)) {
+        st->nbError++;
+        close_socket(socks[c]);
+        connected[c] = false;
+        continue;
+      }
+    }
+
+    // Periodic kangaroo backup (-wi)
+    if(lgNbKang > 0 && (lastSave[c] == 0.0 || now - lastSave[c] > (double)saveWorkPeriod)) {
+      if(!LoadGenKangaroos(socks[c],ids[c],true,t)) {
+        st->nbError++;
+        close_socket(socks[c]);
+        connected[c] = false;
+        continue;
+      }
+      lastSave[c] = Timer::get_tick();
+    }
+
+    // Status round trip, as WaitForServer() after a (re)connection or a
+    // SERVER_BACKUP ack, the status comes with the acks otherwise
+    int32_t status;
+    double t0,t1;
+    if(!ready[c]) {
+      char cmd = SERVER_STATUS;
+      t0 = Timer::get_tick();
+      if(Write(socks[c],&cmd,1,ntimeout) <= 0 || Read(socks[c],(char *)&status,sizeof(int32_t),ntimeout) <= 0) {
+        st->nbError++;
+        close_socket(socks[c]);
+        connected[c] = false;
+        continue;
+      }
+      t1 = Timer::get_tick();
+      lgStatus[t].push_back((float)((t1 - t0) * 1000.0));
+      if(status == SERVER_END) {
+        st->ended = true;
+        endOfSearch = true;
+        break;
+      }
+      if(status == SERVER_BACKUP) {
+        st->nbBackup++;
+        retry[c] = t1 + 1.0;
+        c = (c + 1) % nbConn;
+        continue;
+      }
+      ready[c] = true;
+    }
+
+    // Random DPs, with duplicates and colliding DPs (same x, random distance and herd)
+    head->threadId = ids[c];
+    for(uint32_t i = 0; i < lgBatch; i++) {
+      r ^= r << 13;
+      r ^= r >> 7;
+      r ^= r << 17;
+      uint64_t sel = r >> 32;
+      if(nbRecent > 0 && sel < collThreshold) {
+        dp[i] = recent[(r & 0xFFFFFFFF) % nbRecent];
+        if(sel < dupThreshold) {
+          st->nbDup++;
+          continue;
+        }
+        st->nbColl++;
+      } else {
+        for(int j = 0; j < 4; j++) {
+          r ^= r << 13;
+          r ^= r >> 7;
+          r ^= r << 17;
+          dp[i].x.i64[j] = r;
+        }
+      }
+      for(int j = 0; j < 4; j++) {
+        r ^= r << 13;
+        r ^= r >> 7;
+        r ^= r << 17;
+        dp[i].d.i64[j] = (j < dWords) ? r : 0;
+      }
+      if(dWords > 0) dp[i].d.i64[dWords - 1] &= dMaskTop;
+      dp[i].kIdx = (uint32_t)(r >> 32);
+      recent[recentPos] = dp[i];
+      recentPos = (recentPos + 1) % LG_RECENT;
+      if(nbRecent < LG_RECENT) nbRecent++;
+    }
+
+    t0 = Timer::get_tick();
+    if(Write(socks[c],packet,(int)packetSize,ntimeout) <= 0 ||
+       Read(socks[c],(char *)&status,sizeof(int32_t),ntimeout) <= 0) {
+      st->nbError++;
+      close_socket(socks[c]);
+      connected[c] = false;
+      continue;
+    }
+    t1 = Timer::get_tick();
+    lgAck[t].push_back((float)((t1 - t0) * 1000.0));
+    st->nbDP += lgBatch;
+    st->nbPacket++;
+    st->bytesOut += packetSize;
+    nbSent += lgBatch;
+    if(status == SERVER_BACKUP) {
+      st->nbBackup++;
+      ready[c] = false;
+    }
+    if(status == SERVER_END) {
+      st->ended = true;
+      endOfSearch = true;
+    }
+
+    c = (c + 1) % nbConn;
+
+  }
+
+  for(size_t i = 0; i < nbConn; i++)
+    if(connected[i]) close_socket(socks[i]);
+  free(packet);
+
+  p->isRunning = false;
+
+}
+
+#ifdef WIN64
+DWORD WINAPI _loadGenThread(LPVOID lpParam) {
+#else
+void *_loadGenThread(void *lpParam) {
+#endif
+  TH_PARAM *p = (TH_PARAM *)lpParam;
+  p->obj->LoadGenThread(p);
+  return 0;
+}
+
+static double LoadGenPercentile(vector<float> &v,double q) {
+
+  if(v.size() == 0)
+    return 0.0;
+  size_t i = (size_t)(q * (double)(v.size() - 1) + 0.5);
+  return (double)v[i];
+
+}
+
+static void LoadGenMerge(vector<vector<float> > &in,vector<float> &out) {
+
+  for(size_t i = 0; i < in.size(); i++)
+    out.insert(out.end(),in[i].begin(),in[i].end());
+  sort(out.begin(),out.end());
+
+}
+
+// nbConn simulated clients, served by nbThread threads, send random DPs at
+// dpRate DP/s (0 = as fast as the server acknowledges) during duration seconds
+void Kangaroo::LoadGen(int nbConn,double dpRate,int nbThread,uint32_t batchSize,double dupRate,double collRate,
+                       double stormPeriod,uint64_t nbKang,double duration,string jsonFile) {
+
+  if(nbThread < 1) nbThread = 1;
+  if(nbThread > nbConn) nbThread = nbConn;
+  if(batchSize < 1) batchSize = 1;
+
+  // Range and DP size of the server, the config connection is not used afterwards
+  if(!GetConfigFromServer())
+    return;
+  close_socket(serverConn);
+  isConnected = false;
+  InitRange();
+
+  nbCPUThread = nbThread;
+  nbGPUThread = 0;
+  lgNbConn = nbConn;
+  lgRate = dpRate / (double)nbThread;
+  lgBatch = batchSize;
+  lgDupRate = dupRate;
+  lgCollRate = collRate;
+  lgStorm = stormPeriod;
+  lgNbKang = nbKang;
+  LG_STAT zero;
+  ::memset(&zero,0,sizeof(LG_STAT));
+  lgStat.assign(nbThread,zero);
+  lgAck.assign(nbThread,vector<float>());
+  lgStatus.assign(nbThread,vector<float>());
+  lgConnect.assign(nbThread,vector<float>());
+
+  ::printf("LoadGen: %d connection(s), %d thread(s), %u DP/packet, ",nbConn,nbThread,batchSize);
+  if(dpRate > 0.0) ::printf("%.0f DP/s, ",dpRate);
+  else             ::printf("unlimited rate, ");
+  ::printf("%.1f%% duplicate, %.1f%% collision, %.0fs\n",dupRate * 100.0,collRate * 100.0,duration);
+  if(stormPeriod > 0.0)
+    ::printf("LoadGen: reconnect storm every %.1fs\n",stormPeriod);
+  if(nbKang > 0)
+    ::printf("LoadGen: %.0f kangaroos saved every %ds and loaded after reconnection, per connection\n",
+             (double)nbKang,saveWorkPeriod);
+
+  TH_PARAM *params = (TH_PARAM *)malloc(nbThread * sizeof(TH_PARAM));
+  THREAD_HANDLE *thHandles = (THREAD_HANDLE *)malloc(nbThread * sizeof(THREAD_HANDLE));
+  memset(params,0,nbThread * sizeof(TH_PARAM));
+
+  endOfSearch = false;
+  lgStart = Timer::get_tick();
+  lgEnd = lgStart + duration;
+  for(int i = 0; i < nbThread; i++) {
+    params[i].threadId = i;
+    params[i].isRunning = true;
+    thHandles[i] = LaunchThread(_loadGenThread,params + i);
+  }
+
+  // Progress
+  double lastPrint = lgStart;
+  uint64_t lastDP = 0;
+  while(isAlive(params)) {
+    Timer::SleepMillis(100);
+    double t1 = Timer::get_tick();
+    if(t1 - lastPrint < 2.0)
+      continue;
+    uint64_t nbDP = 0;
+    uint64_t nbBackup = 0;
+    uint64_t nbError = 0;
+    uint64_t nbConnect = 0;
+    for(int i = 0; i < nbThread; i++) {
+      nbDP += lgStat[i].nbDP;
+      nbBackup += lgStat[i].nbBackup;
+      nbError += lgStat[i].nbError;
+      nbConnect += lgStat[i].nbConnect;
+    }
+    ::printf("\r[LoadGen][%.0f DP/s][DP 2^%.2f][Connect %.0f][Backup %.0f][Error %.0f][%s]  ",
+             (double)(nbDP - lastDP) / (t1 - lastPrint),log2((double)nbDP),(double)nbConnect,
+             (double)nbBackup,(double)nbError,GetTimeStr(t1 - lgStart).c_str());
+    lastPrint = t1;
+    lastDP = nbDP;
+  }
+
+  JoinThreads(thHandles,nbThread);
+  FreeHandles(thHandles,nbThread);
+  free(params);
+  free(thHandles);
+  double elapsed = Timer::get_tick() - lgStart;
+
+  LG_STAT tot;
+  ::memset(&tot,0,sizeof(LG_STAT));
+  for(int i = 0; i < nbThread; i++) {
+    LG_STAT &s = lgStat[i];
+    tot.nbDP += s.nbDP;
+    tot.nbPacket += s.nbPacket;
+    tot.nbDup += s.nbDup;
+    tot.nbColl += s.nbColl;
+    tot.nbBackup += s.nbBackup;
+    tot.nbConnect += s.nbConnect;
+    tot.nbError += s.nbError;
+    tot.nbKangSave += s.nbKangSave;
+    tot.nbKangLoad += s.nbKangLoad;
+    tot.kangBytes += s.kangBytes;
+    tot.kangTime += s.kangTime;
+    tot.bytesOut += s.bytesOut;
+    tot.ended = tot.ended || s.ended;
+  }
+
+  vector<float> ack;
+  vector<float> status;
+  vector<float> connect;
+  LoadGenMerge(lgAck,ack);
+  LoadGenMerge(lgStatus,status);
+  LoadGenMerge(lgConnect,connect);
+  double q[5] = { 0.5,0.9,0.99,0.999,1.0 };
+
+  ::printf("\nLoadGen: %.3fs%s\n",elapsed,tot.ended ? ", stopped by the server (SERVER_END)" : "");
+  ::printf("DP acknowledged    %.0f in %.0f packets, %.0f DP/s, %.3f MB/s\n",(double)tot.nbDP,(double)tot.nbPacket,
+           (double)tot.nbDP / elapsed,(double)tot.bytesOut / (1024.0 * 1024.0) / elapsed);
+  ::printf("Injected           %.0f duplicate, %.0f colliding DP\n",(double)tot.nbDup,(double)tot.nbColl);
+  ::printf("Server status      %.0f backup, %.0f error(s)\n",(double)tot.nbBackup,(double)tot.nbError);
+  ::printf("%-18s %9s %9s %9s %9s %9s %9s\n","Latency (ms)","Count","p50","p90","p99","p99.9","max");
+  ::printf("%-18s %9.0f","SENDDP ack",(double)ack.size());
+  for(int i = 0; i < 5; i++) ::printf(" %9.3f",LoadGenPercentile(ack,q[i]));
+  ::printf("\n%-18s %9.0f","Status",(double)status.size());
+  for(int i = 0; i < 5; i++) ::printf(" %9.3f",LoadGenPercentile(status,q[i]));
+  ::printf("\n%-18s %9.0f","Connect",(double)connect.size());
+  for(int i = 0; i < 5; i++) ::printf(" %9.3f",LoadGenPercentile(connect,q[i]));
+  ::printf("\n");
+  if(nbKang > 0)
+    ::printf("Kangaroos          %.0f saved, %.0f loaded, %.3f MB, %.3f MB/s\n",(double)tot.nbKangSave,
+             (double)tot.nbKangLoad,(double)tot.kangBytes / (1024.0 * 1024.0),
+             (tot.kangTime > 0.0) ? (double)tot.kangBytes / (1024.0 * 1024.0) / tot.kangTime : 0.0);
+
+  if(jsonFile.length() == 0)
+    return;
+
+  FILE *f = fopen(jsonFile.c_str(),"w");
+  if(f == NULL) {
+    ::printf("LoadGen: Cannot open %s for writing\n",jsonFile.c_str());
+    ::printf("%s\n",::strerror(errno));
+    return;
+  }
+
+  ::fprintf(f,"{\n");
+  ::fprintf(f,"  \"version\": \"%s\",\n",RELEASE);
+  ::fprintf(f,"  \"connections\": %d,\n",nbConn);
+  ::fprintf(f,"  \"threads\": %d,\n",nbThread);
+  ::fprintf(f,"  \"batch\": %u,\n",batchSize);
+  ::fprintf(f,"  \"rate\": %.1f,\n",dpRate);
+  ::fprintf(f,"  \"dup_rate\": %.4f,\n",dupRate);
+  ::fprintf(f,"  \"coll_rate\": %.4f,\n",collRate);
+  ::fprintf(f,"  \"storm_period\": %.3f,\n",stormPeriod);
+  ::fprintf(f,"  \"kangaroos\": %llu,\n",(unsigned long long)nbKang);
+  ::fprintf(f,"  \"time\": %.6f,\n",elapsed);
+  ::fprintf(f,"  \"ended\": %s,\n",tot.ended ? "true" : "false");
+  ::fprintf(f,"  \"dp\": %llu,\n",(unsigned long long)tot.nbDP);
+  ::fprintf(f,"  \"packets\": %llu,\n",(unsigned long long)tot.nbPacket);
+  ::fprintf(f,"  \"bytes\": %llu,\n",(unsigned long long)tot.bytesOut);
+  ::fprintf(f,"  \"duplicates\": %llu,\n",(unsigned long long)tot.nbDup);
+  ::fprintf(f,"  \"collisions\": %llu,\n",(unsigned long long)tot.nbColl);
+  ::fprintf(f,"  \"backups\": %llu,\n",(unsigned long long)tot.nbBackup);
+  ::fprintf(f,"  \"errors\": %llu,\n",(unsigned long long)tot.nbError);
+  ::fprintf(f,"  \"connects\": %llu,\n",(unsigned long long)tot.nbConnect);
+  ::fprintf(f,"  \"kang_saved\": %llu,\n",(unsigned long long)tot.nbKangSave);
+  ::fprintf(f,"  \"kang_loaded\": %llu,\n",(unsigned long long)tot.nbKangLoad);
+  ::fprintf(f,"  \"kang_bytes\": %llu,\n",(unsigned long long)tot.kangBytes);
+  const char *names[3] = { "ack_ms","status_ms","connect_ms" };
+  vector<float> *lats[3] = { &ack,&status,&connect };
+  for(int l = 0; l < 3; l++) {
+    ::fprintf(f,"  \"%s\": { \"count\": %llu, \"p50\": %.4f, \"p90\": %.4f, \"p99\": %.4f, \"p999\": %.4f, \"max\": %.4f }%s\n",
+              names[l],(unsigned long long)lats[l]->size(),LoadGenPercentile(*lats[l],q[0]),LoadGenPercentile(*lats[l],q[1]),
+              LoadGenPercentile(*lats[l],q[2]),LoadGenPercentile(*lats[l],q[3]),LoadGenPercentile(*lats[l],q[4]),
+              (l < 2) ? "," : "");
+  }
+  ::fprintf(f,"}\n");
+  ::fclose(f);
+
+  ::printf("LoadGen: results written to %s\n",jsonFile.c_str());
+
+}
@@ -283,8 +283,8 @@ bool Kangaroo::MergeWorkPartPart(std::string& part1Name,std::string& part2Name)
 
   if(!partIsEmpty) {
 
-    if(v1 != v2) {
-      ::printf("MergeWorkPartPart: cannot merge workfile of different version\n");
+    if(v1 > WORK_VERSION || v2 > WORK_VERSION) {
+      ::printf("MergeWorkPartPart: cannot merge workfile of unknown version\n");
       ::fclose(f2);
       return true;
     }
@@ -500,16 +500,17 @@ bool Kangaroo::FillEmptyPartFromFile(std::string& partName,std::string& fileName
 
     uint32_t nbItem;
     uint32_t maxItem;
-    unsigned char buff[32];
+    vector<uint8_t> buff;
 
     for(uint32_t h= hStart;h<hStop;h++) {
       ::fread(&nbItem,sizeof(uint32_t),1,f1);
       ::fread(&maxItem,sizeof(uint32_t),1,f1);
       ::fwrite(&nbItem,sizeof(uint32_t),1,f);
       ::fwrite(&maxItem,sizeof(uint32_t),1,f);
-      for(uint32_t i=0;i<nbItem;i++) {
-        ::fread(&buff,32,1,f1);
-        ::fwrite(&buff,32,1,f);
+      if(nbItem) {
+        buff.resize((size_t)ENTRY_FILE_SIZE * nbItem);
+        ::fread(buff.data(),ENTRY_FILE_SIZE,nbItem,f1);
+        ::fwrite(buff.data(),ENTRY_FILE_SIZE,nbItem,f);
       }
       nbDP += nbItem;
     }
@@ -603,8 +604,8 @@ bool Kangaroo::MergeWorkPart(std::string& partName,std::string& file2,bool print
     return true;
   }
 
-  if(v1 != v2) {
-    ::printf("MergeWorkPart: cannot merge workfile of different version\n");
+  if(v1 > WORK_VERSION || v2 > WORK_VERSION) {
+    ::printf("MergeWorkPart: cannot merge workfile of unknown version\n");
     ::fclose(f2);
     return true;
   }
@@ -0,0 +1,300 @@
+/*
+ * This file is part of the BSGS distribution (https://github.com/JeanLucPons/Kangaroo).
+ * Copyright (c) 2020 Jean Luc PONS.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "Kangaroo.h"
+#include "Timer.h"
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#ifndef WIN64
+#include <pthread.h>
+#endif
+
+using namespace std;
+
+// ----------------------------------------------------------------------------
+// Flight recorder: one binary sample per second appended to recFile, and a
+// last one when the recorder is stopped
+
+#ifdef WIN64
+DWORD WINAPI _recordThread(LPVOID lpParam) {
+#else
+void *_recordThread(void *lpParam) {
+#endif
+  TH_PARAM *p = (TH_PARAM *)lpParam;
+  p->obj->RecordThread();
+  free(p);
+  return 0;
+}
+
+void Kangaroo::StartRecorder(int mode) {
+
+  if(recFile.length() == 0)
+    return;
+
+  recMode = mode;
+  recStop = false;
+  TH_PARAM *p = (TH_PARAM *)malloc(sizeof(TH_PARAM));
+  ::memset(p,0,sizeof(TH_PARAM));
+  recThread = LaunchThread(_recordThread,p);
+  recRunning = true;
+
+}
+
+// Write the last sample and close the file
+void Kangaroo::StopRecorder() {
+
+  if(!recRunning)
+    return;
+
+  recStop = true;
+  JoinThreads(&recThread,1);
+  FreeHandles(&recThread,1);
+  recRunning = false;
+
+}
+
+void Kangaroo::RecordThread() {
+
+  FILE *f = fopen(recFile.c_str(),"ab");
+  if(f == NULL) {
+    ::printf("Recorder: Cannot open %s: %s\n",recFile.c_str(),strerror(errno));
+    return;
+  }
+
+  // CPU threads then GPU threads
+  int nbThread = (recMode == REC_SERVER) ? 0 : nbCPUThread + nbGPUThread;
+  if(nbThread > REC_MAX_THREAD) {
+    ::printf("Recorder: %d threads, only the first %d are recorded\n",nbThread,REC_MAX_THREAD);
+    nbThread = REC_MAX_THREAD;
+  }
+  uint64_t lastCount[REC_MAX_THREAD];
+  float *rates = (float *)malloc((nbThread + 1) * sizeof(float));
+  memset(lastCount,0,sizeof(lastCount));
+
+  REC_HEADER h;
+  ::memset(&h,0,sizeof(h));
+  h.tag = REC_TAG_HEADER;
+  h.version = REC_VERSION;
+  h.mode = recMode;
+  h.nbThread = nbThread;
+  h.startTime = (uint64_t)time(NULL);
+  h.dpSize = dpSize;
+  h.pid = Timer::getPID();
+  if(fwrite(&h,sizeof(h),1,f) != 1) {
+    ::printf("Recorder: Cannot write to %s: %s\n",recFile.c_str(),strerror(errno));
+    fclose(f);
+    free(rates);
+    return;
+  }
+  fflush(f);
+
+  double t0 = Timer::get_tick();
+  double tLast = t0;
+  double tNext = t0 + 1.0;
+  bool last = false;
+
+  while(!last) {
+
+    // Sleep by slices so that a stop request is served quickly
+    double t = Timer::get_tick();
+    last = recStop;
+    if(!last && t < tNext) {
+      double toSleep = (tNext - t < 0.1) ? tNext - t : 0.1;
+      Timer::SleepMillis((uint32_t)(toSleep * 1000.0) + 1);
+      continue;
+    }
+    tNext += 1.0;
+    if(tNext < t) tNext = t + 1.0;
+
+    REC_SAMPLE s;
+    ::memset(&s,0,sizeof(s));
+    s.tag = REC_TAG_SAMPLE;
+    s.keyIdx = keyIdx;
+    s.time = t - t0;
+
+    // Thread rates, counters are reset at each key
+    double dt = t - tLast;
+    if(dt < 0.001) dt = 0.001;
+    for(int i = 0; i < nbThread; i++) {
+      int c = (i < nbCPUThread) ? i : 0x80 + (i - nbCPUThread);
+      uint64_t cnt = counters[c];
+      uint64_t d = (cnt >= lastCount[i]) ? cnt - lastCount[i] : cnt;
+      lastCount[i] = cnt;
+      rates[i] = (float)((double)d / dt / 1000000.0);
+      s.keyRate += rates[i];
+    }
+    tLast = t;
+
+    s.nbQueued = dpQueue.getTotalPushed();
+    s.nbSent = pipeStat.nbSent;
+    s.queueDepth = (recMode == REC_CLIENT) ? dpQueue.size() : 0;
+    s.nbPacket = pipeStat.nbPacket;
+    s.ackTime = pipeStat.ackTime;
+    s.nbRecv = pipeStat.nbRecv;
+    s.nbAdded = pipeStat.nbAdded;
+    s.nbPending = pipeStat.nbPending;
+    s.nbSave = serverStat.nbSave;
+    s.saveTime = serverStat.saveTime;
+    s.stallTime = serverStat.stallTime;
+    s.nbClient = (recMode == REC_SERVER) ? connectedClient : 0;
+    s.bytesOut = pipeStat.bytesOut;
+    s.bytesIn = pipeStat.bytesIn;
+    s.tableItem = hashTable.GetNbItem();
+    s.tableByte = hashTable.GetUsedByte();
+
+    if(fwrite(&s,sizeof(s),1,f) != 1 ||
+       (nbThread > 0 && fwrite(rates,sizeof(float),nbThread,f) != (size_t)nbThread)) {
+      ::printf("Recorder: Cannot write to %s: %s\n",recFile.c_str(),strerror(errno));
+      break;
+    }
+    fflush(f);
+
+  }
+
+  fclose(f);
+  free(rates);
+
+}
+
+// ----------------------------------------------------------------------------
+// Decoder: export a recorder file to CSV
+
+static const char *recModeName[] = { "standalone","client","server" };
+
+bool Kangaroo::RecordDump(string &recFile,string &csvFile) {
+
+  FILE *f = fopen(recFile.c_str(),"rb");
+  if(f == NULL) {
+    ::printf("RecordDump: Cannot open %s: %s\n",recFile.c_str(),strerror(errno));
+    return false;
+  }
+
+  // First pass: runs and thread columns
+#ifdef WIN64
+  _fseeki64(f,0,SEEK_END);
+#else
+  fseeko(f,0,SEEK_END);
+#endif
+  uint64_t fileSize = FTell(f);
+  FSeek(f,0);
+
+  int maxThread = 0;
+  int nbRun = 0;
+  REC_HEADER h;
+  ::memset(&h,0,sizeof(h));
+  bool truncated = false;
+  uint64_t pos = 0;
+
+  while(pos < fileSize) {
+    uint32_t tag;
+    if(fread(&tag,sizeof(uint32_t),1,f) != 1) { truncated = true; break; }
+    if(tag == REC_TAG_HEADER) {
+      FSeek(f,pos);
+      if(fread(&h,sizeof(h),1,f) != 1) { truncated = true; break; }
+      if(h.version != REC_VERSION || h.nbThread > REC_MAX_THREAD) {
+        ::printf("RecordDump: %s unsupported version %d\n",recFile.c_str(),h.version);
+        fclose(f);
+        return false;
+      }
+      if((int)h.nbThread > maxThread) maxThread = h.nbThread;
+      pos += sizeof(h);
+      nbRun++;
+    } else if(tag == REC_TAG_SAMPLE && nbRun > 0) {
+      pos += sizeof(REC_SAMPLE) + h.nbThread * sizeof(float);
+      if(pos > fileSize) { truncated = true; break; }
+      FSeek(f,pos);
+    } else {
+      ::printf("RecordDump: %s is not a recorder file or is corrupted\n",recFile.c_str());
+      fclose(f);
+      return false;
+    }
+  }
+
+  FILE *out = fopen(csvFile.c_str(),"w");
+  if(out == NULL) {
+    ::printf("RecordDump: Cannot open %s: %s\n",csvFile.c_str(),strerror(errno));
+    fclose(f);
+    return false;
+  }
+
+  fprintf(out,"run,mode,pid,unix_time,time,key,mks");
+  for(int i = 0; i < maxThread; i++)
+    fprintf(out,",th%d_mks",i);
+  fprintf(out,",dp_emitted,dp_emitted_s,dp_sent,dp_sent_s,dp_queue,packets,ack_ms"
+              ",dp_recv,dp_recv_s,dp_inserted,dp_inserted_s,dp_pending,saves,save_s,stall_s,clients"
+              ",bytes_out,bytes_in,table_dp,table_mb\n");
+
+  // Second pass
+  FSeek(f,0);
+  REC_SAMPLE s;
+  REC_SAMPLE last;
+  float rates[REC_MAX_THREAD];
+  int run = 0;
+  uint64_t nbSample = 0;
+
+  while(true) {
+
+    if(fread(&s,sizeof(uint32_t),1,f) != 1)
+      break;
+    if(s.tag == REC_TAG_HEADER) {
+      h.tag = s.tag;
+      if(fread((char *)&h + sizeof(uint32_t),sizeof(h) - sizeof(uint32_t),1,f) != 1) break;
+      ::memset(&last,0,sizeof(last));
+      run++;
+      continue;
+    }
+    if(fread((char *)&s + sizeof(uint32_t),sizeof(s) - sizeof(uint32_t),1,f) != 1) break;
+    if(fread(rates,sizeof(float),h.nbThread,f) != h.nbThread) break;
+
+    double dt = s.time - last.time;
+    if(dt <= 0) dt = 1.0;
+    uint64_t nbAck = s.nbPacket - last.nbPacket;
+    double ack = (nbAck > 0) ? (s.ackTime - last.ackTime) * 1000.0 / (double)nbAck : 0.0;
+
+    fprintf(out,"%d,%s,%u,%.3f,%.3f,%u,%.3f",run,h.mode <= REC_SERVER ? recModeName[h.mode] : "?",h.pid,
+            (double)h.startTime + s.time,s.time,s.keyIdx,s.keyRate);
+    for(int i = 0; i < maxThread; i++) {
+      if(i < (int)h.nbThread) fprintf(out,",%.3f",rates[i]);
+      else                    fprintf(out,",");
+    }
+    fprintf(out,",%llu,%.1f,%llu,%.1f,%llu,%llu,%.3f",
+            (unsigned long long)s.nbQueued,(double)(s.nbQueued - last.nbQueued) / dt,
+            (unsigned long long)s.nbSent,(double)(s.nbSent - last.nbSent) / dt,
+            (unsigned long long)s.queueDepth,(unsigned long long)s.nbPacket,ack);
+    fprintf(out,",%llu,%.1f,%llu,%.1f,%llu,%llu,%.3f,%.3f,%llu",
+            (unsigned long long)s.nbRecv,(double)(s.nbRecv - last.nbRecv) / dt,
+            (unsigned long long)s.nbAdded,(double)(s.nbAdded - last.nbAdded) / dt,
+            (unsigned long long)s.nbPending,(unsigned long long)s.nbSave,s.saveTime,s.stallTime,
+            (unsigned long long)s.nbClient);
+    fprintf(out,",%llu,%llu,%llu,%.1f\n",
+            (unsigned long long)s.bytesOut,(unsigned long long)s.bytesIn,
+            (unsigned long long)s.tableItem,(double)s.tableByte / (1024.0 * 1024.0));
+
+    last = s;
+    nbSample++;
+
+  }
+
+  fclose(out);
+  fclose(f);
+
+  ::printf("RecordDump: %d run(s), %llu sample(s) written to %s%s\n",run,(unsigned long long)nbSample,
+           csvFile.c_str(),truncated ? " (last sample truncated)" : "");
+  return true;
+
+}
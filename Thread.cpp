@@ -17,6 +17,7 @@
 
 #include "Kangaroo.h"
 #include "Timer.h"
+#include "Log.h"
 #include <string.h>
 #define _USE_MATH_DEFINES
 #include <math.h>
@@ -86,12 +87,12 @@ bool Kangaroo::hasStarted(TH_PARAM *p) {
 
 // ----------------------------------------------------------------------------
 
-bool Kangaroo::isWaiting(TH_PARAM *p) {
+bool Kangaroo::isWaiting(TH_PARAM *p,bool waiting) {
 
   bool isWaiting = true;
   int total = nbCPUThread + nbGPUThread;
   for (int i = 0; i < total; i++)
-    isWaiting = isWaiting && p[i].isWaiting;
+    isWaiting = isWaiting && (p[i].isWaiting == waiting);
 
   return isWaiting;
 
@@ -169,6 +170,7 @@ void Kangaroo::ProcessServer() {
   t0 = Timer::get_tick();
   startTime = t0;
   double lastSave = 0;
+  double lastDetailedPrint = 0;
 
   // Acquire mutex ownership
 #ifndef WIN64
@@ -185,57 +187,79 @@ void Kangaroo::ProcessServer() {
     LOCK(ghMutex);
     // Get back all dps
     localCache.clear();
-    for(int i=0;i<(int)recvDP.size();i++)
+    for(int i=0;i<(int)recvDP.size();i++) {
+      if(sampleRate > 0.0 && sourceStats[recvDP[i].sourceId].quarantined) {
+        // Sender quarantined after these DPs were received
+        clientStats[recvDP[i].clientId].nbRejected += recvDP[i].nbDP;
+        sourceStats[recvDP[i].sourceId].nbRejected += recvDP[i].nbDP;
+        free(recvDP[i].dp);
+        continue;
+      }
       localCache.push_back(recvDP[i]);
+    }
     recvDP.clear();
+    pipeStat.nbPending = 0;
+    if(sampleRate > 0.0)
+      ReleaseSources(t0);
     UNLOCK(ghMutex);
 
     // Add to hashTable
-    static uint64_t totalDPsProcessed = 0;
-    static uint64_t tameDPs = 0;
-    static uint64_t wildDPs = 0;
-
     for(int i = 0; i<(int)localCache.size() && !endOfSearch; i++) {
       DP_CACHE dp = localCache[i];
+      uint64_t nbTame = 0;
+      uint64_t nbWild = 0;
+      uint64_t nbDead = 0;
+      uint64_t nbDuplicate = serverStat.nbDuplicate;
       for(int j = 0; j<(int)dp.nbDP && !endOfSearch; j++) {
         uint32_t kType = dp.dp[j].kIdx % 2;
-        totalDPsProcessed++;
+        if(kType == TAME) nbTame++;
+        else              nbWild++;
 
-        // Count TAME vs WILD DPs
-        if(kType == 0) {
-          tameDPs++;
-        } else {
-          wildDPs++;
-        }
-
-        // Debug: Log first few DPs and periodically
-        if(totalDPsProcessed <= 10 || totalDPsProcessed % 100 == 0) {
-          ::printf("\n[Server DEBUG] DP #%llu: kIdx=%u, kType=%u (%s)",
-                   (unsigned long long)totalDPsProcessed,
-                   dp.dp[j].kIdx,
-                   kType,
-                   kType == 0 ? "TAME" : "WILD");
-          ::printf(" | Stats: TAME=%llu, WILD=%llu",
-                   (unsigned long long)tameDPs,
-                   (unsigned long long)wildDPs);
-        }
+        LOG_RATE(LOGC_SERVER,LOG_TRACE,10,"DP kIdx=%u, kType=%u (%s) from client %u",
+                 dp.dp[j].kIdx,kType,kType == TAME ? "TAME" : "WILD",dp.clientId);
 
+        pipeStat.nbAdded++;
         if(!AddToTable(&dp.dp[j].x,&dp.dp[j].d,kType)) {
           // Collision inside the same herd
-          ::printf("\n[Server] Same-herd collision detected (type=%u)\n", kType);
+          LOG(LOGC_SERVER,LOG_DEBUG,"Same-herd collision (type=%u)",kType);
           collisionInSameHerd++;
+          nbDead++;
         }
       }
       free(dp.dp);
+
+      // Accounting of the sender
+      nbDuplicate = serverStat.nbDuplicate - nbDuplicate;
+      serverStat.nbTame += nbTame;
+      serverStat.nbWild += nbWild;
+      LOCK(ghMutex);
+      CLIENT_STAT *cs = &clientStats[dp.clientId];
+      cs->nbTame += nbTame;
+      cs->nbWild += nbWild;
+      cs->nbDead += nbDead;
+      cs->nbDuplicate += nbDuplicate;
+      sourceStats[dp.sourceId].nbDead += nbDead;
+      sourceStats[dp.sourceId].nbDuplicate += nbDuplicate;
+      UNLOCK(ghMutex);
     }
 
+    // Work files dropped by operators
+    if(dropDir.length() > 0 && !endOfSearch)
+      IngestDropDir();
+
+    // Remove wrong DPs sent by a quarantined client
+    if(sampleRate > 0.0 && !endOfSearch)
+      PurgeTable();
+
     t1 = Timer::get_tick();
 
     double toSleep = SEND_PERIOD - (t1-t0);
-    if(toSleep<0) toSleep = 0.0;
+    if(toSleep<0 || endOfSearch) toSleep = 0.0;
     Timer::SleepMillis((uint32_t)(toSleep*1000.0));
 
     t1 = Timer::get_tick();
+    UpdateServerRates(t1);
+    CheckClients(t1);
 
     if(!endOfSearch) {
       printf("\r[Client %d][Kang 2^%.2f][DP Count 2^%.2f/2^%.2f][Dead %.0f][%s][%s]  ",
@@ -248,53 +272,26 @@ void Kangaroo::ProcessServer() {
         hashTable.GetSizeInfo().c_str()
         );
 
-      // Print detailed statistics every 10 seconds
-      static double lastDetailedPrint = 0;
-      if((t1 - lastDetailedPrint) > 10.0) {
-        ::printf("\n========== SERVER STATS ==========");
-        ::printf("\n[Server STATS] Total DPs processed: %llu (TAME: %llu, WILD: %llu)",
-                 (unsigned long long)totalDPsProcessed,
-                 (unsigned long long)tameDPs,
-                 (unsigned long long)wildDPs);
-        ::printf("\n[Server STATS] Hash table entries: %llu, Same-herd collisions: %.0f",
-                 (unsigned long long)hashTable.GetNbItem(),
-                 (double)collisionInSameHerd);
-        if(totalDPsProcessed > 0) {
-          double tamePercent = 100.0 * tameDPs / totalDPsProcessed;
-          double wildPercent = 100.0 * wildDPs / totalDPsProcessed;
-          ::printf("\n[Server STATS] Distribution: TAME=%.1f%%, WILD=%.1f%%",
-                   tamePercent, wildPercent);
-        }
-
-        // CRITICAL: Check if we should have found a collision by now
-        if(totalDPsProcessed > 100) {
-          ::printf("\n[Server STATS] ⚠️  WARNING: %llu DPs processed, but NO COLLISION detected!",
-                   (unsigned long long)totalDPsProcessed);
-          ::printf("\n[Server STATS] ⚠️  This is statistically IMPOSSIBLE with proper collision detection!");
-
-          // Check hash table bucket distribution
-          uint32_t bucketsUsed = 0;
-          uint32_t bucketsWithMultiple = 0;
-          for(uint32_t h = 0; h < HASH_SIZE; h++) {
-            if(hashTable.E[h].nbItem > 0) {
-              bucketsUsed++;
-              if(hashTable.E[h].nbItem > 1) {
-                bucketsWithMultiple++;
-              }
-            }
-          }
-          ::printf("\n[Server STATS] Hash buckets: %u used, %u with multiple items (should trigger search)",
-                   bucketsUsed, bucketsWithMultiple);
-          if(bucketsWithMultiple == 0) {
-            ::printf("\n[Server STATS] 🔴 CRITICAL: No buckets have >1 item - hash distribution problem!");
-          }
-        }
-        ::printf("\n==================================\n");
-        ::fflush(stdout);
+      // Detailed statistics every 10 seconds
+      if(LOG_ON(LOGC_SERVER,LOG_INFO) && (t1 - lastDetailedPrint) > 10.0) {
+        uint64_t nbDP = serverStat.nbTame + serverStat.nbWild;
+        LOG(LOGC_SERVER,LOG_INFO,"DP processed: %llu (TAME %.1f%%, WILD %.1f%%), table: %llu, same-herd collisions: %.0f",
+            (unsigned long long)nbDP,
+            nbDP ? 100.0 * serverStat.nbTame / nbDP : 0.0,
+            nbDP ? 100.0 * serverStat.nbWild / nbDP : 0.0,
+            (unsigned long long)hashTable.GetNbItem(),
+            (double)collisionInSameHerd);
+        LOG(LOGC_SERVER,LOG_INFO,"Ingest: %.0f DP/s, pending: %llu (max %llu), duplicates: %llu",
+            serverStat.dpRate,
+            (unsigned long long)pipeStat.nbPending,
+            (unsigned long long)pipeStat.maxPending,
+            (unsigned long long)serverStat.nbDuplicate);
         lastDetailedPrint = t1;
       }
     }
 
+    PollServerWork(false);
+
     if(workFile.length() > 0 && !endOfSearch) {
       if((t1 - lastSave) > saveWorkPeriod) {
         SaveServerWork();
@@ -304,6 +301,14 @@ void Kangaroo::ProcessServer() {
 
   }
 
+  // Wait for a save still running and report it
+  PollServerWork(true);
+
+  StopRecorder();
+
+  if(pipeStatFile.length() > 0)
+    SavePipeStat(Timer::get_tick() - startTime);
+
 }
 
 // Wait for end of threads and display stats
@@ -396,6 +401,10 @@ void Kangaroo::Process(TH_PARAM *params,std::string unit) {
 
     }
 
+#ifdef WALK_PROFILE
+    WalkProfilePoll(params,nbCPUThread);
+#endif
+
     // Save request
     if(workFile.length() > 0 && !endOfSearch) {
       if((t1 - lastSave) > saveWorkPeriod) {
@@ -25,6 +25,7 @@ LARGE_INTEGER Timer::perfTickStart;
 double Timer::perfTicksPerSec;
 LARGE_INTEGER Timer::qwTicksPerSec;
 #include <wincrypt.h>
+#include <intrin.h>
 
 #else
 
@@ -32,6 +33,9 @@ LARGE_INTEGER Timer::qwTicksPerSec;
 #include <unistd.h>
 #include <string.h>
 time_t Timer::tickStart;
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
 
 #endif
 
@@ -62,6 +66,17 @@ double Timer::get_tick() {
 
 }
 
+// Time stamp counter, 0 when the CPU does not provide one
+uint64_t Timer::getTSC() {
+
+#if defined(WIN64) || defined(__x86_64__) || defined(__i386__)
+  return __rdtsc();
+#else
+  return 0;
+#endif
+
+}
+
 uint32_t Timer::getSeed32() {
   return ::strtoul(getSeed(4).c_str(),NULL,16);
 }
@@ -38,6 +38,7 @@ public:
   static uint32_t getSeed32();
   static uint32_t getPID();
   static std::string getTS();
+  static uint64_t getTSC();
 
 #ifdef WIN64
   static LARGE_INTEGER perfTickStart;
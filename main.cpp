@@ -17,6 +17,7 @@
 
 #include "Kangaroo.h"
 #include "Timer.h"
+#include "Log.h"
 #include "SECPK1/SECP256k1.h"
 #include "GPU/GPUEngine.h"
 #include <fstream>
@@ -46,9 +47,14 @@ void printUsage() {
   printf(" -wi workInterval: Periodic interval (in seconds) for saving work\n");
   printf(" -ws: Save kangaroos in the work file\n");
   printf(" -wss: Save kangaroos via the server\n");
+  printf(" -wsc: Save kangaroos in compressed format (implies -ws)\n");
   printf(" -wsplit: Split work file of server and reset hashtable\n");
+  printf(" -wj: Incremental save, append new DPs to a journal (workfile.jnl)\n");
+  printf(" -wmap: Save work file in mapped format (instant restart with -i)\n");
+  printf(" -wprefault: Prefetch mapped work file in background when loading\n");
   printf(" -wm file1 file2 destfile: Merge work file\n");
   printf(" -wmdir dir destfile: Merge directory of work files\n");
+  printf(" -wdrop dir: Server: add work files moved into dir to the live table\n");
   printf(" -wt timeout: Save work timeout in millisec (default is 3000ms)\n");
   printf(" -winfo file1: Work file info file\n");
   printf(" -wpartcreate name: Create empty partitioned work file (name is a directory)\n");
@@ -58,9 +64,37 @@ void printUsage() {
   printf(" -c server_ip: Start in client mode and connect to server server_ip\n");
   printf(" -sp port: Server port, default is 17403\n");
   printf(" -nt timeout: Network timeout in millisec (default is 30000ms)\n");
+  printf(" -vsample percent: Server: verify a random sample of client DPs, quarantine senders of wrong DPs\n");
+  printf(" -vwrong percent: Server: quarantine a DP source (process, GPU) when more than percent of its sampled DPs are wrong (default 1)\n");
+  printf(" -vmin nbDP: Server: DPs of a source sampled before it can be quarantined (default 100)\n");
+  printf(" -vrelease seconds: Server: release a quarantined source after seconds, 0 to keep it until restart (default 3600)\n");
+  printf(" -kcheck n: Verify a few kangaroos of each thread every n walk iterations, reseed the wrong ones\n");
   printf(" -o fileName: output result to fileName\n");
   printf(" -l: List cuda enabled devices\n");
   printf(" -check: Check GPU kernel vs CPU\n");
+  printf(" -bench: Run the field and curve arithmetic microbenchmarks\n");
+  printf(" -benchjson fileName: Write the microbenchmark (or -benchtable, -statsolve, -lbench, -loadgen) results as JSON to fileName, implies -bench\n");
+  printf(" -benchtable nbDP: Benchmark the DP table with nbDP synthetic DPs (DP size -d, threads -t)\n");
+  printf(" -benchdup percent: Percentage of duplicate DPs in the -benchtable stream\n");
+  printf(" -benchreplay workFile: Benchmark the DP table with the DPs of workFile ([nbDP] from -benchtable)\n");
+  printf(" -statsolve nbKey[,rangeBits]: Solve nbKey random keys of a 2^rangeBits range (default 40) per configuration\n");
+  printf(" -statdp dp1,dp2,...: DP sizes of -statsolve configurations (default -d or suggested)\n");
+  printf(" -statgrp g1,g2,...: Kangaroos per CPU thread of -statsolve configurations (default 1024)\n");
+  printf(" -statjump n: Number of jump tables of -statsolve configurations (default 1)\n");
+  printf(" -lbench nbClient[,rangeBits]: Loopback benchmark, a server and nbClient CPU clients (threads -t, DP -d, port -sp) solve a known key of a 2^rangeBits range (default 40)\n");
+  printf(" -pstat fileName: Write the DP pipeline counters (client or server) to fileName at the end of the search\n");
+  printf(" -metrics port: Server metrics (DP rates, table, queues, saves, progress, per client accounting and anomaly flags) in text format at http://127.0.0.1:port/metrics\n");
+  printf(" -rec fileName: Flight recorder, append a binary sample of the rates, queues, ack latencies, saves and table size to fileName every second\n");
+  printf(" -recdump recFile csvFile: Export a -rec file to CSV\n");
+  printf(" -log level|cat=level,...: Log level (error,warn,info,debug,trace) of all or some categories (table,server,net,gpu,coll), default info\n");
+  printf(" -logfile fileName: Write log messages to fileName instead of the console\n");
+  printf(" -loadgen nbConn[,dpRate]: Load generator, nbConn simulated clients (threads -t) send random DPs to the server (-c), dpRate DP/s (default unlimited)\n");
+  printf(" -lgbatch nbDP: DP per packet of -loadgen (default 1000)\n");
+  printf(" -lgdup percent: Percentage of duplicate DPs sent by -loadgen\n");
+  printf(" -lgcoll percent: Percentage of colliding DPs (same x, random distance and herd) sent by -loadgen\n");
+  printf(" -lgstorm period: Every period seconds, all -loadgen connections drop and reconnect\n");
+  printf(" -lgkang nbKangaroo: Each -loadgen connection saves nbKangaroo kangaroos to the server every -wi seconds and loads them after reconnection\n");
+  printf(" -lgtime seconds: Duration of -loadgen (default 60)\n");
   printf(" inFile: intput configuration file\n");
   exit(0);
 
@@ -141,6 +175,28 @@ static int dp = -1;
 static int nbCPUThread;
 static string configFile = "";
 static bool checkFlag = false;
+static bool benchFlag = false;
+static string benchFile = "";
+static uint64_t benchTableDP = 0;
+static double benchDupRate = 0.0;
+static string benchReplay = "";
+static vector<int> statSolve;
+static vector<int> statDP;
+static vector<int> statGrp;
+static int statJump = 1;
+static vector<int> loopBench;
+static string pipeStatFile = "";
+static int metricsPort = 0;
+static string recFile = "";
+static string recDumpFile = "";
+static string recDumpCsv = "";
+static vector<int> loadGen;
+static uint32_t lgBatch = 1000;
+static double lgDupRate = 0.0;
+static double lgCollRate = 0.0;
+static double lgStorm = 0.0;
+static uint64_t lgNbKang = 0;
+static double lgTime = 60.0;
 static bool gpuEnable = false;
 static vector<int> gpuId = { 0 };
 static vector<int> gridSize;
@@ -150,6 +206,7 @@ static string iWorkFile = "";
 static uint32_t savePeriod = 60;
 static bool saveKangaroo = false;
 static bool saveKangarooByServer = false;
+static bool compressKangaroo = false;
 static string merge1 = "";
 static string merge2 = "";
 static string mergeDest = "";
@@ -163,6 +220,15 @@ static bool serverMode = false;
 static string serverIP = "";
 static string outputFile = "";
 static bool splitWorkFile = false;
+static bool useJournal = false;
+static bool mapWorkFile = false;
+static bool prefault = false;
+static string dropDir = "";
+static double sampleRate = 0.0;
+static double quarantineWrong = QUARANTINE_WRONG;
+static uint64_t quarantineMin = QUARANTINE_MIN;
+static double quarantineTime = QUARANTINE_TIME;
+static uint64_t kCheckPeriod = 0;
 
 int main(int argc, char* argv[]) {
 
@@ -263,9 +329,67 @@ int main(int argc, char* argv[]) {
     } else if(strcmp(argv[a],"-wss") == 0) {
       a++;
       saveKangarooByServer = true;
+    } else if(strcmp(argv[a],"-wsc") == 0) {
+      a++;
+      compressKangaroo = true;
     } else if(strcmp(argv[a],"-wsplit") == 0) {
       a++;
       splitWorkFile = true;
+    } else if(strcmp(argv[a],"-wj") == 0) {
+      a++;
+      useJournal = true;
+    } else if(strcmp(argv[a],"-wmap") == 0) {
+      a++;
+      mapWorkFile = true;
+    } else if(strcmp(argv[a],"-wprefault") == 0) {
+      a++;
+      prefault = true;
+    } else if(strcmp(argv[a],"-wdrop") == 0) {
+      CHECKARG("-wdrop",1);
+      dropDir = string(argv[a]);
+      a++;
+    } else if(strcmp(argv[a],"-vsample") == 0) {
+      CHECKARG("-vsample",1);
+      sampleRate = getDouble("sampleRate",argv[a]) / 100.0;
+      if(sampleRate < 0.0 || sampleRate > 1.0) {
+        printf("Invalid sampleRate argument, must be in [0,100]\n");
+        exit(-1);
+      }
+      a++;
+    } else if(strcmp(argv[a],"-vwrong") == 0) {
+      CHECKARG("-vwrong",1);
+      quarantineWrong = getDouble("vwrong",argv[a]) / 100.0;
+      if(quarantineWrong < 0.0 || quarantineWrong >= 1.0) {
+        printf("Invalid vwrong argument, must be in [0,100[\n");
+        exit(-1);
+      }
+      a++;
+    } else if(strcmp(argv[a],"-vmin") == 0) {
+      CHECKARG("-vmin",1);
+      int n = getInt("vmin",argv[a]);
+      if(n < 1) {
+        printf("Invalid vmin argument, must be positive\n");
+        exit(-1);
+      }
+      quarantineMin = (uint64_t)n;
+      a++;
+    } else if(strcmp(argv[a],"-vrelease") == 0) {
+      CHECKARG("-vrelease",1);
+      quarantineTime = getDouble("vrelease",argv[a]);
+      if(quarantineTime < 0.0) {
+        printf("Invalid vrelease argument, must be positive\n");
+        exit(-1);
+      }
+      a++;
+    } else if(strcmp(argv[a],"-kcheck") == 0) {
+      CHECKARG("-kcheck",1);
+      int n = getInt("kcheck",argv[a]);
+      if(n < 0) {
+        printf("Invalid kcheck argument, must be positive\n");
+        exit(-1);
+      }
+      kCheckPeriod = (uint64_t)n;
+      a++;
     } else if(strcmp(argv[a],"-wpartcreate") == 0) {
       CHECKARG("-wpartcreate",1);
       workFile = string(argv[a]);
@@ -306,6 +430,149 @@ int main(int argc, char* argv[]) {
     } else if(strcmp(argv[a],"-check") == 0) {
       checkFlag = true;
       a++;
+    } else if(strcmp(argv[a],"-bench") == 0) {
+      benchFlag = true;
+      a++;
+    } else if(strcmp(argv[a],"-benchtable") == 0) {
+      CHECKARG("-benchtable",1);
+      double n = getDouble("benchtable",argv[a]);
+      if(n < 1.0) {
+        printf("Invalid benchtable argument, must be positive\n");
+        exit(-1);
+      }
+      benchTableDP = (uint64_t)n;
+      a++;
+    } else if(strcmp(argv[a],"-benchdup") == 0) {
+      CHECKARG("-benchdup",1);
+      benchDupRate = getDouble("benchdup",argv[a]) / 100.0;
+      if(benchDupRate < 0.0 || benchDupRate >= 1.0) {
+        printf("Invalid benchdup argument, must be in [0,100[\n");
+        exit(-1);
+      }
+      a++;
+    } else if(strcmp(argv[a],"-benchreplay") == 0) {
+      CHECKARG("-benchreplay",1);
+      benchReplay = string(argv[a]);
+      a++;
+    } else if(strcmp(argv[a],"-statsolve") == 0) {
+      CHECKARG("-statsolve",1);
+      getInts("statsolve",statSolve,string(argv[a]),',');
+      if(statSolve.size() < 1 || statSolve.size() > 2 || statSolve[0] < 1) {
+        printf("Invalid statsolve argument, nbKey[,rangeBits] expected\n");
+        exit(-1);
+      }
+      if(statSolve.size() == 1) statSolve.push_back(40);
+      if(statSolve[1] < 16 || statSolve[1] > 125) {
+        printf("Invalid statsolve range, must be in [16,125]\n");
+        exit(-1);
+      }
+      a++;
+    } else if(strcmp(argv[a],"-statdp") == 0) {
+      CHECKARG("-statdp",1);
+      getInts("statdp",statDP,string(argv[a]),',');
+      a++;
+    } else if(strcmp(argv[a],"-statgrp") == 0) {
+      CHECKARG("-statgrp",1);
+      getInts("statgrp",statGrp,string(argv[a]),',');
+      for(int i = 0; i < (int)statGrp.size(); i++) {
+        if(statGrp[i] < 2 || statGrp[i] % 2 != 0) {
+          printf("Invalid statgrp argument, group sizes must be even\n");
+          exit(-1);
+        }
+      }
+      a++;
+    } else if(strcmp(argv[a],"-statjump") == 0) {
+      CHECKARG("-statjump",1);
+      statJump = getInt("statjump",argv[a]);
+      a++;
+    } else if(strcmp(argv[a],"-lbench") == 0) {
+      CHECKARG("-lbench",1);
+      getInts("lbench",loopBench,string(argv[a]),',');
+      if(loopBench.size() < 1 || loopBench.size() > 2 || loopBench[0] < 1) {
+        printf("Invalid lbench argument, nbClient[,rangeBits] expected\n");
+        exit(-1);
+      }
+      if(loopBench.size() == 1) loopBench.push_back(40);
+      if(loopBench[1] < 16 || loopBench[1] > 125) {
+        printf("Invalid lbench range, must be in [16,125]\n");
+        exit(-1);
+      }
+      a++;
+    } else if(strcmp(argv[a],"-pstat") == 0) {
+      CHECKARG("-pstat",1);
+      pipeStatFile = string(argv[a]);
+      a++;
+    } else if(strcmp(argv[a],"-metrics") == 0) {
+      CHECKARG("-metrics",1);
+      metricsPort = getInt("metricsPort",argv[a]);
+      if(metricsPort < 1 || metricsPort > 65535) {
+        printf("Invalid metrics port, must be in [1,65535]\n");
+        exit(-1);
+      }
+      a++;
+    } else if(strcmp(argv[a],"-rec") == 0) {
+      CHECKARG("-rec",1);
+      recFile = string(argv[a]);
+      a++;
+    } else if(strcmp(argv[a],"-recdump") == 0) {
+      CHECKARG("-recdump",1);
+      recDumpFile = string(argv[a]);
+      CHECKARG("-recdump",2);
+      recDumpCsv = string(argv[a]);
+      a++;
+    } else if(strcmp(argv[a],"-log") == 0) {
+      CHECKARG("-log",1);
+      if(!Log::SetLevels(string(argv[a])))
+        exit(-1);
+      a++;
+    } else if(strcmp(argv[a],"-logfile") == 0) {
+      CHECKARG("-logfile",1);
+      if(!Log::SetFile(string(argv[a])))
+        exit(-1);
+      a++;
+    } else if(strcmp(argv[a],"-loadgen") == 0) {
+      CHECKARG("-loadgen",1);
+      getInts("loadgen",loadGen,string(argv[a]),',');
+      if(loadGen.size() < 1 || loadGen.size() > 2 || loadGen[0] < 1) {
+        printf("Invalid loadgen argument, nbConn[,dpRate] expected\n");
+        exit(-1);
+      }
+      if(loadGen.size() == 1) loadGen.push_back(0);
+      a++;
+    } else if(strcmp(argv[a],"-lgbatch") == 0) {
+      CHECKARG("-lgbatch",1);
+      int n = getInt("lgbatch",argv[a]);
+      if(n < 1 || n > 1000000) {
+        printf("Invalid lgbatch argument, must be in [1,1000000]\n");
+        exit(-1);
+      }
+      lgBatch = (uint32_t)n;
+      a++;
+    } else if(strcmp(argv[a],"-lgdup") == 0) {
+      CHECKARG("-lgdup",1);
+      lgDupRate = getDouble("lgdup",argv[a]) / 100.0;
+      a++;
+    } else if(strcmp(argv[a],"-lgcoll") == 0) {
+      CHECKARG("-lgcoll",1);
+      lgCollRate = getDouble("lgcoll",argv[a]) / 100.0;
+      a++;
+    } else if(strcmp(argv[a],"-lgstorm") == 0) {
+      CHECKARG("-lgstorm",1);
+      lgStorm = getDouble("lgstorm",argv[a]);
+      a++;
+    } else if(strcmp(argv[a],"-lgkang") == 0) {
+      CHECKARG("-lgkang",1);
+      lgNbKang = (uint64_t)getDouble("lgkang",argv[a]);
+      a++;
+    } else if(strcmp(argv[a],"-lgtime") == 0) {
+      CHECKARG("-lgtime",1);
+      lgTime = getDouble("lgtime",argv[a]);
+      a++;
+    } else if(strcmp(argv[a],"-benchjson") == 0) {
+      CHECKARG("-benchjson",1);
+      benchFlag = true;
+      benchFile = string(argv[a]);
+      a++;
     } else if(a == argc - 1) {
       configFile = string(argv[a]);
       a++;
@@ -326,11 +593,39 @@ int main(int argc, char* argv[]) {
     exit(-1);
   }
 
+  Log::Start();
+
   Kangaroo *v = new Kangaroo(secp,dp,gpuEnable,workFile,iWorkFile,savePeriod,saveKangaroo,saveKangarooByServer,
-                             maxStep,wtimeout,port,ntimeout,serverIP,outputFile,splitWorkFile);
+                             maxStep,wtimeout,port,ntimeout,serverIP,outputFile,splitWorkFile,useJournal,
+                             mapWorkFile,prefault,dropDir,compressKangaroo,sampleRate,
+                             quarantineWrong,quarantineMin,quarantineTime,kCheckPeriod,
+                             pipeStatFile,metricsPort,recFile);
   if(checkFlag) {
     v->Check(gpuId,gridSize);  
     exit(0);
+  } else if(statSolve.size() > 0) {
+    v->StatSolve(nbCPUThread,statSolve[0],statSolve[1],statDP,statGrp,statJump,benchFile);
+    exit(0);
+  } else if(loadGen.size() > 0) {
+    if(serverIP.length() == 0) {
+      printf("Error: -loadgen needs a server (-c)\n");
+      exit(-1);
+    }
+    if(lgDupRate < 0.0 || lgCollRate < 0.0 || lgDupRate + lgCollRate > 1.0) {
+      printf("Invalid lgdup/lgcoll arguments, must be positive and sum to 100 at most\n");
+      exit(-1);
+    }
+    v->LoadGen(loadGen[0],(double)loadGen[1],nbCPUThread,lgBatch,lgDupRate,lgCollRate,lgStorm,lgNbKang,lgTime,benchFile);
+    exit(0);
+  } else if(loopBench.size() > 0) {
+    v->LoopBench(loopBench[0],loopBench[1],nbCPUThread,benchFile);
+    exit(0);
+  } else if(benchTableDP > 0 || benchReplay.length() > 0) {
+    v->BenchTable(benchTableDP,benchDupRate,nbCPUThread,benchReplay,benchFile);
+    exit(0);
+  } else if(benchFlag) {
+    v->Bench(benchFile);
+    exit(0);
   } else {
     if(checkWorkFile.length() > 0) {
       v->CheckWorkFile(nbCPUThread,checkWorkFile);
@@ -338,6 +633,8 @@ int main(int argc, char* argv[]) {
     } if(infoFile.length()>0) {
       v->WorkInfo(infoFile);
       exit(0);
+    } else if(recDumpFile.length()>0) {
+      exit(v->RecordDump(recDumpFile,recDumpCsv) ? 0 : -1);
     } else if(mergeDir.length() > 0) {
       v->MergeDir(mergeDir,mergeDest);
       exit(0);
@@ -369,8 +666,13 @@ int main(int argc, char* argv[]) {
       }
       v->RunServer();
     }
-    else
+    else {
+      if(dropDir.length() > 0)
+        ::printf("Warning: -wdrop is only used in server mode, ignoring\n");
+      if(sampleRate > 0.0)
+        ::printf("Warning: -vsample is only used in server mode, ignoring\n");
       v->Run(nbCPUThread,gpuId,gridSize);
+    }
   }
 
   return 0;